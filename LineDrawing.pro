@@ -30,15 +30,53 @@ TEMPLATE = app
 SOURCES += main.cpp \
     linedrawingwidget.cpp \
     rtsc.cpp \
-    apparentridge.cpp
+    lineextractor.cpp \
+    perview.cpp \
+    isotree.cpp \
+    meshcache.cpp \
+    mappedfile.cpp \
+    ldmesh.cpp \
+    profiler.cpp \
+    apparentridge.cpp \
+    linestyle.cpp \
+    depthbuffer.cpp \
+    svgexport.cpp
 
 HEADERS  += \
-    linedrawingwidget.h
+    linedrawingwidget.h \
+    lineextractor.h \
+    perview.h \
+    isotree.h \
+    meshcache.h \
+    mappedfile.h \
+    ldmesh.h \
+    profiler.h \
+    linestyle.h \
+    depthbuffer.h \
+    svgexport.h
 
 INCLUDEPATH += .\include
 
+# The SIMD and scalar perview kernels only agree bit for bit
+# if the compiler doesn't fuse multiplies and adds
+*-g++*|*clang* {
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
 
-LIBS += .\lib\trimeshd.lib
+# Per-vertex and per-face loops run in parallel with OpenMP
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+
+include(libsrc/trimesh.pri)
+
+# The camera needs OpenGL, so only the viewer builds it
+SOURCES += libsrc/GLCamera.cc
 
 
 
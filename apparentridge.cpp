@@ -12,9 +12,8 @@ Implements method of
 */
 
 #include <stdio.h>
-#include "linedrawingwidget.h"
-
-#include <qgl.h>
+#include <algorithm>
+#include "lineextractor.h"
 
 using namespace std;
 
@@ -44,7 +43,7 @@ static void largest_eig_2x2(float m1, float m12, float m2, vec2 &e1, float &l1)
 // Pass in u^2, u*v, and v^2, since those are readily available.
 // Fills in q1 and t1 (using the paper's notation).
 // Note that the latter is expressed in the (pdir1,pdir2) coordinate basis
-void LineDrawingWidget::compute_viewdep_curv(const TriMesh *mesh, int i, float ndotv,
+void LineExtractor::compute_viewdep_curv(const TriMesh *mesh, int i, float ndotv,
 			  float u2, float uv, float v2,
 			  float &q1, vec2 &t1)
 {
@@ -73,7 +72,7 @@ void LineDrawingWidget::compute_viewdep_curv(const TriMesh *mesh, int i, float n
 
 // Compute D_{t_1} q_1 - the derivative of max view-dependent curvature
 // in the principal max view-dependent curvature direction.
-void LineDrawingWidget::compute_Dt1q1(const TriMesh *mesh, int i, float ndotv,
+void LineExtractor::compute_Dt1q1(const TriMesh *mesh, int i, float ndotv,
 		   const vector<float> &q1, const vector<vec2> &t1,
 		   float &Dt1q1)
 {
@@ -86,11 +85,12 @@ void LineDrawingWidget::compute_Dt1q1(const TriMesh *mesh, int i, float ndotv,
 	Dt1q1 = 0.0f;
 	int n = 0;
 
-	int naf = mesh->adjacentfaces[i].size();
+	TriMesh::AdjList af = mesh->adjacentfaces[i];
+	int naf = af.size();
 	for (int j = 0; j < naf; j++) {
 		// We're in a triangle adjacent to the vertex of interest.
 		// The current vertex is v0 - let v1 and v2 be the other two
-		int f = mesh->adjacentfaces[i][j];
+		int f = af[j];
 		int ind = mesh->faces[f].indexof(i);
 		int i1 = mesh->faces[f][NEXT(ind)];
 		int i2 = mesh->faces[f][PREV(ind)];
@@ -133,15 +133,16 @@ void LineDrawingWidget::compute_Dt1q1(const TriMesh *mesh, int i, float ndotv,
 }
 
 
-// Draw part of an apparent ridge/valley curve on one triangle face.
-// v0,v1,v2 are the indices of the 3 vertices; this function assumes that the
+// Find part of an apparent ridge/valley curve on one triangle face.
+// v0,v1,v2 are the indices of the 3 vertices of face; this function assumes that the
 // curve connects points on the edges v0-v1 and v1-v2
 // (or connects point on v0-v1 to center if to_center is true)
-void LineDrawingWidget::draw_segment_app_ridge(int v0, int v1, int v2,
+void LineExtractor::find_segment_app_ridge(int face, int v0, int v1, int v2,
 			    float emax0, float emax1, float emax2,
 			    float kmax0, float kmax1, float kmax2,
 			    const vec &tmax0, const vec &tmax1, const vec &tmax2,
-			    float thresh, bool to_center, bool do_test)
+			    float limit, bool to_center, bool do_test,
+			    ThresholdSegments &out)
 {
 	// Interpolate to find ridge/valley line segment endpoints
 	// in this triangle and the curvatures there
@@ -166,16 +167,9 @@ void LineDrawingWidget::draw_segment_app_ridge(int v0, int v1, int v2,
 		k12 = fabs(w12 * kmax1 + w21 * kmax2);
 	}
 
-	// Don't draw below threshold
-	k01 -= thresh;
-	if (k01 < 0.0f)
-		k01 = 0.0f;
-	k12 -= thresh;
-	if (k12 < 0.0f)
-		k12 = 0.0f;
-
-	// Skip lines that you can't see...
-	if (k01 == 0.0f && k12 == 0.0f)
+	// Skip lines that you can't see at any threshold...
+	limit = min(limit, max(k01, k12));
+	if (limit <= 0.0f)
 		return;
 
 	// Perform test: do the tmax-es point *towards* the segment? (Fig 6)
@@ -192,27 +186,18 @@ void LineDrawingWidget::draw_segment_app_ridge(int v0, int v1, int v2,
 			return;
 	}
 
-	// Fade lines
-	if (draw_faded) {
-		k01 /= (k01 + thresh);
-		k12 /= (k12 + thresh);
-	} else {
-		k01 = k12 = 1.0f;
-	}
-
-	// Draw the line segment
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k01);
-	glVertex3fv(p01);
-	glColor4f(currcolor[0], currcolor[1], currcolor[2], k12);
-	glVertex3fv(p12);
+	// Emit the line segment, to be faded by fade_segments
+	out.add(p01, k01, face_edge(face, v2),
+		p12, k12, to_center ? -1 : face_edge(face, v0), limit);
 }
 
 
-// Draw apparent ridges in a triangle
-void LineDrawingWidget::draw_face_app_ridges(int v0, int v1, int v2,
+// Find apparent ridges in a triangle
+void LineExtractor::find_face_app_ridges(int face, int v0, int v1, int v2,
 			  const vector<float> &ndotv, const vector<float> &q1,
 			  const vector<vec2> &t1, const vector<float> &Dt1q1,
-			  bool do_bfcull, bool do_test, float thresh)
+			  bool do_bfcull, bool do_test, float reject,
+			  ThresholdSegments &out)
 {
 #if 0
 	// Backface culling is turned off: getting contours from the
@@ -223,12 +208,14 @@ void LineDrawingWidget::draw_face_app_ridges(int v0, int v1, int v2,
 		return;
 #endif
 
-	// Trivial reject if this face isn't getting past the threshold anyway
+	// Trivial reject if this face isn't getting past the threshold
+	// anyway, and not past a higher one than its largest kmax
 	const float &kmax0 = q1[v0];
 	const float &kmax1 = q1[v1];
 	const float &kmax2 = q1[v2];
-	if (kmax0 <= thresh && kmax1 <= thresh && kmax2 <= thresh)
+	if (kmax0 <= reject && kmax1 <= reject && kmax2 <= reject)
 		return;
+	float limit = max(max(kmax0, kmax1), kmax2);
 
 	// The "tmax" are the principal directions of view-dependent curvature,
 	// flipped to point in the direction in which the curvature
@@ -255,72 +242,89 @@ void LineDrawingWidget::draw_face_app_ridges(int v0, int v1, int v2,
 	if (z01 + z12 + z20 < 2)
 		return;
 
-	// Draw line segment
+	// Extract line segment
 	if (!z01) {
-		draw_segment_app_ridge(v1, v2, v0,
-				       emax1, emax2, emax0,
-				       kmax1, kmax2, kmax0,
-				       tmax1, tmax2, tmax0,
-				       thresh, false, do_test);
+		find_segment_app_ridge(face, v1, v2, v0,
+					  emax1, emax2, emax0,
+					  kmax1, kmax2, kmax0,
+					  tmax1, tmax2, tmax0,
+					  limit, false, do_test, out);
 	} else if (!z12) {
-		draw_segment_app_ridge(v2, v0, v1,
-				       emax2, emax0, emax1,
-				       kmax2, kmax0, kmax1,
-				       tmax2, tmax0, tmax1,
-				       thresh, false, do_test);
+		find_segment_app_ridge(face, v2, v0, v1,
+					  emax2, emax0, emax1,
+					  kmax2, kmax0, kmax1,
+					  tmax2, tmax0, tmax1,
+					  limit, false, do_test, out);
 	} else if (!z20) {
-		draw_segment_app_ridge(v0, v1, v2,
-				       emax0, emax1, emax2,
-				       kmax0, kmax1, kmax2,
-				       tmax0, tmax1, tmax2,
-				       thresh, false, do_test);
+		find_segment_app_ridge(face, v0, v1, v2,
+					  emax0, emax1, emax2,
+					  kmax0, kmax1, kmax2,
+					  tmax0, tmax1, tmax2,
+					  limit, false, do_test, out);
 	} else {
 		// All three edges have crossings -- connect all to center
-		draw_segment_app_ridge(v1, v2, v0,
-				       emax1, emax2, emax0,
-				       kmax1, kmax2, kmax0,
-				       tmax1, tmax2, tmax0,
-				       thresh, true, do_test);
-		draw_segment_app_ridge(v2, v0, v1,
-				       emax2, emax0, emax1,
-				       kmax2, kmax0, kmax1,
-				       tmax2, tmax0, tmax1,
-				       thresh, true, do_test);
-		draw_segment_app_ridge(v0, v1, v2,
-				       emax0, emax1, emax2,
-				       kmax0, kmax1, kmax2,
-				       tmax0, tmax1, tmax2,
-				       thresh, true, do_test);
+		find_segment_app_ridge(face, v1, v2, v0,
+					  emax1, emax2, emax0,
+					  kmax1, kmax2, kmax0,
+					  tmax1, tmax2, tmax0,
+					  limit, true, do_test, out);
+		find_segment_app_ridge(face, v2, v0, v1,
+					  emax2, emax0, emax1,
+					  kmax2, kmax0, kmax1,
+					  tmax2, tmax0, tmax1,
+					  limit, true, do_test, out);
+		find_segment_app_ridge(face, v0, v1, v2,
+					  emax0, emax1, emax2,
+					  kmax0, kmax1, kmax2,
+					  tmax0, tmax1, tmax2,
+					  limit, true, do_test, out);
 	}
 }
 
 
-// Draw apparent ridges of the mesh
-void LineDrawingWidget::draw_mesh_app_ridges(const vector<float> &ndotv, const vector<float> &q1,
+// Find the apparent ridges of the mesh, before the threshold, skipping
+// the faces where all of them are below reject.  They are added to out.
+void LineExtractor::find_mesh_app_ridges(const vector<float> &ndotv, const vector<float> &q1,
 			  const vector<vec2> &t1, const vector<float> &Dt1q1,
-			  bool do_bfcull, bool do_test, float thresh)
+			  bool do_bfcull, bool do_test, float reject,
+			  ThresholdSegments &out)
 {
-	const int *t = &themesh->tstrips[0];
-	const int *stripend = t;
-	const int *end = t + themesh->tstrips.size();
-
-	// Walk through triangle strips
-	while (1) {
-		if (unlikely(t >= stripend)) {
-			if (unlikely(t >= end))
-				return;
-			// New strip: each strip is stored as
-			// length followed by indices
-			stripend = t + 1 + *t;
-			// Skip over length plus first two indices of
-			// first face
-			t += 3;
+	PROFILE_ZONE(profiler, "apparent ridges");
+
+	// Walk through the faces in parallel, a chunk at a time
+	int nf = themesh->faces.size();
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(threshold_buckets.size()) < nchunks)
+		threshold_buckets.resize(nchunks);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		ThresholdSegments &bucket = threshold_buckets[c];
+		bucket.clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			if (!face_drawn(i))
+				continue;
+			const TriMesh::Face &f = themesh->faces[i];
+			find_face_app_ridges(i, f[0], f[1], f[2],
+					     ndotv, q1, t1, Dt1q1,
+					     do_bfcull, do_test, reject,
+					     bucket);
 		}
-
-		draw_face_app_ridges(*(t-2), *(t-1), *t,
-				     ndotv, q1, t1, Dt1q1,
-				     do_bfcull, do_test, thresh);
-		t++;
 	}
+	for (int c = 0; c < nchunks; c++)
+		out.append(threshold_buckets[c]);
+}
+
+
+// Extract apparent ridges of the mesh
+void LineExtractor::extract_mesh_app_ridges(const vector<float> &ndotv, const vector<float> &q1,
+			  const vector<vec2> &t1, const vector<float> &Dt1q1,
+			  bool do_bfcull, bool do_test, float thresh,
+			  SegmentBuffer &out)
+{
+	threshold_segs.clear();
+	find_mesh_app_ridges(ndotv, q1, t1, Dt1q1, do_bfcull, do_test,
+			     thresh, threshold_segs);
+	fade_segments(threshold_segs, thresh, out);
 }
 
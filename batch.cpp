@@ -0,0 +1,506 @@
+/*
+batch.cpp
+Headless batch renderer: extracts the rtsc lines of a mesh for a list
+of views and writes them out as text, without Qt or an OpenGL context.
+
+Each view produces one file, prefix.NNNN.lines, containing a header with
+the camera followed by one block per non-empty line family:
+	family <name> <nsegs>
+	x0 y0 z0 alpha0 x1 y1 z1 alpha1
+	...
+Coordinates are in mesh space; alpha is the fade of the line at that
+endpoint, as it would be drawn by the viewer.
+
+With -chain, each family is written as polylines instead:
+	strokes <name> <nstrokes> <npoints>
+	n x0 y0 z0 alpha0 ... x(n-1) y(n-1) z(n-1) alpha(n-1)
+	...
+with one stroke per line.  A closed loop repeats its first point.
+
+With -svg, each view is also drawn to prefix.NNNN.svg, with the parts of
+the lines hidden by the mesh removed (see svgexport.h).  With -png, it
+is rendered to prefix.NNNN.png as the viewer would draw it (see
+lineimage.h).
+
+The views are extracted in parallel, one per thread, and each written
+out as soon as it is done (see multiview.h).  With -coherent or -trace,
+they are extracted one after another instead.
+
+With -outofcore, a .ldm mesh is worked on a cluster at a time within a
+memory budget, without ever being loaded whole (see outofcore.h).  The
+lines of each cluster are appended to the files of every view as soon as
+they are extracted, so a family can have one block per cluster, and
+strokes are broken where they leave a cluster.  There's no -svg or -png
+then, since those need the whole mesh to hide lines behind.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "timestamp.h"
+#include "lineextractor.h"
+#include "meshcache.h"
+#include "ldmesh.h"
+#include "profiler.h"
+#include "linestyle.h"
+#include "svgexport.h"
+#include "lineimage.h"
+#include "multiview.h"
+#include "outofcore.h"
+
+using namespace std;
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+
+// Same field of view as the viewer, used for the default camera distance
+static const float fov = 0.7f;
+
+
+// Write one family as strokes
+static void write_strokes(FILE *f, const char *pass, const char *name,
+			  const StrokeBuffer &b)
+{
+	fprintf(f, "strokes %s%s %d %d\n", pass, name, b.size(),
+		(int) b.pts.size());
+	for (int i = 0; i < b.size(); i++) {
+		int begin = b.stroke_begin(i), end = b.stroke_end(i);
+		fprintf(f, "%d", end - begin);
+		for (int j = begin; j < end; j++) {
+			const point &p = b.pts[j];
+			fprintf(f, " %.7g %.7g %.7g %.4g",
+				p[0], p[1], p[2], b.alpha[j]);
+		}
+		fprintf(f, "\n");
+	}
+}
+
+
+// Write the lines for one view, or with append, add them to the end of
+// the file written for it before
+static bool write_lines(const char *filename, const xform &xf,
+			const LineSet &lines, const LineSet *hidden,
+			bool chained, bool append)
+{
+	FILE *f = fopen(filename, append ? "a" : "w");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	if (!append) {
+		fprintf(f, "# linedrawing-batch\nxf");
+		for (int i = 0; i < 16; i++)
+			fprintf(f, " %.9g", xf[i]);
+		fprintf(f, "\n");
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		const LineSet *ls = pass ? hidden : &lines;
+		if (!ls)
+			continue;
+		for (int fam = 0; fam < NUM_LINE_FAMILIES; fam++) {
+			const SegmentBuffer &b = (*ls)[fam];
+			if (b.empty())
+				continue;
+			if (chained) {
+				write_strokes(f, pass ? "hidden_" : "",
+					      line_family_names[fam],
+					      ls->strokes[fam]);
+				continue;
+			}
+			fprintf(f, "family %s%s %d\n", pass ? "hidden_" : "",
+				line_family_names[fam], b.size());
+			for (int i = 0; i < (int)b.pts.size(); i += 2) {
+				const point &p0 = b.pts[i], &p1 = b.pts[i+1];
+				fprintf(f, "%.7g %.7g %.7g %.4g %.7g %.7g %.7g %.4g\n",
+					p0[0], p0[1], p0[2], b.alpha[i],
+					p1[0], p1[1], p1[2], b.alpha[i+1]);
+			}
+		}
+	}
+
+	fclose(f);
+	return true;
+}
+
+
+// Turn on the lines named in a comma-separated list
+static bool set_lines(LineOptions &opts, const char *list)
+{
+	opts.draw_c = opts.draw_sc = 0;
+
+	string s(list);
+	size_t start = 0;
+	while (start <= s.size()) {
+		size_t end = s.find(',', start);
+		if (end == string::npos)
+			end = s.size();
+		string name = s.substr(start, end - start);
+		start = end + 1;
+		if (name.empty())
+			continue;
+
+		if (name == "c") opts.draw_c = 1;
+		else if (name == "sc") opts.draw_sc = 1;
+		else if (name == "sh") opts.draw_sh = 1;
+		else if (name == "extsil") opts.draw_extsil = 1;
+		else if (name == "ridges") opts.draw_ridges = 1;
+		else if (name == "valleys") opts.draw_valleys = 1;
+		else if (name == "apparent") opts.draw_apparent = 1;
+		else if (name == "phridges") opts.draw_phridges = 1;
+		else if (name == "phvalleys") opts.draw_phvalleys = 1;
+		else if (name == "K") opts.draw_K = 1;
+		else if (name == "H") opts.draw_H = 1;
+		else if (name == "DwKr") opts.draw_DwKr = 1;
+		else if (name == "bdy") opts.draw_bdy = 1;
+		else if (name == "isoph") opts.draw_isoph = 1;
+		else if (name == "topo") opts.draw_topo = 1;
+		else {
+			fprintf(stderr, "Unknown line type %s\n", name.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Writes out the lines of each view as they are extracted, to
+// prefix.NNNN.lines and, if asked for, .svg and .png, and counts them.
+// Views can be written from several threads at once.  With append, the
+// lines go after those already written for the view.
+class BatchWriter : public ViewSink {
+public:
+	const TriMesh *mesh;
+	const char *prefix;
+	bool chained, append;
+	bool do_svg, do_png;
+	SvgOptions svg;
+	LineImageOptions png;
+	LineStyle styles[NUM_LINE_FAMILIES];
+	LineStyle hidden_styles[NUM_LINE_FAMILIES];
+	FrameProfiler *profiler;	// Only when writing from one thread
+	int nsegs, nstrokes, nstrokepts;
+
+	BatchWriter(const TriMesh *mesh_, const char *prefix_, bool chained_) :
+		mesh(mesh_), prefix(prefix_), chained(chained_), append(false),
+		do_svg(false), do_png(false), profiler(NULL),
+		nsegs(0), nstrokes(0), nstrokepts(0)
+	{}
+	bool view_done(int v, const xform &xf, const LineSet &lines,
+		       const LineSet *hidden);
+};
+
+
+bool BatchWriter::view_done(int v, const xform &xf, const LineSet &lines,
+			    const LineSet *hidden)
+{
+	int n = 0, ns = 0, nsp = 0;
+	for (int fam = 0; fam < NUM_LINE_FAMILIES; fam++) {
+		n += lines[fam].size();
+		ns += lines.strokes[fam].size();
+		nsp += lines.strokes[fam].pts.size();
+	}
+#pragma omp critical (batch_counts)
+	{
+		nsegs += n;
+		nstrokes += ns;
+		nstrokepts += nsp;
+	}
+
+	char filename[1024];
+	sprintf(filename, "%.1000s.%04d.lines", prefix, v);
+	{
+		PROFILE_ZONE(profiler, "write_lines");
+		if (!write_lines(filename, xf, lines, hidden, chained,
+				 append))
+			return false;
+	}
+	if (do_svg) {
+		PROFILE_ZONE(profiler, "write_svg");
+		sprintf(filename, "%.1000s.%04d.svg", prefix, v);
+		if (!write_svg(filename, mesh, xf, lines, styles, hidden,
+			       hidden_styles, svg))
+			return false;
+	}
+	if (do_png) {
+		LineImage image;
+		sprintf(filename, "%.1000s.%04d.png", prefix, v);
+		{
+			PROFILE_ZONE(profiler, "render_line_image");
+			render_line_image(image, mesh, xf, lines, styles,
+					  hidden, hidden_styles, png);
+		}
+		PROFILE_ZONE(profiler, "write_png");
+		if (!image.write_png(filename))
+			return false;
+	}
+	return true;
+}
+
+
+static void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [-options] infile [view.xf ...]\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-lines l1,l2,...  Lines to extract (default c,sc).  One of:\n");
+	fprintf(stderr, "			  c sc sh extsil ridges valleys apparent\n");
+	fprintf(stderr, "			  phridges phvalleys K H DwKr bdy isoph topo\n");
+	fprintf(stderr, "	-orbit n	  Add n views orbiting the mesh about the y axis\n");
+	fprintf(stderr, "	-o prefix	  Output to prefix.NNNN.lines (default: infile)\n");
+	fprintf(stderr, "	-hidden		  Also write the lines of the hidden-line pass\n");
+	fprintf(stderr, "	-notests	  Turn off the tests on c, sc, sh, ph, ridges, apparent\n");
+	fprintf(stderr, "	-nofade		  Don't fade lines near their thresholds\n");
+	fprintf(stderr, "	-hermite	  Place sc and sh by Hermite interpolation\n");
+	fprintf(stderr, "	-chain		  Write the lines as chained polylines\n");
+	fprintf(stderr, "	-svg w h	  Also draw each view to prefix.NNNN.svg, w x h pixels\n");
+	fprintf(stderr, "	-png w h	  Also render each view to prefix.NNNN.png\n");
+	fprintf(stderr, "	-nocache	  Don't read or write infile.ldcache\n");
+	fprintf(stderr, "	-noreorder	  Keep the mesh's own vertex and face order\n");
+	fprintf(stderr, "	-coherent slack	  Reuse per-view values between nearby views\n");
+	fprintf(stderr, "	-trace file.json  Write the time of each stage as a Chrome trace\n");
+	fprintf(stderr, "	-outofcore mb	  Work on a .ldm mesh a cluster at a time, in about mb MB\n");
+	fprintf(stderr, "If no views are given, uses the viewer's default one.\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *myname = argv[0];
+	LineOptions opts;
+	int norbit = 0;
+	bool do_hidden = false;
+	const char *prefix = NULL;
+	bool use_cache = true;
+	bool reorder = true;
+	const char *tracefile = NULL;
+	bool write_chained = false;
+	SvgOptions svg;
+	bool do_svg = false;
+	LineImageOptions png;
+	bool do_png = false;
+	size_t outofcore = 0;
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (!strcmp(argv[1], "-lines") && argc > 2) {
+			if (!set_lines(opts, argv[2]))
+				usage(myname);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-orbit") && argc > 2) {
+			norbit = atoi(argv[2]);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-o") && argc > 2) {
+			prefix = argv[2];
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-hidden")) {
+			do_hidden = true;
+		} else if (!strcmp(argv[1], "-notests")) {
+			opts.test_c = opts.test_sc = opts.test_sh = 0;
+			opts.test_ph = opts.test_rv = opts.test_ar = 0;
+		} else if (!strcmp(argv[1], "-nofade")) {
+			opts.draw_faded = 0;
+		} else if (!strcmp(argv[1], "-hermite")) {
+			opts.use_hermite = 1;
+		} else if (!strcmp(argv[1], "-chain")) {
+			write_chained = true;
+		} else if (!strcmp(argv[1], "-svg") && argc > 3) {
+			do_svg = true;
+			svg.width = atoi(argv[2]);
+			svg.height = atoi(argv[3]);
+			if (svg.width <= 0 || svg.height <= 0)
+				usage(myname);
+			argc -= 2, argv += 2;
+		} else if (!strcmp(argv[1], "-png") && argc > 3) {
+			do_png = true;
+			png.width = atoi(argv[2]);
+			png.height = atoi(argv[3]);
+			if (png.width <= 0 || png.height <= 0)
+				usage(myname);
+			argc -= 2, argv += 2;
+		} else if (!strcmp(argv[1], "-nocache")) {
+			use_cache = false;
+		} else if (!strcmp(argv[1], "-noreorder")) {
+			reorder = false;
+		} else if (!strcmp(argv[1], "-coherent") && argc > 2) {
+			opts.coherent = 1;
+			opts.coherence_slack = atof(argv[2]);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-trace") && argc > 2) {
+			tracefile = argv[2];
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-outofcore") && argc > 2) {
+			outofcore = size_t(atof(argv[2]) * 1048576.0);
+			if (!outofcore)
+				usage(myname);
+			argc--, argv++;
+		} else {
+			usage(myname);
+		}
+		argc--, argv++;
+	}
+	if (argc < 2)
+		usage(myname);
+	const char *infilename = argv[1];
+	if (!prefix)
+		prefix = infilename;
+	opts.draw_hidden = do_hidden;
+	svg.fov = png.fov = fov;
+	if (outofcore) {
+		if (!is_ldm_filename(infilename)) {
+			fprintf(stderr, "-outofcore needs a .ldm mesh\n");
+			exit(1);
+		}
+		if (do_svg || do_png || opts.coherent || tracefile) {
+			fprintf(stderr, "-outofcore can't be used with -svg, "
+					"-png, -coherent or -trace\n");
+			exit(1);
+		}
+	}
+
+	// Paths in the SVG follow the chained lines
+	opts.chain_lines = (write_chained || do_svg);
+
+	// Keep every view, and the loading, in the profiler's history
+	int nviews = max(argc - 2 + norbit, 1);
+	FrameProfiler profiler(nviews + 1);
+
+	TriMesh *themesh = NULL;
+	OutOfCoreMesh clusters;
+	TriMesh::BSphere bsphere;
+	float feature_size;
+	LineExtractor extractor;
+	extractor.set_options(opts);
+	timestamp t0 = now();
+	if (outofcore) {
+		// The mesh stays in the file, and the lines are extracted
+		// later, a cluster at a time
+		if (!clusters.open(infilename, outofcore))
+			usage(myname);
+		bsphere = clusters.bsphere();
+		fprintf(stderr, "Split mesh into %d clusters in %.3f sec.\n",
+			clusters.nclusters(), now() - t0);
+		t0 = now();
+		feature_size = clusters.feature_size();
+		fprintf(stderr, "Found feature size in %.3f sec.\n",
+			now() - t0);
+	} else {
+		profiler.begin_frame();
+		profiler.enter("read_mesh");
+		themesh = read_mesh(infilename, &feature_size);
+		profiler.leave();
+		if (!themesh)
+			usage(myname);
+		t0 = now();
+		string cachename = mesh_cache_name(infilename);
+		profiler.enter("prepare_mesh");
+		feature_size = prepare_mesh(themesh,
+			use_cache ? cachename.c_str() : NULL, reorder,
+			feature_size);
+		profiler.leave();
+		bsphere = themesh->bsphere;
+
+		extractor.set_mesh(themesh, feature_size);
+		extractor.profiler = &profiler;
+		profiler.end_frame();
+		fprintf(stderr, "Prepared mesh in %.3f sec.\n", now() - t0);
+	}
+
+	// Views: the xf files on the command line, then the orbit
+	vector<xform> views;
+	for (int i = 2; i < argc; i++) {
+		xform xf;
+		if (!xf.read(argv[i])) {
+			fprintf(stderr, "Couldn't read %s\n", argv[i]);
+			exit(1);
+		}
+		views.push_back(xf);
+	}
+	xform home = xform::trans(0, 0, -3.5f / fov * bsphere.r);
+	for (int i = 0; i < norbit; i++) {
+		double angle = 2.0 * M_PI * i / norbit;
+		views.push_back(home * xform::rot(angle, 0, 1, 0) *
+				xform::trans(-bsphere.center));
+	}
+	if (views.empty())
+		views.push_back(home * xform::trans(-bsphere.center));
+	nviews = views.size();
+
+	BatchWriter writer(themesh, prefix, write_chained);
+	writer.do_svg = do_svg;
+	writer.svg = svg;
+	writer.do_png = do_png;
+	writer.png = png;
+	find_line_styles(opts, false, false, false, writer.styles);
+	find_line_styles(opts, false, false, true, writer.hidden_styles);
+
+	double nrecomputed = 0;
+	t0 = now();
+	if (outofcore) {
+		// Start each view's file, and then add the lines of each
+		// cluster to them
+		LineSet none;
+		for (int v = 0; v < nviews; v++)
+			if (!writer.view_done(v, views[v], none, NULL))
+				exit(1);
+		writer.append = true;
+		if (!clusters.extract_views(extractor, views, do_hidden,
+					    feature_size, writer))
+			exit(1);
+	} else if (opts.coherent || tracefile) {
+		// One view after another, for temporal coherence and so that
+		// the stages of each view can be timed
+		LineSet lines, hidden;
+		writer.profiler = &profiler;
+		for (int v = 0; v < nviews; v++) {
+			profiler.begin_frame();
+			extractor.set_view(views[v]);
+			profiler.enter("compute_perview");
+			extractor.compute_perview();
+			profiler.leave();
+			nrecomputed += extractor.perview_recomputed;
+			profiler.enter("extract");
+			extractor.extract(lines);
+			profiler.leave();
+			if (do_hidden) {
+				profiler.enter("extract hidden");
+				extractor.extract(hidden, true);
+				profiler.leave();
+			}
+			if (!writer.view_done(v, views[v], lines,
+					      do_hidden ? &hidden : NULL))
+				exit(1);
+			profiler.end_frame();
+		}
+	} else if (!extract_views(extractor, views, do_hidden, writer)) {
+		exit(1);
+	}
+	int nsegs = writer.nsegs;
+	int nstrokes = writer.nstrokes, nstrokepts = writer.nstrokepts;
+	float elapsed = now() - t0;
+	fprintf(stderr, "%d views, %d segments in %.3f sec. (%.2f msec/view)\n",
+		(int) views.size(), nsegs, elapsed,
+		1000.0f * elapsed / views.size());
+	if (outofcore)
+		fprintf(stderr, "Loaded %.1f%% more faces for the halos.\n",
+			100.0 * clusters.faces_loaded / clusters.nfaces() -
+			100.0);
+	if (opts.chain_lines && nsegs)
+		fprintf(stderr, "Chained into %d strokes of %d points "
+			"(%.1f%% of the segment endpoints).\n", nstrokes,
+			nstrokepts, 50.0 * nstrokepts / nsegs);
+	if (opts.coherent)
+		fprintf(stderr, "Recomputed %.1f%% of per-view values.\n",
+			100.0 * nrecomputed /
+			(views.size() * themesh->vertices.size()));
+	if (tracefile && !profiler.write_chrome_trace(tracefile))
+		exit(1);
+
+	delete themesh;
+	return 0;
+}
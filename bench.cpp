@@ -0,0 +1,445 @@
+/*
+bench.cpp
+Benchmark of the line extraction across mesh sizes, for catching
+performance regressions.
+
+Each input mesh (data/horse.obj by default) is benchmarked as it is and
+after each round of Loop subdivision, which multiplies the face count by
+four, as long as it stays under -maxfaces (10M by default).  For every
+size this times:
+	- preprocessing: reorder_mesh_locality, each need_* call that
+	  prepare_mesh and the extractor depend on, and mesh_feature_size,
+	  on a fresh copy of the mesh for each of -reps repetitions;
+	- compute_perview, with everything needed by all the line families;
+	- extract, once for each line family on its own, and for
+	  suggestive contours and highlights with Hermite interpolation,
+over a fixed orbit of -views camera poses, after one untimed warm-up view.
+
+The median and 99th percentile of each stage are printed, and written to
+prefix.csv and prefix.json (prefix is linedrawing-bench unless -o is
+given).  Everything is deterministic except the times themselves, so runs
+of two builds on the same machine, with the same OMP_NUM_THREADS, can be
+compared stage by stage.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "XForm.h"
+#include "timestamp.h"
+#include "lineextractor.h"
+#include "ldmesh.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+
+using namespace std;
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+
+// The line families, by the names linedrawing-batch uses for them
+static const struct {
+	const char *name;
+	int LineOptions::*flag;
+} families[] = {
+	{ "c",		&LineOptions::draw_c },
+	{ "sc",		&LineOptions::draw_sc },
+	{ "sh",		&LineOptions::draw_sh },
+	{ "extsil",	&LineOptions::draw_extsil },
+	{ "ridges",	&LineOptions::draw_ridges },
+	{ "valleys",	&LineOptions::draw_valleys },
+	{ "apparent",	&LineOptions::draw_apparent },
+	{ "phridges",	&LineOptions::draw_phridges },
+	{ "phvalleys",	&LineOptions::draw_phvalleys },
+	{ "K",		&LineOptions::draw_K },
+	{ "H",		&LineOptions::draw_H },
+	{ "DwKr",	&LineOptions::draw_DwKr },
+	{ "bdy",	&LineOptions::draw_bdy },
+	{ "isoph",	&LineOptions::draw_isoph },
+	{ "topo",	&LineOptions::draw_topo },
+};
+static const int nfamilies = sizeof(families) / sizeof(families[0]);
+
+// The preprocessing, in an order in which each call finds what it
+// depends on already computed
+static const struct {
+	const char *name;
+	void (TriMesh::*call)();
+} prep_stages[] = {
+	{ "need_adjacentfaces",	&TriMesh::need_adjacentfaces },
+	{ "need_neighbors",	&TriMesh::need_neighbors },
+	{ "need_across_edge",	&TriMesh::need_across_edge },
+	{ "need_tstrips",	&TriMesh::need_tstrips },
+	{ "need_bsphere",	&TriMesh::need_bsphere },
+	{ "need_normals",	&TriMesh::need_normals },
+	{ "need_pointareas",	&TriMesh::need_pointareas },
+	{ "need_curvatures",	&TriMesh::need_curvatures },
+	{ "need_dcurv",		&TriMesh::need_dcurv },
+};
+static const int nprep_stages = sizeof(prep_stages) / sizeof(prep_stages[0]);
+
+
+// The times of one stage, in seconds
+struct Stage {
+	string name;
+	vector<double> samples;
+};
+
+// All the stages for one mesh
+struct MeshResult {
+	string mesh;
+	int faces, vertices;
+	vector<Stage> stages;
+};
+
+
+// Add a sample to the named stage, creating it if needed
+static void add_sample(vector<Stage> &stages, const string &name, double t)
+{
+	for (size_t i = 0; i < stages.size(); i++) {
+		if (stages[i].name == name) {
+			stages[i].samples.push_back(t);
+			return;
+		}
+	}
+	stages.push_back(Stage());
+	stages.back().name = name;
+	stages.back().samples.push_back(t);
+}
+
+
+// The p-th quantile of the samples, interpolating between the nearest two
+static double quantile(vector<double> samples, double p)
+{
+	if (samples.empty())
+		return 0.0;
+	sort(samples.begin(), samples.end());
+	double x = p * (samples.size() - 1);
+	size_t i = (size_t) x;
+	if (i + 1 >= samples.size())
+		return samples.back();
+	return samples[i] + (x - i) * (samples[i+1] - samples[i]);
+}
+
+
+// A copy of just the geometry of a mesh, with nothing computed
+static TriMesh *bare_copy(const TriMesh *mesh)
+{
+	TriMesh *copy = new TriMesh;
+	copy->vertices = mesh->vertices;
+	copy->faces = mesh->faces;
+	return copy;
+}
+
+
+// Time the preprocessing on fresh copies of the mesh, and return the
+// last copy, prepared, along with its feature size
+static TriMesh *bench_prep(const TriMesh *base, int reps,
+			   vector<Stage> &stages, float &feature_size)
+{
+	TriMesh *mesh = NULL;
+	for (int r = 0; r < reps; r++) {
+		delete mesh;
+		mesh = bare_copy(base);
+
+		vector<int> remap;
+		timestamp t = now();
+		reorder_mesh_locality(mesh, &remap);
+		add_sample(stages, "reorder_mesh_locality", now() - t);
+
+		// Start the rest from scratch, including the strips that
+		// reordering leaves behind
+		mesh->tstrips.clear();
+		mesh->adjacentfaces.clear();
+		for (int i = 0; i < nprep_stages; i++) {
+			t = now();
+			(mesh->*prep_stages[i].call)();
+			add_sample(stages, prep_stages[i].name, now() - t);
+		}
+
+		t = now();
+		feature_size = mesh_feature_size(mesh, &remap);
+		add_sample(stages, "mesh_feature_size", now() - t);
+	}
+	return mesh;
+}
+
+
+// Time compute_perview and the extraction of each family over the views
+static void bench_views(TriMesh *mesh, float feature_size,
+			const vector<xform> &views, vector<Stage> &stages)
+{
+	// compute_perview does what every family needs...
+	LineOptions all, none;
+	for (int i = 0; i < nfamilies; i++) {
+		all.*families[i].flag = 1;
+		none.*families[i].flag = 0;
+	}
+
+	LineExtractor extractor;
+	extractor.set_mesh(mesh, feature_size);
+	LineSet lines;
+
+	// ... after a warm-up view, which also builds the K and H trees
+	for (int v = -1; v < (int) views.size(); v++) {
+		const xform &xf = views[max(v, 0)];
+		extractor.set_options(all);
+		extractor.set_view(xf);
+		timestamp t = now();
+		extractor.compute_perview();
+		double tperview = now() - t;
+		if (v >= 0)
+			add_sample(stages, "compute_perview", tperview);
+
+		// ... while each family is extracted on its own
+		for (int i = 0; i < nfamilies; i++) {
+			LineOptions opts = none;
+			opts.*families[i].flag = 1;
+			extractor.set_options(opts);
+			t = now();
+			extractor.extract(lines);
+			double textract = now() - t;
+			if (v >= 0)
+				add_sample(stages, string("extract ") +
+					   families[i].name, textract);
+		}
+
+		// Suggestive contours and highlights again, placed by
+		// Hermite interpolation.  Setting the view again makes each
+		// start without the gradients cached by the other.
+		for (int i = 0; i < 2; i++) {
+			LineOptions opts = none;
+			opts.use_hermite = 1;
+			if (i)
+				opts.draw_sh = 1;
+			else
+				opts.draw_sc = 1;
+			extractor.set_options(opts);
+			extractor.set_view(xf);
+			t = now();
+			extractor.extract(lines);
+			double textract = now() - t;
+			if (v >= 0)
+				add_sample(stages, i ? "extract sh hermite" :
+					   "extract sc hermite", textract);
+		}
+	}
+}
+
+
+// Benchmark one mesh
+static void bench_mesh(const TriMesh *base, const char *name, int nviews,
+		       int reps, vector<MeshResult> &results)
+{
+	results.push_back(MeshResult());
+	MeshResult &res = results.back();
+	res.mesh = name;
+	res.faces = base->faces.size();
+	res.vertices = base->vertices.size();
+	fprintf(stderr, "%s: %d vertices, %d faces\n", name,
+		res.vertices, res.faces);
+
+	float feature_size;
+	TriMesh *mesh = bench_prep(base, reps, res.stages, feature_size);
+
+	// The orbit used by linedrawing-batch -orbit
+	vector<xform> views;
+	xform home = xform::trans(0, 0, -5.0f * mesh->bsphere.r);
+	for (int i = 0; i < nviews; i++) {
+		double angle = 2.0 * M_PI * i / nviews;
+		views.push_back(home * xform::rot(angle, 0, 1, 0) *
+				xform::trans(-mesh->bsphere.center));
+	}
+	bench_views(mesh, feature_size, views, res.stages);
+	delete mesh;
+}
+
+
+// Write a string as a JSON string literal
+static void write_json_string(FILE *f, const string &s)
+{
+	putc('"', f);
+	for (size_t i = 0; i < s.size(); i++) {
+		char c = s[i];
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if ((unsigned char) c < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char) c);
+		else
+			putc(c, f);
+	}
+	putc('"', f);
+}
+
+
+// Write the results as CSV, one row per mesh and stage
+static bool write_csv(const char *filename, const vector<MeshResult> &results)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+	fprintf(f, "mesh,faces,vertices,stage,samples,median_ms,p99_ms\n");
+	for (size_t m = 0; m < results.size(); m++) {
+		const MeshResult &res = results[m];
+		for (size_t s = 0; s < res.stages.size(); s++) {
+			const Stage &st = res.stages[s];
+			fprintf(f, "\"%s\",%d,%d,%s,%d,%.4f,%.4f\n",
+				res.mesh.c_str(), res.faces, res.vertices,
+				st.name.c_str(), (int) st.samples.size(),
+				1000.0 * quantile(st.samples, 0.5),
+				1000.0 * quantile(st.samples, 0.99));
+		}
+	}
+	bool ok = !ferror(f);
+	if (fclose(f) != 0)
+		ok = false;
+	return ok;
+}
+
+
+// Write the results, and the settings they were taken with, as JSON
+static bool write_json(const char *filename, const vector<MeshResult> &results,
+		       int nviews, int reps, int nthreads)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+	fprintf(f, "{\"views\":%d,\"reps\":%d,\"threads\":%d,\"meshes\":[",
+		nviews, reps, nthreads);
+	for (size_t m = 0; m < results.size(); m++) {
+		const MeshResult &res = results[m];
+		fprintf(f, "%s\n{\"mesh\":", m ? "," : "");
+		write_json_string(f, res.mesh);
+		fprintf(f, ",\"faces\":%d,\"vertices\":%d,\"stages\":[",
+			res.faces, res.vertices);
+		for (size_t s = 0; s < res.stages.size(); s++) {
+			const Stage &st = res.stages[s];
+			fprintf(f, "%s\n {\"stage\":", s ? "," : "");
+			write_json_string(f, st.name);
+			fprintf(f, ",\"samples\":%d,\"median_ms\":%.4f,"
+				   "\"p99_ms\":%.4f}",
+				(int) st.samples.size(),
+				1000.0 * quantile(st.samples, 0.5),
+				1000.0 * quantile(st.samples, 0.99));
+		}
+		fprintf(f, "]}");
+	}
+	fprintf(f, "\n]}\n");
+	bool ok = !ferror(f);
+	if (fclose(f) != 0)
+		ok = false;
+	return ok;
+}
+
+
+static void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [-options] [infile ...]\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-maxfaces n	Subdivide while under n faces (default 10000000)\n");
+	fprintf(stderr, "	-views n	Number of orbit views (default 16)\n");
+	fprintf(stderr, "	-reps n		Repetitions of the preprocessing (default 3)\n");
+	fprintf(stderr, "	-o prefix	Write prefix.csv and prefix.json (default linedrawing-bench)\n");
+	fprintf(stderr, "The default infile is data/horse.obj.\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *myname = argv[0];
+	long long maxfaces = 10000000;
+	int nviews = 16, reps = 3;
+	const char *prefix = "linedrawing-bench";
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (!strcmp(argv[1], "-maxfaces") && argc > 2) {
+			maxfaces = atoll(argv[2]);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-views") && argc > 2) {
+			nviews = max(atoi(argv[2]), 1);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-reps") && argc > 2) {
+			reps = max(atoi(argv[2]), 1);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-o") && argc > 2) {
+			prefix = argv[2];
+			argc--, argv++;
+		} else {
+			usage(myname);
+		}
+		argc--, argv++;
+	}
+	vector<const char *> infiles(argv + 1, argv + argc);
+	if (infiles.empty())
+		infiles.push_back("data/horse.obj");
+
+	int nthreads = 1;
+#ifdef _OPENMP
+	nthreads = omp_get_max_threads();
+#endif
+
+	vector<MeshResult> results;
+	for (size_t i = 0; i < infiles.size(); i++) {
+		TriMesh *mesh = read_mesh(infiles[i]);
+		if (!mesh)
+			usage(myname);
+		mesh->need_faces();
+		TriMesh *base = bare_copy(mesh);
+		delete mesh;
+
+		// The mesh as it is, then subdivided while it's small enough
+		for (int level = 0; ; level++) {
+			char name[1024];
+			if (level)
+				sprintf(name, "%.1000s subdiv %d", infiles[i], level);
+			else
+				sprintf(name, "%.1000s", infiles[i]);
+			bench_mesh(base, name, nviews, reps, results);
+
+			if (4LL * (long long) base->faces.size() > maxfaces)
+				break;
+			subdiv(base);
+			TriMesh *next = bare_copy(base);
+			delete base;
+			base = next;
+		}
+		delete base;
+	}
+
+	printf("%-28s %10s %-24s %7s %12s %12s\n", "mesh", "faces", "stage",
+	       "samples", "median ms", "p99 ms");
+	for (size_t m = 0; m < results.size(); m++) {
+		const MeshResult &res = results[m];
+		for (size_t s = 0; s < res.stages.size(); s++) {
+			const Stage &st = res.stages[s];
+			printf("%-28s %10d %-24s %7d %12.3f %12.3f\n",
+			       res.mesh.c_str(), res.faces, st.name.c_str(),
+			       (int) st.samples.size(),
+			       1000.0 * quantile(st.samples, 0.5),
+			       1000.0 * quantile(st.samples, 0.99));
+		}
+	}
+
+	string csvname = string(prefix) + ".csv";
+	string jsonname = string(prefix) + ".json";
+	if (!write_csv(csvname.c_str(), results) ||
+	    !write_json(jsonname.c_str(), results, nviews, reps, nthreads)) {
+		fprintf(stderr, "Couldn't write the results\n");
+		return 1;
+	}
+	fprintf(stderr, "Wrote %s and %s\n", csvname.c_str(), jsonname.c_str());
+	return 0;
+}
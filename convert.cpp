@@ -0,0 +1,160 @@
+/*
+convert.cpp
+Converts meshes in any format TriMesh::read understands (OBJ, PLY, ...)
+to the memory-mappable .ldm format.  With -prepare, also computes and
+stores everything prepare_mesh() would, so that loading the .ldm needs
+no further processing, along with the feature size, which can't be found
+again once the mesh has been reordered.
+
+With -check, the lines of an orbit of views around the .ldm that was
+written are compared with those of the input mesh, each prepared the way
+linedrawing-batch would, and the program fails unless every family has
+the same number of segments in every view.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "timestamp.h"
+#include "lineextractor.h"
+#include "ldmesh.h"
+
+using namespace std;
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+#define CHECK_VIEWS 8
+
+
+// Read a mesh and prepare it as linedrawing-batch does
+static TriMesh *read_prepared(const char *filename, float &feature_size)
+{
+	TriMesh *mesh = read_mesh(filename, &feature_size);
+	if (mesh)
+		feature_size = prepare_mesh(mesh, NULL, true, feature_size);
+	return mesh;
+}
+
+
+// Compare the number of segments of every line family, in an orbit of
+// views, on the input mesh and the .ldm written from it
+static bool check_lines(const char *infilename, const char *ldmfilename)
+{
+	const char *names[2] = { infilename, ldmfilename };
+	TriMesh *meshes[2];
+	LineExtractor extractors[2];
+	LineOptions opts;
+	opts.draw_c = opts.draw_sc = opts.draw_sh = 1;
+	opts.draw_ridges = opts.draw_valleys = opts.draw_apparent = 1;
+	opts.draw_phridges = opts.draw_phvalleys = 1;
+	opts.draw_K = opts.draw_H = opts.draw_DwKr = 1;
+	opts.draw_bdy = opts.draw_isoph = opts.draw_topo = 1;
+	for (int m = 0; m < 2; m++) {
+		float feature_size;
+		meshes[m] = read_prepared(names[m], feature_size);
+		if (!meshes[m])
+			return false;
+		extractors[m].set_mesh(meshes[m], feature_size);
+		extractors[m].set_options(opts);
+	}
+
+	const TriMesh::BSphere &bs = meshes[0]->bsphere;
+	xform home = xform::trans(0, 0, -5.0f * bs.r);
+	bool same = true;
+	for (int v = 0; v < CHECK_VIEWS; v++) {
+		double angle = 2.0 * M_PI * v / CHECK_VIEWS;
+		xform xf = home * xform::rot(angle, 0, 1, 0) *
+			   xform::trans(-bs.center);
+		LineSet lines[2];
+		for (int m = 0; m < 2; m++) {
+			extractors[m].set_view(xf);
+			extractors[m].compute_perview();
+			extractors[m].extract(lines[m]);
+		}
+		for (int fam = 0; fam < NUM_LINE_FAMILIES; fam++) {
+			int n0 = lines[0][fam].size(), n1 = lines[1][fam].size();
+			if (n0 == n1)
+				continue;
+			fprintf(stderr, "View %d: %d %s segments in %s, "
+					"%d in %s\n", v, n0,
+				line_family_names[fam], infilename,
+				n1, ldmfilename);
+			same = false;
+		}
+	}
+
+	for (int m = 0; m < 2; m++)
+		delete meshes[m];
+	return same;
+}
+
+
+static void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [-options] infile outfile.ldm\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-prepare	Also store strips, normals, curvatures and dcurv\n");
+	fprintf(stderr, "	-check		Check that the .ldm gives the same lines as infile\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *myname = argv[0];
+	bool prepare = false, check = false;
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (!strcmp(argv[1], "-prepare"))
+			prepare = true;
+		else if (!strcmp(argv[1], "-check"))
+			check = true;
+		else
+			usage(myname);
+		argc--, argv++;
+	}
+	if (argc != 3 || !is_ldm_filename(argv[2]))
+		usage(myname);
+
+	float feature_size;
+	TriMesh *mesh = read_mesh(argv[1], &feature_size);
+	if (!mesh)
+		usage(myname);
+	mesh->need_faces();
+
+	if (prepare) {
+		timestamp t0 = now();
+		feature_size = prepare_mesh(mesh, NULL, true, feature_size);
+		fprintf(stderr, "Prepared mesh in %.3f sec.\n", now() - t0);
+	} else {
+		// Keep only the vertices and faces, and the bounding sphere,
+		// which is what OutOfCoreMesh would otherwise have to copy
+		// all the vertices to find
+		mesh->need_bsphere();
+		TriMesh *bare = new TriMesh;
+		bare->vertices.swap(mesh->vertices);
+		bare->faces.swap(mesh->faces);
+		bare->bsphere = mesh->bsphere;
+		delete mesh;
+		mesh = bare;
+	}
+
+	if (!write_ldm(argv[2], mesh, feature_size))
+		exit(1);
+	fprintf(stderr, "Wrote %s: %d vertices, %d faces\n", argv[2],
+		(int) mesh->vertices.size(), (int) mesh->faces.size());
+
+	delete mesh;
+
+	if (check) {
+		if (!check_lines(argv[1], argv[2]))
+			exit(1);
+		fprintf(stderr, "%s gives the same lines as %s\n",
+			argv[2], argv[1]);
+	}
+	return 0;
+}
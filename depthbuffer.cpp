@@ -0,0 +1,209 @@
+/*
+depthbuffer.cpp
+Occlusion by the mesh, worked out on the CPU: see depthbuffer.h.
+*/
+
+#include <float.h>
+#include <algorithm>
+#include "depthbuffer.h"
+
+using namespace std;
+
+// As in GLCamera
+#define MAXDOF 10000.0f
+
+// Size of the tiles faces are binned into, in samples
+#define DEPTH_TILE 64
+
+
+// Set up the view.  The near plane is just in front of the mesh's
+// bounding sphere, as long as that isn't too close to the eye.
+void ScreenProjection::set(const TriMesh *mesh, const xform &xf_,
+			   int width_, int height_, float fov)
+{
+	xf = xf_;
+	width = width_;
+	height = height_;
+	float diag = sqrt(float(sqr(width) + sqr(height)));
+	scale = diag / fov;
+
+	point center = xf * mesh->bsphere.center;
+	float r = mesh->bsphere.r;
+	neardist = max(-(center[2] + r), r / MAXDOF);
+}
+
+
+// A front face, set up for rasterization
+struct DepthTriangle {
+	float x0, y0, x1, y1, x2, y2;	// In samples
+	float q0, q1, q2;
+	float rarea;			// 1 / (twice the signed area)
+	float offset;			// Polygon offset, in 1/z
+	int ixmin, ixmax, iymin, iymax;	// Samples whose centers might be in
+};
+
+
+// Set up a face, returning false if it is culled or clipped
+static bool setup_triangle(const TriMesh::Face &f, const float *sx,
+			   const float *sy, const float *sq, int width,
+			   int height, float offset_factor, float units,
+			   DepthTriangle &t)
+{
+	t.q0 = sq[f[0]]; t.q1 = sq[f[1]]; t.q2 = sq[f[2]];
+	if (t.q0 == 0.0f || t.q1 == 0.0f || t.q2 == 0.0f)
+		return false;
+	t.x0 = sx[f[0]]; t.x1 = sx[f[1]]; t.x2 = sx[f[2]];
+	t.y0 = sy[f[0]]; t.y1 = sy[f[1]]; t.y2 = sy[f[2]];
+
+	// Twice the signed area, which is negative for front faces since y
+	// points down
+	float area = (t.x1 - t.x0) * (t.y2 - t.y0) -
+		     (t.x2 - t.x0) * (t.y1 - t.y0);
+	if (!(area < 0.0f))
+		return false;
+	t.rarea = 1.0f / area;
+
+	// The depth slope, for the polygon offset
+	float dqdx = (t.q0 * (t.y1 - t.y2) + t.q1 * (t.y2 - t.y0) +
+		      t.q2 * (t.y0 - t.y1)) * t.rarea;
+	float dqdy = (t.q0 * (t.x2 - t.x1) + t.q1 * (t.x0 - t.x2) +
+		      t.q2 * (t.x1 - t.x0)) * t.rarea;
+	t.offset = offset_factor * max(fabs(dqdx), fabs(dqdy)) + units;
+
+	float xlo = max(min(min(t.x0, t.x1), t.x2), -1.0f);
+	float xhi = min(max(max(t.x0, t.x1), t.x2), float(width));
+	float ylo = max(min(min(t.y0, t.y1), t.y2), -1.0f);
+	float yhi = min(max(max(t.y0, t.y1), t.y2), float(height));
+	t.ixmin = max(0, int(ceil(xlo - 0.5f)));
+	t.ixmax = min(width - 1, int(floor(xhi - 0.5f)));
+	t.iymin = max(0, int(ceil(ylo - 0.5f)));
+	t.iymax = min(height - 1, int(floor(yhi - 0.5f)));
+	return t.ixmin <= t.ixmax && t.iymin <= t.iymax;
+}
+
+
+// Rasterize the part of a triangle within [x0, x1) x [y0, y1).  Samples
+// are at pixel centers, and a sample on an edge is covered by the faces
+// on both sides of it.
+static void raster_triangle(const DepthTriangle &t, int x0, int x1,
+			    int y0, int y1, int width, float *depth)
+{
+	int ixmin = max(t.ixmin, x0), ixmax = min(t.ixmax, x1 - 1);
+	int iymin = max(t.iymin, y0), iymax = min(t.iymax, y1 - 1);
+	for (int iy = iymin; iy <= iymax; iy++) {
+		float py = iy + 0.5f;
+		float *row = depth + iy * width;
+		for (int ix = ixmin; ix <= ixmax; ix++) {
+			float px = ix + 0.5f;
+			float e0 = (t.x1 - px) * (t.y2 - py) -
+				   (t.x2 - px) * (t.y1 - py);
+			float e1 = (t.x2 - px) * (t.y0 - py) -
+				   (t.x0 - px) * (t.y2 - py);
+			float e2 = (t.x0 - px) * (t.y1 - py) -
+				   (t.x1 - px) * (t.y0 - py);
+			if (e0 > 0.0f || e1 > 0.0f || e2 > 0.0f)
+				continue;
+			float q = (t.q0 * e0 + t.q1 * e1 + t.q2 * e2) * t.rarea;
+			q = max(q - t.offset, FLT_MIN);
+			if (q > row[ix])
+				row[ix] = q;
+		}
+	}
+}
+
+
+// Render the depth of the front faces.  The faces are binned into tiles
+// of DEPTH_TILE x DEPTH_TILE samples, and the tiles rendered in parallel.
+// Since each sample keeps the nearest depth, the result doesn't depend
+// on the order.
+void DepthBuffer::render(const TriMesh *mesh, const ScreenProjection &proj,
+			 int oversample_, float offset_factor,
+			 float offset_units)
+{
+	oversample = max(oversample_, 1);
+	width = proj.width * oversample;
+	height = proj.height * oversample;
+	depth.assign(width * height, 0.0f);
+	if (!width || !height)
+		return;
+
+	// Vertices in sample coordinates
+	int nv = mesh->vertices.size();
+	vector<float> sx(nv), sy(nv), sq(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		float x = 0.0f, y = 0.0f;
+		sq[i] = proj.project(mesh->vertices[i], x, y);
+		sx[i] = x * oversample;
+		sy[i] = y * oversample;
+	}
+
+	// The smallest resolvable difference in window depth is 2^-24, which
+	// near the near plane is that divided by neardist in 1/z
+	float units = offset_units / 16777216.0f / proj.neardist;
+
+	// Set up the faces
+	int nf = mesh->faces.size();
+	vector<DepthTriangle> tris(nf);
+	vector<char> front(nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++)
+		front[i] = setup_triangle(mesh->faces[i], &sx[0], &sy[0],
+					  &sq[0], width, height,
+					  offset_factor, units, tris[i]);
+
+	// Bin them: tile_start[t] .. tile_start[t+1]-1 index the faces
+	// overlapping tile t, in bin
+	int ntx = (width + DEPTH_TILE - 1) / DEPTH_TILE;
+	int nty = (height + DEPTH_TILE - 1) / DEPTH_TILE;
+	int ntiles = ntx * nty;
+	vector<int> tile_start(ntiles + 1, 0);
+	for (int i = 0; i < nf; i++) {
+		if (!front[i])
+			continue;
+		const DepthTriangle &t = tris[i];
+		int tx0 = t.ixmin / DEPTH_TILE, tx1 = t.ixmax / DEPTH_TILE;
+		int ty0 = t.iymin / DEPTH_TILE, ty1 = t.iymax / DEPTH_TILE;
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				tile_start[ty * ntx + tx + 1]++;
+	}
+	for (int i = 0; i < ntiles; i++)
+		tile_start[i+1] += tile_start[i];
+	vector<int> bin(tile_start[ntiles]);
+	vector<int> fill(tile_start.begin(), tile_start.end() - 1);
+	for (int i = 0; i < nf; i++) {
+		if (!front[i])
+			continue;
+		const DepthTriangle &t = tris[i];
+		int tx0 = t.ixmin / DEPTH_TILE, tx1 = t.ixmax / DEPTH_TILE;
+		int ty0 = t.iymin / DEPTH_TILE, ty1 = t.iymax / DEPTH_TILE;
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				bin[fill[ty * ntx + tx]++] = i;
+	}
+
+#pragma omp parallel for schedule(dynamic)
+	for (int tile = 0; tile < ntiles; tile++) {
+		int x0 = (tile % ntx) * DEPTH_TILE, y0 = (tile / ntx) * DEPTH_TILE;
+		int x1 = min(x0 + DEPTH_TILE, width);
+		int y1 = min(y0 + DEPTH_TILE, height);
+		for (int j = tile_start[tile]; j < tile_start[tile+1]; j++)
+			raster_triangle(tris[bin[j]], x0, x1, y0, y1, width,
+					&depth[0]);
+	}
+}
+
+
+// The fraction of the samples of pixel (x, y) covered by the mesh
+float DepthBuffer::coverage(int x, int y) const
+{
+	int n = 0;
+	for (int j = 0; j < oversample; j++) {
+		const float *row = &depth[(y * oversample + j) * width];
+		for (int i = 0; i < oversample; i++)
+			if (row[x * oversample + i] > 0.0f)
+				n++;
+	}
+	return float(n) / sqr(oversample);
+}
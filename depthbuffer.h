@@ -0,0 +1,80 @@
+/*
+depthbuffer.h
+Occlusion by the mesh, worked out on the CPU instead of with OpenGL.
+
+A ScreenProjection maps mesh coordinates to pixels the way the viewer's
+GLCamera does: a perspective view down -z whose field of view is measured
+along the diagonal of the window.  A DepthBuffer holds the depth of the
+nearest front-facing triangle at each of its samples, pushed back as by
+the glPolygonOffset in draw_base_mesh, so that the points of lines can be
+tested against it the way the viewer's depth test does.
+
+Depths are stored as 1/z, z being the distance in front of the eye,
+since that is linear in screen space.  0 means no triangle.
+*/
+
+#ifndef DEPTHBUFFER_H
+#define DEPTHBUFFER_H
+
+#include <vector>
+#include "TriMesh.h"
+#include "XForm.h"
+
+
+struct ScreenProjection {
+	xform xf;		// Mesh to camera coordinates
+	int width, height;	// In pixels
+	float scale;		// Pixels per unit of x/z at the center
+	float neardist;		// Points nearer than this are clipped
+
+	ScreenProjection() : width(0), height(0), scale(0), neardist(0) {}
+	// Set up the view of mesh through xf, in a window of the given size
+	// and field of view, with the near plane GLCamera would use
+	void set(const TriMesh *mesh, const xform &xf, int width, int height,
+		 float fov);
+
+	// Project p into pixel coordinates (x to the right and y down from
+	// the top left corner).  Returns 1/z, or 0 if p is clipped.
+	float project(const point &p, float &x, float &y) const
+	{
+		point c = xf * p;
+		float z = -c[2];
+		if (z <= neardist)
+			return 0.0f;
+		float q = 1.0f / z;
+		x = 0.5f * width + scale * c[0] * q;
+		y = 0.5f * height - scale * c[1] * q;
+		return q;
+	}
+};
+
+
+class DepthBuffer {
+public:
+	int width, height;	// In samples
+	int oversample;		// Samples per pixel along each axis
+	std::vector<float> depth;
+
+	DepthBuffer() : width(0), height(0), oversample(1) {}
+
+	// Render the front faces of the mesh, with oversample x oversample
+	// samples per pixel.  Each face is pushed back by offset_factor times
+	// its depth slope plus offset_units times the smallest difference a
+	// 24-bit depth buffer resolves, as glPolygonOffset(offset_factor,
+	// offset_units) does.
+	void render(const TriMesh *mesh, const ScreenProjection &proj,
+		    int oversample = 1, float offset_factor = 5.0f,
+		    float offset_units = 30.0f);
+	// The fraction of the samples of pixel (x, y) covered by the mesh
+	float coverage(int x, int y) const;
+	// Is a point at pixel (x, y), with 1/z = q, in front of the mesh?
+	bool visible(float x, float y, float q) const
+	{
+		int ix = int(x * oversample), iy = int(y * oversample);
+		if (x < 0.0f || y < 0.0f || ix >= width || iy >= height)
+			return true;
+		return q >= depth[iy * width + ix];
+	}
+};
+
+#endif
@@ -92,6 +92,35 @@ public:
 		friend const TriMesh::BBox operator + (const TriMesh::BBox &b1, const TriMesh::BBox &b2);
 	};
 
+	// One list of an Adjacency: indexes and iterates like a
+	// vector<int>, but just points into the shared index array
+	struct AdjList {
+		const int *b, *e;
+
+		int size() const { return int(e - b); }
+		bool empty() const { return b == e; }
+		int operator [] (int i) const { return b[i]; }
+		const int *begin() const { return b; }
+		const int *end() const { return e; }
+	};
+
+	// Adjacency in compressed sparse row form: the list for element i
+	// is index[offset[i]] .. index[offset[i+1]-1]
+	struct Adjacency {
+		std::vector<int> offset, index;
+
+		int size() const
+			{ return offset.empty() ? 0 : int(offset.size()) - 1; }
+		bool empty() const { return offset.empty(); }
+		void clear() { offset.clear(); index.clear(); }
+		AdjList operator [] (int i) const
+		{
+			const int *p = index.empty() ? 0 : &index[0];
+			AdjList l = { p + offset[i], p + offset[i+1] };
+			return l;
+		}
+	};
+
 	struct BSphere {
 		point center;
 		float r;
@@ -113,7 +142,8 @@ public:
 	//
 	// Constructor
 	//
-	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0)
+	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0),
+		moved_stale(0)
 		{}
 
 	//
@@ -151,14 +181,25 @@ public:
 
 	// Connectivity structures:
 	//  For each vertex, all neighboring vertices
-	std::vector< std::vector<int> > neighbors;
-	//  For each vertex, all neighboring faces
-	std::vector< std::vector<int> > adjacentfaces;
+	Adjacency neighbors;
+	//  For each vertex, all neighboring faces, in increasing order
+	Adjacency adjacentfaces;
 	//  For each face, the three faces attached to its edges
 	//  (for example, across_edge[3][2] is the number of the face
 	//   that's touching the edge opposite vertex 2 of face 3)
 	std::vector<Face> across_edge;
 
+	// Tracking of moved vertices (see TriMesh_moved.cc):
+	//  The positions the computed per-vertex properties are up to date
+	//  with, if tracking
+	std::vector<point> tracked_vertices;
+	//  The vertices moved since, and which of the properties still
+	//  need updating around them
+	std::vector<int> moved;
+	unsigned moved_stale;
+	enum { STALE_NORMALS = 1, STALE_POINTAREAS = 2,
+		STALE_CURVATURES = 4, STALE_DCURV = 8 };
+
 	//
 	// Compute all this stuff...
 	//
@@ -185,6 +226,18 @@ public:
 	void need_adjacentfaces();
 	void need_across_edge();
 
+	//
+	// Local updates after vertices move: normals, pointareas, curvatures
+	// and dcurv, where already computed, are then updated by need_* only
+	// around the moved vertices
+	//
+	void mark_moved(int v);
+	void find_moved(float epsilon = 0.0f);
+	void clear_moved()
+		{ tracked_vertices.clear(); moved.clear(); moved_stale = 0; }
+	bool moved_region(int rings, std::vector<int> &verts);
+	void done_moved(unsigned stale);
+
 	//
 	// Delete everything
 	//
@@ -199,6 +252,7 @@ public:
 		cornerareas.clear(); pointareas.clear();
 		bbox.valid = bsphere.valid = false;
 		neighbors.clear(); adjacentfaces.clear(); across_edge.clear();
+		clear_moved();
 	}
 
 	//
@@ -48,13 +48,19 @@ extern void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table);
 // they are referenced by the tstrips or faces.
 extern void reorder_verts(TriMesh *mesh);
 
+// Reorder vertices along a space-filling curve, and faces to match, so
+// that nearby parts of the mesh are nearby in memory.  If remap is
+// given, it is set to the new number of each old vertex.
+extern void reorder_mesh_locality(TriMesh *mesh,
+	std::vector<int> *remap = NULL);
+
 // Perform one iteration of subdivision on a mesh.
 enum { SUBDIV_PLANAR, SUBDIV_LOOP, SUBDIV_LOOP_ORIG, SUBDIV_LOOP_NEW,
        SUBDIV_BUTTERFLY, SUBDIV_BUTTERFLY_MODIFIED };
 extern void subdiv(TriMesh *mesh, int scheme = SUBDIV_LOOP);
 
 // Smooth the mesh geometry
-extern void smooth_mesh(TriMesh *themesh, float sigma);
+extern bool smooth_mesh(TriMesh *themesh, float sigma);
 
 // Bilateral smoothing
 extern void bilateral_smooth_mesh(TriMesh *themesh, float sigma1, float sigma2);
@@ -64,13 +70,20 @@ template <class T>
 extern void diffuse_vector(TriMesh *themesh, std::vector<T> &field, float sigma);
 
 // Diffuse the normals across the mesh
-extern void diffuse_normals(TriMesh *themesh, float sigma);
+extern bool diffuse_normals(TriMesh *themesh, float sigma);
 
 // Diffuse the curvatures across the mesh
-extern void diffuse_curv(TriMesh *themesh, float sigma);
+extern bool diffuse_curv(TriMesh *themesh, float sigma);
 
 // Diffuse the curvature derivatives across the mesh
-extern void diffuse_dcurv(TriMesh *themesh, float sigma);
+extern bool diffuse_dcurv(TriMesh *themesh, float sigma);
+
+// Have smooth_mesh and diffuse_* call hook now and then, from the thread
+// that called them while no other thread is working, with the fraction of
+// the work done.  The mesh may be partly smoothed by then, so the hook
+// shouldn't let it be drawn.  If it returns false, they stop, leave the
+// mesh as it was, and return false.
+extern void set_diffuse_progress_hook(bool (*hook)(float done));
 
 // Given a curvature tensor, find principal directions and curvatures
 extern void diagonalize_curv(const vec &old_u, const vec &old_v,
@@ -496,6 +496,20 @@ namespace std {
 }
 
 
+// Utility functions for square and cube, to go along with sqrt and cbrt
+template <class T>
+static inline T sqr(const T &x)
+{
+	return x*x;
+}
+
+template <class T>
+static inline T cube(const T &x)
+{
+	return x*x*x;
+}
+
+
 // Squared length
 template <int D, class T>
 static inline const T len2(const Vec<D,T> &v)
@@ -562,20 +576,6 @@ static inline T trinorm(const T &v0, const T &v1, const T &v2)
 }
 
 
-// Utility functions for square and cube, to go along with sqrt and cbrt
-template <class T>
-static inline T sqr(const T &x)
-{
-	return x*x;
-}
-
-template <class T>
-static inline T cube(const T &x)
-{
-	return x*x*x;
-}
-
-
 // Sign of a scalar.  Note that sgn(0) == 1.
 template <class T>
 static inline T sgn(const T &x)
@@ -0,0 +1,112 @@
+/*
+isotree.cpp
+A min/max tree over the faces of a mesh, keyed on a per-vertex scalar
+field.  See isotree.h.
+*/
+
+#include <float.h>
+#include <algorithm>
+#include "isotree.h"
+
+using namespace std;
+
+
+// Build the tree for the given field on the faces of mesh, or only on
+// those marked in drawn
+void IsoTree::build(const TriMesh *mesh, const vector<float> &val,
+		    const vector<char> *drawn)
+{
+	nf = mesh->faces.size();
+	if (nf == 0) {
+		clear();
+		return;
+	}
+
+	// Range over each face.  Faces left out get an empty range, which
+	// never straddles anything.
+	if (drawn && drawn->empty())
+		drawn = NULL;
+	face_min.resize(nf);
+	face_max.resize(nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		if (drawn && !(*drawn)[i]) {
+			face_min[i] = FLT_MAX;
+			face_max[i] = -FLT_MAX;
+			continue;
+		}
+		const TriMesh::Face &f = mesh->faces[i];
+		float v0 = val[f[0]], v1 = val[f[1]], v2 = val[f[2]];
+		face_min[i] = min(min(v0, v1), v2);
+		face_max[i] = max(max(v0, v1), v2);
+	}
+
+	// Range over each leaf.  Pad to a power of two with empty leaves,
+	// whose range never straddles anything.
+	int nused = (nf + leaf_size - 1) / leaf_size;
+	nleaves = 1;
+	while (nleaves < nused)
+		nleaves *= 2;
+	node_min.resize(2 * nleaves);
+	node_max.resize(2 * nleaves);
+#pragma omp parallel for
+	for (int j = 0; j < nleaves; j++) {
+		float lmin = 0.0f, lmax = 0.0f;
+		int start = j * leaf_size, end = min(nf, start + leaf_size);
+		if (start < end) {
+			lmin = face_min[start];
+			lmax = face_max[start];
+			for (int i = start + 1; i < end; i++) {
+				lmin = min(lmin, face_min[i]);
+				lmax = max(lmax, face_max[i]);
+			}
+		}
+		node_min[nleaves + j] = lmin;
+		node_max[nleaves + j] = lmax;
+	}
+
+	// And up the tree
+	for (int i = nleaves - 1; i > 0; i--) {
+		node_min[i] = min(node_min[2*i], node_min[2*i+1]);
+		node_max[i] = max(node_max[2*i], node_max[2*i+1]);
+	}
+}
+
+
+void IsoTree::clear()
+{
+	nf = nleaves = 0;
+	face_min.clear();
+	face_max.clear();
+	node_min.clear();
+	node_max.clear();
+}
+
+
+// Set faces to the faces with min < level < max, in increasing order
+void IsoTree::find(float level, vector<int> &faces) const
+{
+	faces.clear();
+	if (nf == 0)
+		return;
+
+	// Depth-first, left to right, so faces come out in order
+	int stack[64];
+	int sp = 0;
+	stack[sp++] = 1;
+	while (sp) {
+		int i = stack[--sp];
+		if (!(node_min[i] < level && node_max[i] > level))
+			continue;
+		if (i < nleaves) {
+			stack[sp++] = 2*i + 1;
+			stack[sp++] = 2*i;
+			continue;
+		}
+		int start = (i - nleaves) * leaf_size;
+		int end = min(nf, start + leaf_size);
+		for (int f = start; f < end; f++)
+			if (face_min[f] < level && face_max[f] > level)
+				faces.push_back(f);
+	}
+}
@@ -0,0 +1,48 @@
+/*
+isotree.h
+A min/max tree over the faces of a mesh, keyed on a per-vertex scalar
+field, for finding the faces crossed by an isoline val = level.
+
+The faces are grouped, in order, into leaves of leaf_size faces, and
+the leaves into a complete binary tree whose nodes store the range of
+the field below them.  A query only descends into nodes whose range
+straddles the level, so its cost is roughly proportional to the number
+of faces it returns rather than to the size of the mesh.  This pays off
+when the same field is queried at many levels (isophotes, topo lines),
+or for several frames (K = 0, H = 0).
+*/
+
+#ifndef ISOTREE_H
+#define ISOTREE_H
+
+#include <vector>
+#include "TriMesh.h"
+
+
+class IsoTree {
+public:
+	IsoTree() : nf(0), nleaves(0) {}
+
+	// Build the tree for the given field on the faces of mesh.  If
+	// drawn is given and not empty, only the faces i with drawn[i] set
+	// are ever found.
+	void build(const TriMesh *mesh, const std::vector<float> &val,
+		   const std::vector<char> *drawn = NULL);
+	void clear();
+	bool empty() const { return nf == 0; }
+
+	// Set faces to the faces with min < level < max over their
+	// vertices, in increasing order
+	void find(float level, std::vector<int> &faces) const;
+
+private:
+	static const int leaf_size = 8;
+	int nf, nleaves;
+	// Per-face range of the field
+	std::vector<float> face_min, face_max;
+	// Per-node range, as a heap: node 1 is the root, the children of
+	// node i are 2i and 2i+1, and leaf j is node nleaves + j
+	std::vector<float> node_min, node_max;
+};
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ldmesh.cpp
+The .ldm mesh format.  See ldmesh.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ldmesh.h"
+
+using namespace std;
+
+
+static const char ldm_magic[8] = "LDMESH";
+static const unsigned ldm_align = 64;
+
+
+// The file is little-endian, and only used in place on little-endian
+// hosts
+static bool host_little_endian()
+{
+	unsigned x = 1;
+	return *(const unsigned char *) &x == 1;
+}
+
+
+static inline unsigned long long align_up(unsigned long long x)
+{
+	return (x + ldm_align - 1) & ~(unsigned long long) (ldm_align - 1);
+}
+
+
+// Are the strips, each its length followed by that many vertex indices
+// as TriMesh keeps them, within n values and nv vertices?
+static bool valid_tstrips(const int *t, int n, int nv)
+{
+	int i = 0;
+	while (i < n) {
+		int len = t[i++];
+		if (len < 0 || len > n - i)
+			return false;
+		for (int end = i + len; i < end; i++)
+			if (unsigned(t[i]) >= unsigned(nv))
+				return false;
+	}
+	return true;
+}
+
+
+MappedMesh::MappedMesh()
+{
+	close();
+}
+
+
+// Forget the file and all the arrays in it
+void MappedMesh::close()
+{
+	file.close();
+	chunks = NULL;
+	nchunks = 0;
+	nv = nf = ntstrips = 0;
+	vertices = NULL;
+	faces = NULL;
+	normals = pdir1 = pdir2 = NULL;
+	curv1 = curv2 = NULL;
+	dcurv = NULL;
+	pointareas = NULL;
+	cornerareas = NULL;
+	tstrips = NULL;
+	bsphere = NULL;
+	feature_size = NULL;
+}
+
+
+// Map a .ldm file and check its header and chunk table
+bool MappedMesh::open(const char *filename)
+{
+	close();
+	if (!host_little_endian()) {
+		TriMesh::eprintf("%s: .ldm files need a little-endian host\n",
+				 filename);
+		return false;
+	}
+	if (!file.open(filename)) {
+		TriMesh::eprintf("Couldn't open %s\n", filename);
+		return false;
+	}
+
+	const LdmHeader *h = (const LdmHeader *) file.data();
+	if (file.size() < sizeof(LdmHeader) ||
+	    memcmp(h->magic, ldm_magic, sizeof(ldm_magic)) ||
+	    h->version != LDM_VERSION ||
+	    file.size() < sizeof(LdmHeader) +
+			  (unsigned long long) h->nchunks * sizeof(LdmChunk)) {
+		TriMesh::eprintf("%s is not a version %d .ldm file\n",
+				 filename, LDM_VERSION);
+		close();
+		return false;
+	}
+
+	// Every chunk must lie within the file, be aligned, and be as
+	// big as its element layout says
+	chunks = (const LdmChunk *) (file.data() + sizeof(LdmHeader));
+	nchunks = h->nchunks;
+	for (int i = 0; i < nchunks; i++) {
+		const LdmChunk &c = chunks[i];
+		unsigned long long want = 4ull * c.count * c.components;
+		if (c.offset % ldm_align || c.size != want ||
+		    c.offset > file.size() || c.size > file.size() - c.offset) {
+			TriMesh::eprintf("%s: bad chunk %.4s\n",
+					 filename, c.tag);
+			close();
+			return false;
+		}
+	}
+
+	nv = h->nv;
+	nf = h->nf;
+	vertices = (const point *) get("VERT", LDM_FLOAT32, 3, nv);
+	faces = (const TriMesh::Face *) get("FACE", LDM_INT32, 3, nf);
+	if (!vertices || (nf && !faces)) {
+		TriMesh::eprintf("%s: missing vertices or faces\n", filename);
+		close();
+		return false;
+	}
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (unsigned(faces[i][j]) >= unsigned(nv)) {
+				TriMesh::eprintf("%s: bad face %d\n",
+						 filename, i);
+				close();
+				return false;
+			}
+		}
+	}
+
+	normals = (const vec *) get("NORM", LDM_FLOAT32, 3, nv);
+	pdir1 = (const vec *) get("PDR1", LDM_FLOAT32, 3, nv);
+	pdir2 = (const vec *) get("PDR2", LDM_FLOAT32, 3, nv);
+	curv1 = (const float *) get("CRV1", LDM_FLOAT32, 1, nv);
+	curv2 = (const float *) get("CRV2", LDM_FLOAT32, 1, nv);
+	dcurv = (const Vec<4,float> *) get("DCRV", LDM_FLOAT32, 4, nv);
+	pointareas = (const float *) get("PTAR", LDM_FLOAT32, 1, nv);
+	cornerareas = (const vec *) get("CNAR", LDM_FLOAT32, 3, nf);
+	bsphere = (const float *) get("BSPH", LDM_FLOAT32, 4, 1);
+	feature_size = (const float *) get("FSIZ", LDM_FLOAT32, 1, 1);
+	const LdmChunk *t = find_chunk("TSTR");
+	if (t && t->type == LDM_INT32 && t->components == 1) {
+		tstrips = (const int *) chunk_data(t);
+		ntstrips = t->count;
+		if (!valid_tstrips(tstrips, ntstrips, nv)) {
+			TriMesh::eprintf("%s: bad triangle strips\n",
+					 filename);
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Find a chunk by tag
+const LdmChunk *MappedMesh::find_chunk(const char *tag) const
+{
+	for (int i = 0; i < nchunks; i++)
+		if (!strncmp(chunks[i].tag, tag, 4))
+			return &chunks[i];
+	return NULL;
+}
+
+
+// Pointer to the data of chunk tag, if it has the given layout and count
+const void *MappedMesh::get(const char *tag, unsigned type,
+			    unsigned components, unsigned count) const
+{
+	const LdmChunk *c = find_chunk(tag);
+	if (!c || c->type != type || c->components != components ||
+	    c->count != count)
+		return NULL;
+	return chunk_data(c);
+}
+
+
+// Copy an array out of the file into a vector, if it's there
+template <class T>
+static inline void copy_array(const T *p, int n, vector<T> &v)
+{
+	if (p)
+		v.assign(p, p + n);
+}
+
+
+// Make a TriMesh holding a copy of everything in the file
+TriMesh *MappedMesh::to_trimesh() const
+{
+	if (!is_open())
+		return NULL;
+	TriMesh *mesh = new TriMesh;
+	copy_array(vertices, nv, mesh->vertices);
+	copy_array(faces, nf, mesh->faces);
+	copy_array(normals, nv, mesh->normals);
+	copy_array(pdir1, nv, mesh->pdir1);
+	copy_array(pdir2, nv, mesh->pdir2);
+	copy_array(curv1, nv, mesh->curv1);
+	copy_array(curv2, nv, mesh->curv2);
+	copy_array(dcurv, nv, mesh->dcurv);
+	copy_array(pointareas, nv, mesh->pointareas);
+	copy_array(cornerareas, nf, mesh->cornerareas);
+	copy_array(tstrips, ntstrips, mesh->tstrips);
+	if (bsphere) {
+		mesh->bsphere.center = point(bsphere[0], bsphere[1], bsphere[2]);
+		mesh->bsphere.r = bsphere[3];
+		mesh->bsphere.valid = true;
+	}
+	return mesh;
+}
+
+
+// One chunk to be written
+struct LdmOut {
+	const char *tag;
+	unsigned type, components, count;
+	const void *data;
+};
+
+
+// Write a mesh, with whichever arrays it has, to a .ldm file
+bool write_ldm(const char *filename, const TriMesh *mesh, float feature_size)
+{
+	if (!host_little_endian()) {
+		TriMesh::eprintf("%s: .ldm files need a little-endian host\n",
+				 filename);
+		return false;
+	}
+
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	float bs[4] = { mesh->bsphere.center[0], mesh->bsphere.center[1],
+			mesh->bsphere.center[2], mesh->bsphere.r };
+
+	// The arrays that are present and the right size
+	vector<LdmOut> out;
+#define LDM_ADD(tag, type, components, v, n) \
+	if (int((v).size()) == (n) && (n)) { \
+		LdmOut o = { tag, type, components, (unsigned) (n), &(v)[0] }; \
+		out.push_back(o); \
+	}
+	LDM_ADD("VERT", LDM_FLOAT32, 3, mesh->vertices, nv);
+	LDM_ADD("FACE", LDM_INT32, 3, mesh->faces, nf);
+	LDM_ADD("NORM", LDM_FLOAT32, 3, mesh->normals, nv);
+	LDM_ADD("PDR1", LDM_FLOAT32, 3, mesh->pdir1, nv);
+	LDM_ADD("PDR2", LDM_FLOAT32, 3, mesh->pdir2, nv);
+	LDM_ADD("CRV1", LDM_FLOAT32, 1, mesh->curv1, nv);
+	LDM_ADD("CRV2", LDM_FLOAT32, 1, mesh->curv2, nv);
+	LDM_ADD("DCRV", LDM_FLOAT32, 4, mesh->dcurv, nv);
+	LDM_ADD("PTAR", LDM_FLOAT32, 1, mesh->pointareas, nv);
+	LDM_ADD("CNAR", LDM_FLOAT32, 3, mesh->cornerareas, nf);
+	LDM_ADD("TSTR", LDM_INT32, 1, mesh->tstrips,
+		int(mesh->tstrips.size()));
+#undef LDM_ADD
+	if (mesh->bsphere.valid) {
+		LdmOut o = { "BSPH", LDM_FLOAT32, 4, 1, bs };
+		out.push_back(o);
+	}
+	if (feature_size) {
+		LdmOut o = { "FSIZ", LDM_FLOAT32, 1, 1, &feature_size };
+		out.push_back(o);
+	}
+	if (out.empty() || strncmp(out[0].tag, "VERT", 4)) {
+		TriMesh::eprintf("No vertices to write to %s\n", filename);
+		return false;
+	}
+
+	// Lay out the chunks
+	LdmHeader h;
+	memset(&h, 0, sizeof(h));
+	h.version = LDM_VERSION;
+	h.nchunks = out.size();
+	h.nv = nv;
+	h.nf = nf;
+	vector<LdmChunk> table(out.size());
+	unsigned long long offset = align_up(sizeof(LdmHeader) +
+					     out.size() * sizeof(LdmChunk));
+	for (size_t i = 0; i < out.size(); i++) {
+		LdmChunk &c = table[i];
+		memset(&c, 0, sizeof(c));
+		memcpy(c.tag, out[i].tag, 4);
+		c.type = out[i].type;
+		c.count = out[i].count;
+		c.components = out[i].components;
+		c.offset = offset;
+		c.size = 4ull * c.count * c.components;
+		offset = align_up(offset + c.size);
+	}
+
+	// Another process may have the old file mapped, so it is replaced
+	// rather than rewritten (see mappedfile.h)
+	string tempname = temp_file_name(filename);
+	FILE *f = fopen(tempname.c_str(), "wb");
+	if (!f) {
+		TriMesh::eprintf("Couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	// The magic number is written last, so that a partly-written
+	// file is never taken for a valid one
+	static const char zeros[ldm_align] = { 0 };
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) &&
+		  (fwrite(&table[0], sizeof(LdmChunk), table.size(), f) ==
+		   table.size());
+	unsigned long long pos = sizeof(h) + table.size() * sizeof(LdmChunk);
+	for (size_t i = 0; i < out.size() && ok; i++) {
+		size_t pad = table[i].offset - pos;
+		if (pad)
+			ok = (fwrite(zeros, pad, 1, f) == 1);
+		ok = ok && (fwrite(out[i].data, table[i].size, 1, f) == 1);
+		pos = table[i].offset + table[i].size;
+	}
+	if (ok) {
+		fflush(f);
+		ok = (fseek(f, 0, SEEK_SET) == 0) &&
+		     (fwrite(ldm_magic, sizeof(ldm_magic), 1, f) == 1);
+	}
+	ok = (fclose(f) == 0) && ok;
+	if (!ok)
+		remove(tempname.c_str());
+	else
+		ok = replace_file(tempname.c_str(), filename);
+	if (!ok)
+		TriMesh::eprintf("Couldn't write %s\n", filename);
+	return ok;
+}
+
+
+// Does the filename end in .ldm?
+bool is_ldm_filename(const char *filename)
+{
+	size_t len = strlen(filename);
+	return len >= 4 && !strcmp(filename + len - 4, ".ldm");
+}
+
+
+// Read a mesh in any format TriMesh::read understands, or .ldm
+TriMesh *read_mesh(const char *filename, float *feature_size)
+{
+	if (feature_size)
+		*feature_size = 0.0f;
+	if (!is_ldm_filename(filename))
+		return TriMesh::read(filename);
+
+	TriMesh::dprintf("Reading %s... ", filename);
+	MappedMesh m;
+	if (!m.open(filename))
+		return NULL;
+	TriMesh *mesh = m.to_trimesh();
+	if (feature_size && m.feature_size)
+		*feature_size = *m.feature_size;
+	TriMesh::dprintf("Done.\n");
+	return mesh;
+}
@@ -0,0 +1,118 @@
+/*
+ldmesh.h
+The .ldm mesh format: a little-endian binary file that can be
+memory-mapped and used in place.
+
+Layout:
+	LdmHeader			64 bytes
+	LdmChunk[nchunks]		32 bytes each
+	chunk data			each starting at a multiple of 64 bytes
+
+Every chunk is an array of count elements of components 32-bit values
+(floats or ints), identified by a four-character tag:
+	VERT	vertices	float x 3	required
+	FACE	faces		int x 3		required
+	NORM	normals		float x 3
+	PDR1	pdir1		float x 3
+	PDR2	pdir2		float x 3
+	CRV1	curv1		float x 1
+	CRV2	curv2		float x 1
+	DCRV	dcurv		float x 4
+	PTAR	pointareas	float x 1
+	CNAR	cornerareas	float x 3	(per face)
+	TSTR	tstrips		int x 1
+	BSPH	bsphere		float x 4	(center, radius)
+	FSIZ	feature size	float x 1	(see mesh_feature_size)
+Readers skip chunks with tags they don't know.
+
+Since the element layouts match those of TriMesh, MappedMesh exposes
+the chunks as typed pointers straight into the mapping, without copying.
+*/
+
+#ifndef LDMESH_H
+#define LDMESH_H
+
+#include "TriMesh.h"
+#include "mappedfile.h"
+
+
+#define LDM_VERSION 1
+
+enum { LDM_FLOAT32 = 1, LDM_INT32 = 2 };
+
+struct LdmHeader {
+	char magic[8];			// "LDMESH" and two NULs
+	unsigned version;		// LDM_VERSION
+	unsigned nchunks;
+	unsigned nv, nf;
+	unsigned char pad[40];
+};
+
+struct LdmChunk {
+	char tag[4];
+	unsigned type;			// LDM_FLOAT32 or LDM_INT32
+	unsigned count;			// Number of elements
+	unsigned components;		// Values per element
+	unsigned long long offset;	// From the start of the file
+	unsigned long long size;	// In bytes
+};
+
+
+class MappedMesh {
+public:
+	MappedMesh();
+
+	// Map a .ldm file and check its header and chunk table
+	bool open(const char *filename);
+	void close();
+	bool is_open() const { return file.is_open(); }
+
+	// Find a chunk by tag, or NULL if it isn't in the file
+	const LdmChunk *find_chunk(const char *tag) const;
+	// The data of a chunk
+	const void *chunk_data(const LdmChunk *c) const
+		{ return file.data() + c->offset; }
+
+	// Make a TriMesh holding a copy of everything in the file
+	TriMesh *to_trimesh() const;
+
+	// The arrays in the file, or NULL when absent
+	int nv, nf, ntstrips;
+	const point *vertices;
+	const TriMesh::Face *faces;
+	const vec *normals, *pdir1, *pdir2;
+	const float *curv1, *curv2;
+	const Vec<4,float> *dcurv;
+	const float *pointareas;
+	const vec *cornerareas;
+	const int *tstrips;
+	const float *bsphere;
+	const float *feature_size;
+
+private:
+	MappedFile file;
+	const LdmChunk *chunks;
+	int nchunks;
+
+	// Pointer to the data of chunk tag, if it has the given
+	// layout and count, otherwise NULL
+	const void *get(const char *tag, unsigned type, unsigned components,
+			unsigned count) const;
+};
+
+
+// Write a mesh, with whichever of the above arrays it has, to a .ldm file.
+// The feature size is stored too unless it is 0.  It should be the one
+// the mesh had in the order it was read in: once it has been reordered,
+// mesh_feature_size() samples other vertices.
+extern bool write_ldm(const char *filename, const TriMesh *mesh,
+		      float feature_size = 0.0f);
+
+// Does the filename end in .ldm?
+extern bool is_ldm_filename(const char *filename);
+
+// Read a mesh in any format TriMesh::read understands, or .ldm.  If
+// feature_size is given, it is set to the one stored in a .ldm file, or 0.
+extern TriMesh *read_mesh(const char *filename, float *feature_size = NULL);
+
+#endif
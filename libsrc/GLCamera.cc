@@ -0,0 +1,330 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+GLCamera.cc
+Manages OpenGL camera and trackball/arcball interaction.  Only core GL
+is used (no GLU), so that this builds wherever the widget does.
+*/
+
+
+#ifdef _WIN32
+# include <windows.h>
+#endif
+#ifdef __APPLE__
+# include <OpenGL/gl.h>
+#else
+# include <GL/gl.h>
+#endif
+#include <float.h>
+#include "GLCamera.h"
+using namespace std;
+
+
+#define DOF 10.0f
+#define MAXDOF 10000.0f
+#define TRACKBALL_R 0.8f
+#define SPIN_TIME 0.1f
+#define SPIN_SPEED 0.05f
+#define TRANSLATE_SPEED 2.0f
+#define WHEEL_MOVE 0.2f
+#define MAX_LIGHT (M_PI / 2.0 - 0.05)
+
+
+// Read back the framebuffer at the given pixel and compute where that
+// surface point is, in camera coordinates.  Returns false if there is
+// nothing drawn there.
+bool GLCamera::read_depth(int x, int y, point &p) const
+{
+	GLdouble M[16], P[16];
+	GLint V[4];
+	glGetDoublev(GL_MODELVIEW_MATRIX, M);
+	glGetDoublev(GL_PROJECTION_MATRIX, P);
+	glGetIntegerv(GL_VIEWPORT, V);
+
+	// Look around for the nearest drawn pixel
+	static const float dx[] =
+		{ 0, 1,-1,-1, 1, 3,-3, 0, 0, 6,-6,-6, 6, 25,-25, 0, 0 };
+	static const float dy[] =
+		{ 0, 1, 1,-1,-1, 0, 0, 3,-3, 6, 6,-6,-6, 0, 0, 25,-25 };
+	const int ntries = sizeof(dx) / sizeof(dx[0]);
+	float scale = 0.01f;
+	for (int i = 0; i < ntries; i++) {
+		float xx = min(max(x + i * scale * dx[i], float(V[0])),
+			       float(V[0] + V[2] - 1));
+		float yy = min(max(y + i * scale * dy[i], float(V[1])),
+			       float(V[1] + V[3] - 1));
+		float d;
+		glReadPixels(int(xx), int(yy), 1, 1,
+			     GL_DEPTH_COMPONENT, GL_FLOAT, &d);
+		if (d <= 0.0f || d >= 1.0f)
+			continue;
+
+		// Unproject through the inverse of P*M
+		xform PM = xform(P) * xform(M);
+		invert(PM);
+		point ndc(2.0f * (xx - V[0]) / V[2] - 1.0f,
+			  2.0f * (yy - V[1]) / V[3] - 1.0f,
+			  2.0f * d - 1.0f);
+		p = PM * ndc;
+		return true;
+	}
+	return false;
+}
+
+
+// Set up the OpenGL camera for rendering
+void GLCamera::setupGL(const point &scene_center, float scene_size) const
+{
+	point surface_point;
+	GLint V[4];
+	glGetIntegerv(GL_VIEWPORT, V);
+	int width = V[2], height = V[3];
+	if (read_depth(V[0] + width / 2, V[1] + height / 2, surface_point))
+		surface_depth = -surface_point[2];
+
+	float fardist = max(-(scene_center[2] - scene_size),
+			    scene_size / DOF);
+	float neardist = max(-(scene_center[2] + scene_size),
+			     scene_size / MAXDOF);
+	surface_depth = min(surface_depth, fardist);
+	surface_depth = max(surface_depth, neardist);
+	surface_depth = max(surface_depth, fardist / MAXDOF);
+	neardist = max(neardist, surface_depth / DOF);
+
+	float diag = sqrt(float(sqr(width) + sqr(height)));
+	float top = (float) height / diag * 0.5f * field_of_view * neardist;
+	float bottom = -top;
+	float right = (float) width / diag * 0.5f * field_of_view * neardist;
+	float left = -right;
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glFrustum(left, right, bottom, top, neardist, fardist);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	GLfloat light0_position[] = { lightdir[0], lightdir[1], lightdir[2], 0 };
+	glLightfv(GL_LIGHT0, GL_POSITION, light0_position);
+}
+
+
+// Handle mouse events, updating xf.  mousey is in window coordinates,
+// increasing downwards.
+void GLCamera::mouse(int mousex, int mousey, Mouse::button b,
+		     const point &scene_center, float scene_size,
+		     xform &xf)
+{
+	GLint V[4];
+	glGetIntegerv(GL_VIEWPORT, V);
+	mousey = V[1] + V[3] - 1 - mousey;
+
+	if (b == Mouse::NONE && lastb == Mouse::NONE)
+		return;
+
+	dospin = false;
+	if (lastb != b)
+		mouse_click(mousex, mousey, scene_center, scene_size);
+
+	switch (b) {
+		case Mouse::ROTATE:
+			rotate(mousex, mousey, xf);
+			break;
+		case Mouse::MOVEXY:
+			movexy(mousex, mousey, xf);
+			break;
+		case Mouse::MOVEZ:
+			movez(mousex, mousey, xf);
+			break;
+		case Mouse::WHEELUP:
+		case Mouse::WHEELDOWN:
+			wheel(b, xf);
+			break;
+		case Mouse::LIGHT:
+			relight(mousex, mousey);
+			break;
+		case Mouse::NONE:
+			if (lastb == Mouse::ROTATE)
+				startspin();
+			break;
+	}
+
+	lastmousex = mousex;  lastmousey = mousey;
+	lastb = b;
+	last_time = now();
+}
+
+
+// Remember where the mouse went down: the trackball's center and size,
+// and how far away the surface under the mouse is
+void GLCamera::mouse_click(int mousex, int mousey,
+			   const point &scene_center, float scene_size)
+{
+	point surface_point;
+	if (read_depth(mousex, mousey, surface_point))
+		click_depth = -surface_point[2];
+	else
+		click_depth = surface_depth;
+
+	GLint V[4];
+	glGetIntegerv(GL_VIEWPORT, V);
+	int width = V[2], height = V[3];
+	pixscale = field_of_view / sqrt(float(sqr(width) + sqr(height)));
+
+	// The trackball is centered on the scene if it is in front of us,
+	// and otherwise on the screen
+	if (scene_center[2] < 0.0f) {
+		float d = -scene_center[2];
+		tb_screen_x = V[0] + 0.5f * width +
+			      scene_center[0] / (pixscale * d);
+		tb_screen_y = V[1] + 0.5f * height +
+			      scene_center[1] / (pixscale * d);
+		tb_screen_size = scene_size / (pixscale * d);
+	} else {
+		tb_screen_x = V[0] + 0.5f * width;
+		tb_screen_y = V[1] + 0.5f * height;
+		tb_screen_size = 0.0f;
+	}
+	float minsize = 0.25f * min(width, height);
+	float maxsize = 0.5f * min(width, height);
+	tb_screen_size = min(max(tb_screen_size, minsize), maxsize);
+
+	spincenter = scene_center;
+	if (constraint_ != UNCONSTRAINED)
+		spincenter = point(0, 0, -click_depth);
+}
+
+
+// Map a screen position onto the trackball: a sphere near the center,
+// blending into a hyperbolic sheet further out
+vec GLCamera::mouse2tb(float x, float y)
+{
+	float r2 = sqr(x) + sqr(y);
+	float t = 0.5f * sqr(TRACKBALL_R);
+
+	vec pos(x, y, 0);
+	if (r2 < t)
+		pos[2] = sqrt(2.0f * t - r2);
+	else
+		pos[2] = t / sqrt(r2);
+
+	normalize(pos);
+	return pos;
+}
+
+
+// Rotation with the trackball
+void GLCamera::rotate(int mousex, int mousey, xform &xf)
+{
+	float ox = (lastmousex - tb_screen_x) / tb_screen_size;
+	float oy = (lastmousey - tb_screen_y) / tb_screen_size;
+	float nx = (mousex - tb_screen_x) / tb_screen_size;
+	float ny = (mousey - tb_screen_y) / tb_screen_size;
+
+	vec mouse0, mouse1;
+	if (constraint_ == UNCONSTRAINED) {
+		mouse0 = mouse2tb(ox, oy);
+		mouse1 = mouse2tb(nx, ny);
+		spinaxis = mouse0 CROSS mouse1;
+		float sinang = len(spinaxis);
+		if (sinang < 1e-6f)
+			return;
+		spinaxis /= sinang;
+		float cosang = mouse0 DOT mouse1;
+		spinspeed = atan2(sinang, cosang);
+	} else {
+		// Rotate about a fixed screen axis
+		int axis = (constraint_ == XCONSTRAINED) ? 0 :
+			   (constraint_ == YCONSTRAINED) ? 1 : 2;
+		spinaxis = vec(0, 0, 0);
+		spinaxis[axis] = 1.0f;
+		if (axis == 2)
+			spinspeed = atan2(ox * ny - oy * nx, ox * nx + oy * ny);
+		else if (axis == 0)
+			spinspeed = ny - oy;
+		else
+			spinspeed = nx - ox;
+	}
+
+	xf = xform::trans(spincenter) * xform::rot(spinspeed, spinaxis) *
+	     xform::trans(-spincenter) * xf;
+}
+
+
+// Translation in the plane of the screen
+void GLCamera::movexy(int mousex, int mousey, xform &xf)
+{
+	float dx = pixscale * click_depth * (mousex - lastmousex);
+	float dy = pixscale * click_depth * (mousey - lastmousey);
+	if (constraint_ == XCONSTRAINED)
+		dy = 0;
+	else if (constraint_ == YCONSTRAINED)
+		dx = 0;
+	xf = xform::trans(dx, dy, 0) * xf;
+}
+
+
+// Translation towards and away from the viewer
+void GLCamera::movez(int mousex, int mousey, xform &xf)
+{
+	float delta = 0.01f * ((mousex - lastmousex) - (mousey - lastmousey));
+	float dz = TRANSLATE_SPEED * click_depth * delta;
+	dz = max(dz, -0.5f * click_depth);
+	click_depth += dz;
+	surface_depth += dz;
+	xf = xform::trans(0, 0, dz) * xf;
+}
+
+
+// Translation in z due to the mouse wheel
+void GLCamera::wheel(Mouse::button updown, xform &xf)
+{
+	float dz = WHEEL_MOVE * click_depth;
+	if (updown == Mouse::WHEELUP)
+		dz = -dz;
+	click_depth += dz;
+	surface_depth += dz;
+	xf = xform::trans(0, 0, dz) * xf;
+}
+
+
+// Move the light: its direction follows the mouse over a hemisphere
+void GLCamera::relight(int mousex, int mousey)
+{
+	GLint V[4];
+	glGetIntegerv(GL_VIEWPORT, V);
+	float x = 2.0f * float(mousex - V[0]) / float(V[2]) - 1.0f;
+	float y = 2.0f * float(mousey - V[1]) / float(V[3]) - 1.0f;
+
+	float theta = float(M_PI) * min(sqrt(sqr(x) + sqr(y)), 1.0f);
+	theta = min(theta, float(MAX_LIGHT));
+	float phi = atan2(y, x);
+	lightdir = vec(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+}
+
+
+// Keep spinning after the mouse is released, if it was moving
+void GLCamera::startspin()
+{
+	float dt = now() - last_time;
+	if (dt > SPIN_TIME || fabs(spinspeed) < SPIN_SPEED * dt)
+		return;
+	spinspeed /= max(dt, 0.01f);
+	dospin = true;
+}
+
+
+// Rotate xf by however far the camera has spun since the last call.
+// Returns whether it is still spinning.
+bool GLCamera::autospin(xform &xf)
+{
+	if (!dospin)
+		return false;
+
+	timestamp t = now();
+	float dt = t - last_time;
+	last_time = t;
+	xf = xform::trans(spincenter) * xform::rot(spinspeed * dt, spinaxis) *
+	     xform::trans(-spincenter) * xf;
+	return true;
+}
@@ -0,0 +1,51 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_bounding.cc
+Bounding box and bounding sphere.
+*/
+
+
+#include <stdio.h>
+#include "TriMesh.h"
+#include "bsphere.h"
+
+
+// Find axis-aligned bounding box of the vertices
+void TriMesh::need_bbox()
+{
+	if (vertices.empty() || bbox.valid)
+		return;
+
+	dprintf("Computing bounding box... ");
+
+	bbox.clear();
+	for (size_t i = 0; i < vertices.size(); i++)
+		bbox += vertices[i];
+
+	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
+		bbox.center()[0], bbox.center()[1], bbox.center()[2],
+		0.5f * len(bbox.size()));
+}
+
+
+// Compute a bounding sphere of the vertices, using Miniball
+void TriMesh::need_bsphere()
+{
+	if (vertices.empty() || bsphere.valid)
+		return;
+
+	dprintf("Computing bounding sphere... ");
+
+	Miniball<3,float> mb;
+	mb.check_in(vertices.begin(), vertices.end());
+	mb.build();
+	bsphere.center = mb.center();
+	bsphere.r = sqrt(mb.squared_radius());
+	bsphere.valid = true;
+
+	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
+		bsphere.center[0], bsphere.center[1],
+		bsphere.center[2], bsphere.r);
+}
@@ -0,0 +1,224 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_connectivity.cc
+Manipulate data structures that describe connectivity between faces and verts.
+
+The per-vertex lists are kept in compressed sparse row form (see
+TriMesh::Adjacency), and built in parallel in two passes: one to count
+the entries of each list, and, after a prefix sum gives the offsets,
+one to fill them in.  The lists come out in the same order as if they
+had been built by a serial loop over the faces.
+*/
+
+
+#include <stdio.h>
+#include "TriMesh.h"
+#include <algorithm>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using std::find;
+
+
+// How many threads the parallel loops will use
+static int num_threads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+// Turn per-element counts into CSR offsets, and size the index array
+static void counts_to_offsets(TriMesh::Adjacency &adj)
+{
+	int n = adj.offset.size() - 1;
+	int total = 0;
+	for (int i = 0; i < n; i++) {
+		int count = adj.offset[i];
+		adj.offset[i] = total;
+		total += count;
+	}
+	adj.offset[n] = total;
+	adj.index.resize(total);
+}
+
+
+// Append the neighbors of vertex v to nbrs, in the order a loop over its
+// faces would first find them, and return how many there are
+static int find_neighbors(const TriMesh *mesh, int v, int *nbrs)
+{
+	int n = 0;
+	TriMesh::AdjList af = mesh->adjacentfaces[v];
+	for (int k = 0; k < af.size(); k++) {
+		const TriMesh::Face &f = mesh->faces[af[k]];
+		for (int j = 0; j < 3; j++) {
+			if (f[j] != v)
+				continue;
+			int n1 = f[(j+1)%3];
+			int n2 = f[(j+2)%3];
+			if (find(nbrs, nbrs + n, n1) == nbrs + n)
+				nbrs[n++] = n1;
+			if (find(nbrs, nbrs + n, n2) == nbrs + n)
+				nbrs[n++] = n2;
+		}
+	}
+	return n;
+}
+
+
+// Find the direct neighbors of each vertex
+void TriMesh::need_neighbors()
+{
+	if (!neighbors.empty())
+		return;
+	need_faces();
+	if (faces.empty())
+		return;
+	need_adjacentfaces();
+
+	dprintf("Finding vertex neighbors... ");
+	int nv = vertices.size();
+
+	// A vertex has at most two neighbors per adjacent face, so each
+	// list fits in the space between its offsets in adjacentfaces,
+	// times two
+	neighbors.offset.resize(nv + 1);
+#pragma omp parallel
+	{
+		std::vector<int> tmp;
+#pragma omp for
+		for (int i = 0; i < nv; i++) {
+			tmp.resize(2 * adjacentfaces[i].size());
+			neighbors.offset[i] = tmp.empty() ? 0 :
+				find_neighbors(this, i, &tmp[0]);
+		}
+	}
+	counts_to_offsets(neighbors);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		if (neighbors.offset[i+1] > neighbors.offset[i])
+			find_neighbors(this, i,
+				       &neighbors.index[neighbors.offset[i]]);
+	}
+
+	dprintf("Done.\n");
+}
+
+
+// Find the faces touching each vertex.  Each thread handles a range of
+// vertices, scanning all the faces for those touching its range, so
+// the lists come out in face order with no atomics.
+void TriMesh::need_adjacentfaces()
+{
+	if (!adjacentfaces.empty())
+		return;
+	need_faces();
+	if (faces.empty())
+		return;
+
+	dprintf("Finding vertex to triangle maps... ");
+	int nv = vertices.size(), nf = faces.size();
+	int nranges = std::min(num_threads(), nv);
+
+	adjacentfaces.offset.assign(nv + 1, 0);
+#pragma omp parallel for
+	for (int r = 0; r < nranges; r++) {
+		int vbegin = int((long long) nv * r / nranges);
+		int vend = int((long long) nv * (r + 1) / nranges);
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+				int v = faces[i][j];
+				if (v >= vbegin && v < vend)
+					adjacentfaces.offset[v]++;
+			}
+		}
+	}
+	counts_to_offsets(adjacentfaces);
+#pragma omp parallel for
+	for (int r = 0; r < nranges; r++) {
+		int vbegin = int((long long) nv * r / nranges);
+		int vend = int((long long) nv * (r + 1) / nranges);
+		std::vector<int> next(adjacentfaces.offset.begin() + vbegin,
+				      adjacentfaces.offset.begin() + vend);
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+				int v = faces[i][j];
+				if (v >= vbegin && v < vend)
+					adjacentfaces.index[next[v-vbegin]++] = i;
+			}
+		}
+	}
+
+	dprintf("Done.\n");
+}
+
+
+// The face across edge j of face i, found by searching the faces around
+// the edge's first vertex, or -1
+static int find_across_edge(const TriMesh *mesh, int i, int j)
+{
+	const TriMesh::Face &f = mesh->faces[i];
+	int v1 = f[(j+1)%3];
+	int v2 = f[(j+2)%3];
+	TriMesh::AdjList a1 = mesh->adjacentfaces[v1];
+	TriMesh::AdjList a2 = mesh->adjacentfaces[v2];
+	for (int k1 = 0; k1 < a1.size(); k1++) {
+		int other = a1[k1];
+		if (other == i)
+			continue;
+		if (find(a2.begin(), a2.end(), other) == a2.end())
+			continue;
+		int ind = (mesh->faces[other].indexof(v1)+1)%3;
+		if (mesh->faces[other][(ind+1)%3] != v2)
+			continue;
+		return other;
+	}
+	return -1;
+}
+
+
+// Find the face across each edge from each other face (-1 on boundary)
+// If topology is bad, not necessarily what one would expect...
+void TriMesh::need_across_edge()
+{
+	if (!across_edge.empty())
+		return;
+	need_adjacentfaces();
+	if (adjacentfaces.empty())
+		return;
+
+	dprintf("Finding across-edge maps... ");
+
+	int nf = faces.size();
+
+	// Search around every edge in parallel...
+	std::vector<Face> found(nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++)
+		for (int j = 0; j < 3; j++)
+			found[i][j] = find_across_edge(this, i, j);
+
+	// ... then pair up the faces in order, so that where more than two
+	// faces share an edge the pairing is the same as it always was
+	across_edge.resize(nf, Face(-1,-1,-1));
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (across_edge[i][j] != -1)
+				continue;
+			int other = found[i][j];
+			if (other < 0)
+				continue;
+			int v1 = faces[i][(j+1)%3];
+			int ind = (faces[other].indexof(v1)+1)%3;
+			across_edge[i][j] = other;
+			across_edge[other][ind] = i;
+		}
+	}
+
+	dprintf("Done.\n");
+}
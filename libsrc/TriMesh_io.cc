@@ -0,0 +1,875 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_io.cc
+Input and output of triangle meshes
+Can read: PLY (ascii and binary), OFF, OBJ
+Can write: PLY (binary), OBJ
+
+Files are read into memory in one go and parsed from there, with a
+number parser that doesn't go through the C library.  OBJ files are
+split into chunks at line boundaries, and the chunks parsed in parallel.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <string>
+#include "TriMesh.h"
+#include "strutil.h"
+
+#ifdef _WIN32
+# define FSEEK64 _fseeki64
+# define FTELL64 _ftelli64
+#else
+# define FSEEK64 fseeko
+# define FTELL64 ftello
+#endif
+
+using namespace std;
+
+
+// Forward declarations
+static bool read_ply(FILE *f, TriMesh *mesh);
+static bool read_off(FILE *f, TriMesh *mesh);
+static bool read_obj(FILE *f, TriMesh *mesh);
+static bool write_ply(TriMesh *mesh, FILE *f);
+static bool write_obj(TriMesh *mesh, FILE *f);
+static void tess(vector<TriMesh::Face> &faces, const int *thisface, int n);
+
+
+// Read a TriMesh from a file.  Defined to use a helper function to make
+// subclassing easier.
+TriMesh *TriMesh::read(const char *filename)
+{
+	TriMesh *mesh = new TriMesh();
+
+	if (read_helper(filename, mesh))
+		return mesh;
+
+	delete mesh;
+	return NULL;
+}
+
+
+// Actual reading code
+bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
+{
+	if (!filename || *filename == '\0')
+		return false;
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	dprintf("Reading %s... ", filename);
+
+	bool ok = false;
+	int c = fgetc(f);
+	if (c == EOF) {
+		eprintf("Can't read header\n");
+		goto out;
+	}
+	ungetc(c, f);
+
+	if (c == 'p') {
+		// See if it's a ply file
+		char buf[4];
+		if (!fgets(buf, 4, f)) {
+			eprintf("Can't read header\n");
+			goto out;
+		}
+		if (strncmp(buf, "ply", 3) == 0) {
+			ok = read_ply(f, mesh);
+			goto out;
+		}
+		rewind(f);
+	} else if (c == 'O') {
+		// See if it's an OFF file
+		char buf[4];
+		if (!fgets(buf, 4, f)) {
+			eprintf("Can't read header\n");
+			goto out;
+		}
+		if (strncmp(buf, "OFF", 3) == 0) {
+			ok = read_off(f, mesh);
+			goto out;
+		}
+		rewind(f);
+	}
+
+	// Anything else is treated as OBJ
+	ok = read_obj(f, mesh);
+
+out:
+	fclose(f);
+	if (!ok || (mesh->vertices.empty() && mesh->faces.empty())) {
+		eprintf("\nError reading file [%s]\n", filename);
+		return false;
+	}
+
+	dprintf("Done.\n");
+	return true;
+}
+
+
+// Read the rest of a file, from the current position, into memory.
+// The buffer is terminated by an extra NUL.
+static bool slurp(FILE *f, vector<char> &buf)
+{
+	long long start = FTELL64(f);
+	if (start < 0 || FSEEK64(f, 0, SEEK_END) != 0)
+		return false;
+	long long end = FTELL64(f);
+	if (end < start || FSEEK64(f, start, SEEK_SET) != 0)
+		return false;
+
+	size_t size = size_t(end - start);
+	buf.resize(size + 1);
+	const size_t block = 16 << 20;
+	for (size_t done = 0; done < size; ) {
+		size_t n = min(block, size - done);
+		if (fread(&buf[done], 1, n, f) != n)
+			return false;
+		done += n;
+	}
+	buf[size] = '\0';
+	return true;
+}
+
+
+// Character classes for the parsers below.  Lines may end in \n or \r\n.
+static inline bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline const char *skip_blanks(const char *p)
+{
+	while (is_blank(*p))
+		p++;
+	return p;
+}
+
+static inline const char *skip_space(const char *p)
+{
+	while (is_blank(*p) || *p == '\n')
+		p++;
+	return p;
+}
+
+static inline const char *next_line(const char *p)
+{
+	while (*p && *p != '\n')
+		p++;
+	return *p ? p + 1 : p;
+}
+
+// Skip blank lines and comments (lines beginning with #)
+static inline const char *skip_comments(const char *p)
+{
+	while (1) {
+		p = skip_space(p);
+		if (*p != '#')
+			return p;
+		p = next_line(p);
+	}
+}
+
+
+// Parse a number starting at p.  Returns the end of the number, or NULL
+// if there isn't one.  Numbers with at most 15 significant digits and
+// small exponents are converted exactly with one rounding in double
+// precision; anything else goes to strtod.
+static const char *parse_double(const char *p, double &val)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22
+	};
+
+	const char *start = p;
+	bool neg = false;
+	if (*p == '-')
+		neg = true, p++;
+	else if (*p == '+')
+		p++;
+
+	unsigned long long mant = 0;
+	int ndigits = 0, exp10 = 0;
+	bool any = false;
+	while (*p == '0')
+		p++, any = true;
+	while (is_digit(*p)) {
+		if (ndigits < 19)
+			mant = mant * 10 + (*p - '0'), ndigits++;
+		else
+			exp10++;
+		p++, any = true;
+	}
+	if (*p == '.') {
+		p++;
+		if (!ndigits) {
+			while (*p == '0')
+				p++, exp10--, any = true;
+		}
+		while (is_digit(*p)) {
+			if (ndigits < 19)
+				mant = mant * 10 + (*p - '0'), ndigits++,
+				exp10--;
+			p++, any = true;
+		}
+	}
+	if (!any) {
+		// Maybe inf or nan
+		char *end;
+		val = strtod(start, &end);
+		return (end == start) ? NULL : end;
+	}
+	if (*p == 'e' || *p == 'E') {
+		const char *q = p + 1;
+		bool eneg = false;
+		if (*q == '-')
+			eneg = true, q++;
+		else if (*q == '+')
+			q++;
+		if (is_digit(*q)) {
+			int e = 0;
+			while (is_digit(*q)) {
+				if (e < 10000)
+					e = e * 10 + (*q - '0');
+				q++;
+			}
+			exp10 += eneg ? -e : e;
+			p = q;
+		}
+	}
+
+	if (ndigits > 15 || exp10 > 22 || exp10 < -22) {
+		val = strtod(start, NULL);
+		return p;
+	}
+	double d = double(mant);
+	if (exp10 >= 0)
+		d *= pow10[exp10];
+	else
+		d /= pow10[-exp10];
+	val = neg ? -d : d;
+	return p;
+}
+
+static inline const char *parse_float(const char *p, float &val)
+{
+	double d;
+	p = parse_double(p, d);
+	val = float(d);
+	return p;
+}
+
+// Parse an integer starting at p
+static inline const char *parse_int(const char *p, int &val)
+{
+	bool neg = false;
+	if (*p == '-')
+		neg = true, p++;
+	else if (*p == '+')
+		p++;
+	if (!is_digit(*p))
+		return NULL;
+	int i = 0;
+	while (is_digit(*p))
+		i = i * 10 + (*p++ - '0');
+	val = neg ? -i : i;
+	return p;
+}
+
+
+// Is this machine little-endian?
+static inline bool we_are_little_endian()
+{
+	int test = 1;
+	return *(char *) &test == 1;
+}
+
+
+// Byte-swap a 32-bit or 64-bit quantity
+static inline void swap_4(void *p)
+{
+	unsigned char *c = (unsigned char *) p;
+	swap(c[0], c[3]);
+	swap(c[1], c[2]);
+}
+
+static inline void swap_8(void *p)
+{
+	unsigned char *c = (unsigned char *) p;
+	swap(c[0], c[7]);
+	swap(c[1], c[6]);
+	swap(c[2], c[5]);
+	swap(c[3], c[4]);
+}
+
+
+// Types of properties that may appear in a PLY file
+enum PlyType { PLY_CHAR, PLY_UCHAR, PLY_SHORT, PLY_USHORT,
+	       PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE, PLY_NONE };
+
+static PlyType ply_type(const char *name)
+{
+	if (!strcmp(name, "char") || !strcmp(name, "int8"))
+		return PLY_CHAR;
+	if (!strcmp(name, "uchar") || !strcmp(name, "uint8"))
+		return PLY_UCHAR;
+	if (!strcmp(name, "short") || !strcmp(name, "int16"))
+		return PLY_SHORT;
+	if (!strcmp(name, "ushort") || !strcmp(name, "uint16"))
+		return PLY_USHORT;
+	if (!strcmp(name, "int") || !strcmp(name, "int32"))
+		return PLY_INT;
+	if (!strcmp(name, "uint") || !strcmp(name, "uint32"))
+		return PLY_UINT;
+	if (!strcmp(name, "float") || !strcmp(name, "float32"))
+		return PLY_FLOAT;
+	if (!strcmp(name, "double") || !strcmp(name, "float64"))
+		return PLY_DOUBLE;
+	return PLY_NONE;
+}
+
+static int ply_type_size(PlyType t)
+{
+	static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+	return sizes[t];
+}
+
+
+// One property of a PLY element
+struct PlyProperty {
+	string name;
+	PlyType type;
+	PlyType count_type; // PLY_NONE unless this is a list
+};
+
+// One element (vertex, face, ...) of a PLY file
+struct PlyElement {
+	string name;
+	int count;
+	vector<PlyProperty> props;
+};
+
+
+// Read one value of the given type from the PLY data at p, which ends
+// at end.  Returns the position after it, or NULL.
+static inline const char *ply_read_value(const char *p, const char *end,
+					 PlyType t, bool binary,
+					 bool need_swap, double &val)
+{
+	if (!binary) {
+		p = skip_space(p);
+		if (p >= end)
+			return NULL;
+		return parse_double(p, val);
+	}
+
+	unsigned char buf[8];
+	int size = ply_type_size(t);
+	if (end - p < size)
+		return NULL;
+	memcpy(buf, p, size);
+	if (need_swap) {
+		if (size == 2)
+			swap(buf[0], buf[1]);
+		else if (size == 4)
+			swap_4(buf);
+		else if (size == 8)
+			swap_8(buf);
+	}
+
+	switch (t) {
+		case PLY_CHAR:   val = *(signed char *) buf; break;
+		case PLY_UCHAR:  val = *(unsigned char *) buf; break;
+		case PLY_SHORT:  val = *(short *) buf; break;
+		case PLY_USHORT: val = *(unsigned short *) buf; break;
+		case PLY_INT:    val = *(int *) buf; break;
+		case PLY_UINT:   val = *(unsigned *) buf; break;
+		case PLY_FLOAT:  val = *(float *) buf; break;
+		case PLY_DOUBLE: val = *(double *) buf; break;
+		default:         return NULL;
+	}
+	return p + size;
+}
+
+
+// Read a ply file
+static bool read_ply(FILE *f, TriMesh *mesh)
+{
+	char buf[1024];
+	bool binary = false, need_swap = false;
+	vector<PlyElement> elements;
+
+	// Read the header
+	if (!fgets(buf, 1024, f))
+		return false;
+	if (begins_with(buf, "format binary_big_endian")) {
+		binary = true;
+		need_swap = we_are_little_endian();
+	} else if (begins_with(buf, "format binary_little_endian")) {
+		binary = true;
+		need_swap = !we_are_little_endian();
+	} else if (!begins_with(buf, "format ascii")) {
+		TriMesh::eprintf("Unknown ply format or version\n");
+		return false;
+	}
+
+	while (1) {
+		if (!fgets(buf, 1024, f))
+			return false;
+		if (begins_with(buf, "end_header"))
+			break;
+		char s1[256], s2[256], s3[256];
+		if (begins_with(buf, "element")) {
+			PlyElement e;
+			int count;
+			if (sscanf(buf, "element %255s %d", s1, &count) != 2)
+				return false;
+			e.name = s1;
+			e.count = count;
+			elements.push_back(e);
+		} else if (begins_with(buf, "property list")) {
+			if (elements.empty() ||
+			    sscanf(buf, "property list %255s %255s %255s",
+				   s1, s2, s3) != 3)
+				return false;
+			PlyProperty p;
+			p.count_type = ply_type(s1);
+			p.type = ply_type(s2);
+			p.name = s3;
+			if (p.count_type == PLY_NONE || p.type == PLY_NONE)
+				return false;
+			elements.back().props.push_back(p);
+		} else if (begins_with(buf, "property")) {
+			if (elements.empty() ||
+			    sscanf(buf, "property %255s %255s", s1, s2) != 2)
+				return false;
+			PlyProperty p;
+			p.type = ply_type(s1);
+			p.count_type = PLY_NONE;
+			p.name = s2;
+			if (p.type == PLY_NONE)
+				return false;
+			elements.back().props.push_back(p);
+		}
+	}
+
+	// Read the data
+	vector<char> data;
+	if (!slurp(f, data))
+		return false;
+	const char *p = &data[0], *end = p + data.size() - 1;
+
+	vector<int> thisface;
+	for (size_t i = 0; i < elements.size(); i++) {
+		const PlyElement &e = elements[i];
+		bool is_vert = (e.name == "vertex");
+		bool is_face = (e.name == "face");
+		if (is_vert)
+			mesh->vertices.reserve(e.count);
+		if (is_face)
+			mesh->faces.reserve(e.count);
+
+		// Where each property of a vertex goes: 0-2 = position,
+		// 3-5 = color, -1 = nowhere
+		vector<int> dest(e.props.size(), -1);
+		bool have_color = false;
+		for (size_t k = 0; is_vert && k < e.props.size(); k++) {
+			const string &name = e.props[k].name;
+			if (name == "x") dest[k] = 0;
+			else if (name == "y") dest[k] = 1;
+			else if (name == "z") dest[k] = 2;
+			else if (name == "red" || name == "diffuse_red")
+				dest[k] = 3, have_color = true;
+			else if (name == "green" || name == "diffuse_green")
+				dest[k] = 4;
+			else if (name == "blue" || name == "diffuse_blue")
+				dest[k] = 5;
+		}
+		if (have_color)
+			mesh->colors.reserve(e.count);
+
+		for (int j = 0; j < e.count; j++) {
+			float v[6] = { 0, 0, 0, 0, 0, 0 };
+			for (size_t k = 0; k < e.props.size(); k++) {
+				const PlyProperty &prop = e.props[k];
+				double val;
+				if (prop.count_type == PLY_NONE) {
+					p = ply_read_value(p, end, prop.type,
+						binary, need_swap, val);
+					if (!p)
+						return false;
+					if (dest[k] >= 0)
+						v[dest[k]] = float(val);
+					continue;
+				}
+				double count;
+				p = ply_read_value(p, end, prop.count_type,
+						   binary, need_swap, count);
+				if (!p)
+					return false;
+				bool want = is_face &&
+					    (prop.name == "vertex_indices" ||
+					     prop.name == "vertex_index");
+				thisface.resize(int(count));
+				for (int l = 0; l < int(count); l++) {
+					p = ply_read_value(p, end, prop.type,
+						binary, need_swap, val);
+					if (!p)
+						return false;
+					thisface[l] = int(val);
+				}
+				if (want && thisface.size() >= 3)
+					tess(mesh->faces, &thisface[0],
+					     thisface.size());
+			}
+			if (is_vert) {
+				mesh->vertices.push_back(point(v[0], v[1], v[2]));
+				if (have_color)
+					mesh->colors.push_back(Color(
+						v[3] / 255.0f, v[4] / 255.0f,
+						v[5] / 255.0f));
+			}
+		}
+	}
+
+	return true;
+}
+
+
+// Read an off file
+static bool read_off(FILE *f, TriMesh *mesh)
+{
+	vector<char> data;
+	if (!slurp(f, data))
+		return false;
+	const char *p = skip_comments(&data[0]);
+
+	int nverts, nfaces;
+	if (!(p = parse_int(p, nverts)) ||
+	    !(p = parse_int(skip_blanks(p), nfaces)))
+		return false;
+	if (nverts <= 0 || nfaces < 0)
+		return false;
+	p = next_line(p);
+
+	mesh->vertices.resize(nverts);
+	for (int i = 0; i < nverts; i++) {
+		p = skip_comments(p);
+		for (int j = 0; j < 3; j++) {
+			p = parse_float(skip_blanks(p), mesh->vertices[i][j]);
+			if (!p)
+				return false;
+		}
+		// Skip anything else (e.g. colors) on this line
+		p = next_line(p);
+	}
+
+	mesh->faces.reserve(nfaces);
+	vector<int> thisface;
+	for (int i = 0; i < nfaces; i++) {
+		p = skip_comments(p);
+		int n;
+		if (!(p = parse_int(p, n)) || n < 0)
+			return false;
+		thisface.resize(n);
+		for (int j = 0; j < n; j++)
+			if (!(p = parse_int(skip_blanks(p), thisface[j])))
+				return false;
+		if (n >= 3)
+			tess(mesh->faces, &thisface[0], n);
+		p = next_line(p);
+	}
+
+	return true;
+}
+
+
+// What one chunk of an obj file holds.  Relative (negative) vertex
+// indices are stored relative to the start of the chunk, and their
+// corners (3 * face + j) listed in relative so they can be fixed up
+// once the chunks' vertex counts are known.
+struct ObjChunk {
+	const char *begin, *end;
+	vector<point> vertices;
+	vector<TriMesh::Face> faces;
+	vector<int> relative;
+	bool ok;
+};
+
+
+// Parse the lines of an obj file in [chunk.begin, chunk.end)
+static void read_obj_chunk(ObjChunk &chunk)
+{
+	chunk.ok = true;
+	vector<int> thisface;
+	vector<bool> thisrel;
+	const char *p = chunk.begin;
+	while (p < chunk.end) {
+		p = skip_blanks(p);
+		if (p[0] == 'v' && is_blank(p[1])) {
+			point v;
+			p++;
+			for (int j = 0; j < 3; j++) {
+				p = parse_float(skip_blanks(p), v[j]);
+				if (!p) {
+					chunk.ok = false;
+					return;
+				}
+			}
+			chunk.vertices.push_back(v);
+		} else if (p[0] == 'f' && is_blank(p[1])) {
+			thisface.clear();
+			thisrel.clear();
+			p++;
+			bool rel = false;
+			while (1) {
+				p = skip_blanks(p);
+				int ind;
+				const char *q = parse_int(p, ind);
+				if (!q)
+					break;
+				thisrel.push_back(ind < 0);
+				if (ind < 0) {
+					ind += chunk.vertices.size();
+					rel = true;
+				} else {
+					ind--;
+				}
+				thisface.push_back(ind);
+				// Skip texture coordinate and normal indices
+				p = q;
+				while (*p && !is_blank(*p) && *p != '\n')
+					p++;
+			}
+			int n = thisface.size();
+			if (n >= 3 && !rel)
+				tess(chunk.faces, &thisface[0], n);
+			// Same fan as tess, remembering relative corners
+			for (int i = 2; rel && i < n; i++) {
+				int corner = 3 * chunk.faces.size();
+				chunk.faces.push_back(TriMesh::Face(thisface[0],
+					thisface[i-1], thisface[i]));
+				if (thisrel[0])
+					chunk.relative.push_back(corner);
+				if (thisrel[i-1])
+					chunk.relative.push_back(corner + 1);
+				if (thisrel[i])
+					chunk.relative.push_back(corner + 2);
+			}
+		}
+		p = next_line(p);
+	}
+}
+
+
+// Read an obj file
+static bool read_obj(FILE *f, TriMesh *mesh)
+{
+	vector<char> data;
+	if (!slurp(f, data))
+		return false;
+	const char *begin = &data[0], *end = begin + data.size() - 1;
+
+	// Split into chunks of about 4 MB, ending at line boundaries
+	const size_t chunk_size = 4 << 20;
+	int nchunks = int((end - begin) / chunk_size) + 1;
+	vector<ObjChunk> chunks(nchunks);
+	const char *p = begin;
+	for (int c = 0; c < nchunks; c++) {
+		chunks[c].begin = p;
+		if (c == nchunks - 1 || size_t(end - p) <= chunk_size)
+			p = end;
+		else
+			p = next_line(p + chunk_size);
+		chunks[c].end = p;
+	}
+
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++)
+		read_obj_chunk(chunks[c]);
+
+	// Gather the chunks, fixing up relative indices
+	int nv = 0, nf = 0;
+	vector<int> first_vertex(nchunks), first_face(nchunks);
+	for (int c = 0; c < nchunks; c++) {
+		if (!chunks[c].ok)
+			return false;
+		first_vertex[c] = nv;
+		first_face[c] = nf;
+		nv += chunks[c].vertices.size();
+		nf += chunks[c].faces.size();
+	}
+	mesh->vertices.resize(nv);
+	mesh->faces.resize(nf);
+#pragma omp parallel for
+	for (int c = 0; c < nchunks; c++) {
+		ObjChunk &chunk = chunks[c];
+		for (size_t i = 0; i < chunk.relative.size(); i++) {
+			int corner = chunk.relative[i];
+			chunk.faces[corner / 3][corner % 3] += first_vertex[c];
+		}
+		if (!chunk.vertices.empty())
+			memcpy(&mesh->vertices[first_vertex[c]],
+			       &chunk.vertices[0],
+			       chunk.vertices.size() * sizeof(point));
+		if (!chunk.faces.empty())
+			memcpy(&mesh->faces[first_face[c]], &chunk.faces[0],
+			       chunk.faces.size() * sizeof(TriMesh::Face));
+	}
+
+	return true;
+}
+
+
+// Tesselate an arbitrary n-gon as a triangle fan.  Appends to faces
+static void tess(vector<TriMesh::Face> &faces, const int *thisface, int n)
+{
+	for (int i = 2; i < n; i++)
+		faces.push_back(TriMesh::Face(thisface[0],
+					      thisface[i-1],
+					      thisface[i]));
+}
+
+
+// Write a TriMesh to a file, with the format determined by the extension
+bool TriMesh::write(const char *filename)
+{
+	if (!filename || *filename == '\0')
+		return false;
+
+	need_faces();
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		eprintf("Error opening [%s] for writing: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	dprintf("Writing %s... ", filename);
+
+	bool ok = ends_with(filename, ".obj") ? write_obj(this, f) :
+						write_ply(this, f);
+	fclose(f);
+	if (!ok) {
+		eprintf("\nError writing file [%s]\n", filename);
+		return false;
+	}
+
+	dprintf("Done.\n");
+	return true;
+}
+
+
+// Write a binary ply file, in native byte order
+static bool write_ply(TriMesh *mesh, FILE *f)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	fprintf(f, "ply\nformat binary_%s_endian 1.0\n",
+		we_are_little_endian() ? "little" : "big");
+	fprintf(f, "element vertex %d\n", nv);
+	fprintf(f, "property float x\nproperty float y\nproperty float z\n");
+	fprintf(f, "element face %d\n", nf);
+	fprintf(f, "property list uchar int vertex_indices\nend_header\n");
+
+	if (nv && fwrite(&mesh->vertices[0][0], 12, nv, f) != size_t(nv))
+		return false;
+	for (int i = 0; i < nf; i++) {
+		unsigned char n = 3;
+		if (fwrite(&n, 1, 1, f) != 1 ||
+		    fwrite(&mesh->faces[i][0], 4, 3, f) != 3)
+			return false;
+	}
+	return true;
+}
+
+
+// Write an obj file
+static bool write_obj(TriMesh *mesh, FILE *f)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	for (int i = 0; i < nv; i++)
+		fprintf(f, "v %.7g %.7g %.7g\n", mesh->vertices[i][0],
+			mesh->vertices[i][1], mesh->vertices[i][2]);
+	for (int i = 0; i < nf; i++)
+		fprintf(f, "f %d %d %d\n", mesh->faces[i][0] + 1,
+			mesh->faces[i][1] + 1, mesh->faces[i][2] + 1);
+	return !ferror(f);
+}
+
+
+// Debugging printout, controllable by a "verbose"ness parameter, and
+// hookable for GUIs
+int TriMesh::verbose = 1;
+
+void TriMesh::set_verbose(int verbose_)
+{
+	verbose = verbose_;
+}
+
+void (*TriMesh::dprintf_hook)(const char *) = NULL;
+
+void TriMesh::set_dprintf_hook(void (*hook)(const char *))
+{
+	dprintf_hook = hook;
+}
+
+void TriMesh::dprintf(const char *format, ...)
+{
+	if (!verbose)
+		return;
+
+	va_list ap;
+	va_start(ap, format);
+	char buf[1024];
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+
+	if (dprintf_hook) {
+		dprintf_hook(buf);
+	} else {
+		fprintf(stderr, "%s", buf);
+		fflush(stderr);
+	}
+}
+
+
+// Same as above, but fatal-error printout
+void (*TriMesh::eprintf_hook)(const char *) = NULL;
+
+void TriMesh::set_eprintf_hook(void (*hook)(const char *))
+{
+	eprintf_hook = hook;
+}
+
+void TriMesh::eprintf(const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	char buf[1024];
+	vsnprintf(buf, sizeof(buf), format, ap);
+	va_end(ap);
+
+	if (eprintf_hook) {
+		eprintf_hook(buf);
+	} else {
+		fprintf(stderr, "%s", buf);
+		fflush(stderr);
+	}
+}
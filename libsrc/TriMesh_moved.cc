@@ -0,0 +1,128 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_moved.cc
+Tracking of moved vertices, so that the per-vertex properties computed
+from the geometry can be updated just around them.
+
+Moving a vertex changes the corner areas of the faces around it, and so
+the point areas and normals of its 1-ring.  Curvatures are fit to the
+normals, corner areas and point areas of the faces around each vertex,
+so they change in the 2-ring, and dcurv, fit to the curvatures, in the
+3-ring.  need_normals, need_pointareas, need_curvatures and need_dcurv
+recompute each of those vertices from scratch, adding up over its faces
+in the same order as when computing all of them, so that the result is
+the same as recomputing everything.  When the region gets to be a good
+part of the mesh, they just recompute everything.
+
+With a tolerance, vertices that moved less than it since their
+properties were last computed are not counted as moved, trading some
+accuracy for time when most of the mesh moves a little.
+*/
+
+
+#include "TriMesh.h"
+#include <algorithm>
+using namespace std;
+
+
+// Mark vertex v as moved.  The properties computed so far will be updated
+// around it the next time they are asked for.
+void TriMesh::mark_moved(int v)
+{
+	int nv = vertices.size();
+	if (int(tracked_vertices.size()) == nv)
+		tracked_vertices[v] = vertices[v];
+	if (int(normals.size()) == nv)
+		moved_stale |= STALE_NORMALS;
+	if (int(pointareas.size()) == nv)
+		moved_stale |= STALE_POINTAREAS;
+	if (int(curv1.size()) == nv)
+		moved_stale |= STALE_CURVATURES;
+	if (int(dcurv.size()) == nv)
+		moved_stale |= STALE_DCURV;
+	// Nothing to update if nothing has been computed
+	if (moved_stale)
+		moved.push_back(v);
+}
+
+
+// Mark the vertices that moved by more than epsilon since they were last
+// marked.  The first call starts tracking, and since it can't tell what
+// moved before then, drops the properties computed so far.
+void TriMesh::find_moved(float epsilon)
+{
+	int nv = vertices.size();
+	if (int(tracked_vertices.size()) != nv) {
+		dprintf("Tracking moved vertices... ");
+		tracked_vertices = vertices;
+		moved.clear();
+		moved_stale = 0;
+		normals.clear();
+		pointareas.clear(); cornerareas.clear();
+		curv1.clear(); curv2.clear(); pdir1.clear(); pdir2.clear();
+		dcurv.clear();
+		dprintf("Done.\n");
+		return;
+	}
+
+	float epsilon2 = sqr(epsilon);
+	int nmoved = moved.size();
+	for (int i = 0; i < nv; i++) {
+		if (dist2(vertices[i], tracked_vertices[i]) > epsilon2)
+			mark_moved(i);
+	}
+	dprintf("%d of %d vertices moved.\n", int(moved.size()) - nmoved, nv);
+}
+
+
+// The moved vertices and those within rings edges of them, in order.
+// Returns false, leaving verts incomplete, if that is more than a quarter
+// of the mesh: since each face is then fit once for each of its vertices
+// rather than once, it is quicker to update everything.
+bool TriMesh::moved_region(int rings, vector<int> &verts)
+{
+	need_adjacentfaces();
+	int nv = vertices.size();
+	vector<char> in(nv);
+	verts.clear();
+	for (size_t k = 0; k < moved.size(); k++) {
+		if (!in[moved[k]]) {
+			in[moved[k]] = 1;
+			verts.push_back(moved[k]);
+		}
+	}
+
+	// Add each ring around the last
+	size_t begin = 0;
+	for (int r = 0; r < rings; r++) {
+		size_t end = verts.size();
+		for (size_t k = begin; k < end; k++) {
+			AdjList af = adjacentfaces[verts[k]];
+			for (int l = 0; l < af.size(); l++) {
+				const Face &f = faces[af[l]];
+				for (int j = 0; j < 3; j++) {
+					if (!in[f[j]]) {
+						in[f[j]] = 1;
+						verts.push_back(f[j]);
+					}
+				}
+			}
+			if (4 * int(verts.size()) > nv)
+				return false;
+		}
+		begin = end;
+	}
+	sort(verts.begin(), verts.end());
+	return 4 * int(verts.size()) <= nv;
+}
+
+
+// Note that the given properties are up to date around the moved vertices
+void TriMesh::done_moved(unsigned stale)
+{
+	moved_stale &= ~stale;
+	if (!moved_stale)
+		moved.clear();
+}
@@ -0,0 +1,108 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_normals.cc
+Compute per-vertex normals for TriMeshes
+
+For meshes, uses average of per-face normals, weighted according to:
+  Max, N.
+  "Weights for Computing Vertex Normals from Facet Normals,"
+  Journal of Graphics Tools, Vol. 4, No. 2, 1999.
+*/
+
+
+#include "TriMesh.h"
+using namespace std;
+
+
+// What face i adds to the normal at each of its corners.  Returns false
+// for a degenerate face, which adds nothing.
+static bool corner_normals(const TriMesh *mesh, int i, vec cn[3])
+{
+	const TriMesh::Face &f = mesh->faces[i];
+	const point &p0 = mesh->vertices[f[0]];
+	const point &p1 = mesh->vertices[f[1]];
+	const point &p2 = mesh->vertices[f[2]];
+	vec a = p0-p1, b = p1-p2, c = p2-p0;
+	float l2a = len2(a), l2b = len2(b), l2c = len2(c);
+	if (!l2a || !l2b || !l2c)
+		return false;
+	vec facenormal = a CROSS b;
+	cn[0] = facenormal * (1.0f / (l2a * l2c));
+	cn[1] = facenormal * (1.0f / (l2b * l2a));
+	cn[2] = facenormal * (1.0f / (l2c * l2b));
+	return true;
+}
+
+
+// Recompute the normals of the vertices around those that moved
+static void update_moved_normals(TriMesh *mesh, const vector<int> &verts)
+{
+	int n = verts.size();
+#pragma omp parallel for
+	for (int k = 0; k < n; k++) {
+		int v = verts[k];
+		TriMesh::AdjList af = mesh->adjacentfaces[v];
+		vec sum;
+		for (int l = 0; l < af.size(); l++) {
+			int i = af[l];
+			vec cn[3];
+			if ((l > 0 && af[l-1] == i) || !corner_normals(mesh, i, cn))
+				continue;
+			for (int j = 0; j < 3; j++)
+				if (mesh->faces[i][j] == v)
+					sum = sum + cn[j];
+		}
+		normalize(sum);
+		mesh->normals[v] = sum;
+	}
+}
+
+
+// Compute per-vertex normals
+void TriMesh::need_normals()
+{
+	// Nothing to do if we already have normals, unless some vertices
+	// have moved since
+	int nv = vertices.size();
+	bool have = (int(normals.size()) == nv);
+	if (have && !(moved_stale & STALE_NORMALS))
+		return;
+
+	need_faces();
+	if (faces.empty()) {
+		done_moved(STALE_NORMALS);
+		return;
+	}
+
+	// If they have, and not too many, update just around them
+	vector<int> verts;
+	if (have && moved_region(1, verts)) {
+		update_moved_normals(this, verts);
+		done_moved(STALE_NORMALS);
+		return;
+	}
+
+	dprintf("Computing normals... ");
+	normals.clear();
+	normals.resize(nv);
+
+	int nf = faces.size();
+	for (int i = 0; i < nf; i++) {
+		vec cn[3];
+		if (!corner_normals(this, i, cn))
+			continue;
+		for (int j = 0; j < 3; j++) {
+			int vj = faces[i][j];
+			normals[vj] = normals[vj] + cn[j];
+		}
+	}
+
+	// Make them all unit-length
+	for (int i = 0; i < nv; i++)
+		normalize(normals[i]);
+	done_moved(STALE_NORMALS);
+
+	dprintf("Done.\n");
+}
@@ -0,0 +1,128 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_pointareas.cc
+Compute the area "belonging" to each vertex or each corner
+of a triangle (defined as Voronoi area restricted to the 1-ring of
+a vertex, or to the triangle).
+*/
+
+
+#include "TriMesh.h"
+#include <algorithm>
+using namespace std;
+
+
+// Compute the corner areas of face i
+static void corner_areas(TriMesh *mesh, int i)
+{
+	const TriMesh::Face &f = mesh->faces[i];
+	const vector<point> &vertices = mesh->vertices;
+	vec &ca = mesh->cornerareas[i];
+
+	// Edges
+	vec e[3] = { vertices[f[2]] - vertices[f[1]],
+		     vertices[f[0]] - vertices[f[2]],
+		     vertices[f[1]] - vertices[f[0]] };
+
+	// Compute corner weights
+	float area = 0.5f * len(e[0] CROSS e[1]);
+	float l2[3] = { len2(e[0]), len2(e[1]), len2(e[2]) };
+	float ew[3] = { l2[0] * (l2[1] + l2[2] - l2[0]),
+			l2[1] * (l2[2] + l2[0] - l2[1]),
+			l2[2] * (l2[0] + l2[1] - l2[2]) };
+	if (ew[0] <= 0.0f) {
+		ca[1] = -0.25f * l2[2] * area / (e[0] DOT e[2]);
+		ca[2] = -0.25f * l2[1] * area / (e[0] DOT e[1]);
+		ca[0] = area - ca[1] - ca[2];
+	} else if (ew[1] <= 0.0f) {
+		ca[2] = -0.25f * l2[0] * area / (e[1] DOT e[0]);
+		ca[0] = -0.25f * l2[2] * area / (e[1] DOT e[2]);
+		ca[1] = area - ca[2] - ca[0];
+	} else if (ew[2] <= 0.0f) {
+		ca[0] = -0.25f * l2[1] * area / (e[2] DOT e[1]);
+		ca[1] = -0.25f * l2[0] * area / (e[2] DOT e[0]);
+		ca[2] = area - ca[0] - ca[1];
+	} else {
+		float ewscale = 0.5f * area / (ew[0] + ew[1] + ew[2]);
+		for (int j = 0; j < 3; j++)
+			ca[j] = ewscale * (ew[(j+1)%3] + ew[(j+2)%3]);
+	}
+}
+
+
+// Recompute the corner areas of the faces touching the moved vertices,
+// and the point areas of the vertices around them
+static void update_moved_pointareas(TriMesh *mesh, const vector<int> &moved,
+				    const vector<int> &verts)
+{
+	vector<int> moved_faces;
+	for (size_t k = 0; k < moved.size(); k++) {
+		TriMesh::AdjList af = mesh->adjacentfaces[moved[k]];
+		moved_faces.insert(moved_faces.end(), af.begin(), af.end());
+	}
+	sort(moved_faces.begin(), moved_faces.end());
+	moved_faces.erase(unique(moved_faces.begin(), moved_faces.end()),
+			  moved_faces.end());
+	int nf = moved_faces.size();
+#pragma omp parallel for
+	for (int k = 0; k < nf; k++)
+		corner_areas(mesh, moved_faces[k]);
+
+	int n = verts.size();
+#pragma omp parallel for
+	for (int k = 0; k < n; k++) {
+		int v = verts[k];
+		TriMesh::AdjList af = mesh->adjacentfaces[v];
+		float sum = 0.0f;
+		for (int l = 0; l < af.size(); l++) {
+			int i = af[l];
+			if (l > 0 && af[l-1] == i)
+				continue;
+			for (int j = 0; j < 3; j++)
+				if (mesh->faces[i][j] == v)
+					sum += mesh->cornerareas[i][j];
+		}
+		mesh->pointareas[v] = sum;
+	}
+}
+
+
+// Compute per-vertex point areas
+void TriMesh::need_pointareas()
+{
+	int nv = vertices.size();
+	bool have = (int(pointareas.size()) == nv);
+	if (have && !(moved_stale & STALE_POINTAREAS))
+		return;
+	need_faces();
+
+	// If vertices have moved since, and not too many, update just
+	// around them
+	vector<int> moved_verts, verts;
+	if (have && !faces.empty() && cornerareas.size() == faces.size() &&
+	    moved_region(0, moved_verts) && moved_region(1, verts)) {
+		update_moved_pointareas(this, moved_verts, verts);
+		done_moved(STALE_POINTAREAS);
+		return;
+	}
+
+	dprintf("Computing point areas... ");
+
+	int nf = faces.size();
+	pointareas.clear();
+	pointareas.resize(nv);
+	cornerareas.clear();
+	cornerareas.resize(nf);
+
+	for (int i = 0; i < nf; i++) {
+		corner_areas(this, i);
+		pointareas[faces[i][0]] += cornerareas[i][0];
+		pointareas[faces[i][1]] += cornerareas[i][1];
+		pointareas[faces[i][2]] += cornerareas[i][2];
+	}
+	done_moved(STALE_POINTAREAS);
+
+	dprintf("Done.\n");
+}
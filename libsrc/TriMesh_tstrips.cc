@@ -0,0 +1,211 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_tstrips.cc
+Code for dealing with triangle strips
+*/
+
+
+#include "TriMesh.h"
+using namespace std;
+
+
+// Third vertex of face f, given the other two
+static inline int third_vert(const TriMesh::Face &f, int a, int b)
+{
+	return (f[0] != a && f[0] != b) ? f[0] :
+	       (f[1] != a && f[1] != b) ? f[1] : f[2];
+}
+
+
+// Build a single strip, starting at face f, and append it (preceded by
+// its length) to mesh.tstrips.  The strip is grown greedily across the
+// edge formed by its last two vertices, for as long as the face there
+// is available and consistently oriented.
+static void tstrip_build(TriMesh &mesh, int f, vector<bool> &done)
+{
+	const TriMesh::Face &start = mesh.faces[f];
+
+	// Start along the edge that has an available neighbor, if any:
+	// the strip (v[j], v[j+1], v[j+2]) continues across the edge
+	// opposite v[j]
+	int j0 = 0;
+	for (int j = 0; j < 3; j++) {
+		int n = mesh.across_edge[f][j];
+		if (n >= 0 && !done[n]) {
+			j0 = j;
+			break;
+		}
+	}
+
+	vector<int> &t = mesh.tstrips;
+	size_t lenpos = t.size();
+	t.push_back(0);
+	t.push_back(start[j0]);
+	t.push_back(start[(j0+1)%3]);
+	t.push_back(start[(j0+2)%3]);
+	done[f] = true;
+
+	int len = 3, last = f;
+	while (1) {
+		int a = t[t.size()-2], b = t[t.size()-1];
+		int opp = mesh.faces[last].indexof(third_vert(mesh.faces[last], a, b));
+		int next = mesh.across_edge[last][opp];
+		if (next < 0 || done[next])
+			break;
+
+		// Faces alternate orientation along a strip: the new face
+		// is (a,b,c) if it's even-numbered, (b,a,c) if odd
+		const TriMesh::Face &nf = mesh.faces[next];
+		bool even = ((len - 2) % 2 == 0);
+		int first = even ? a : b, second = even ? b : a;
+		int ind = nf.indexof(first);
+		if (ind < 0 || nf[(ind+1)%3] != second)
+			break;
+
+		t.push_back(third_vert(nf, a, b));
+		done[next] = true;
+		last = next;
+		len++;
+	}
+	t[lenpos] = len;
+}
+
+
+// Convert faces to tstrips
+void TriMesh::need_tstrips()
+{
+	if (!tstrips.empty())
+		return;
+	need_faces();
+	if (faces.empty())
+		return;
+	need_across_edge();
+
+	dprintf("Building triangle strips... ");
+
+	int nf = faces.size();
+	vector<bool> done(nf, false);
+	int nstrips = 0;
+	for (int i = 0; i < nf; i++) {
+		if (done[i])
+			continue;
+		tstrip_build(*this, i, done);
+		nstrips++;
+	}
+
+	dprintf("Done.\n  %d triangles, %d strips\n", nf, nstrips);
+}
+
+
+// Convert between "length preceding strip" and "-1 following strip"
+// representations
+void TriMesh::convert_strips(TstripRep rep)
+{
+	if (tstrips.empty())
+		return;
+	if (rep == TSTRIP_TERM && tstrips.back() == -1)
+		return;
+	if (rep == TSTRIP_LENGTH && tstrips.back() != -1)
+		return;
+
+	if (rep == TSTRIP_TERM) {
+		int len = tstrips[0];
+		for (size_t i = 1; i < tstrips.size(); i++) {
+			if (len) {
+				tstrips[i-1] = tstrips[i];
+				len--;
+			} else {
+				tstrips[i-1] = -1;
+				len = tstrips[i];
+			}
+		}
+		tstrips.back() = -1;
+	} else {
+		int len = 0;
+		for (int i = int(tstrips.size()) - 2; i >= 0; i--) {
+			if (tstrips[i] == -1) {
+				tstrips[i+1] = len;
+				len = 0;
+			} else {
+				tstrips[i+1] = tstrips[i];
+				len++;
+			}
+		}
+		tstrips[0] = len;
+	}
+}
+
+
+// Unpack triangle strips into faces
+void TriMesh::unpack_tstrips()
+{
+	if (tstrips.empty() || !faces.empty())
+		return;
+
+	dprintf("Unpacking triangle strips... ");
+
+	const int *t = &tstrips[0];
+	const int *end = t + tstrips.size();
+	while (t < end) {
+		int striplen = *t++;
+		for (int i = 2; i < striplen; i++) {
+			if (i & 1)
+				faces.push_back(Face(t[i-1], t[i-2], t[i]));
+			else
+				faces.push_back(Face(t[i-2], t[i-1], t[i]));
+		}
+		t += striplen;
+	}
+
+	dprintf("Done.\n  %d triangles\n", int(faces.size()));
+}
+
+
+// Triangulate a range grid
+void TriMesh::triangulate_grid()
+{
+	int nv = vertices.size();
+	int ngrid = grid_width * grid_height;
+	if (grid_width <= 0 || grid_height <= 0 || int(grid.size()) != ngrid)
+		return;
+
+	dprintf("Triangulating... ");
+
+	for (int i = 0; i < ngrid; i++)
+		if (grid[i] < 0 || grid[i] >= nv)
+			grid[i] = GRID_INVALID;
+
+	for (int j = 0; j < grid_height - 1; j++) {
+		for (int i = 0; i < grid_width - 1; i++) {
+			int ll = grid[i + j * grid_width];
+			int lr = grid[i+1 + j * grid_width];
+			int ul = grid[i + (j+1) * grid_width];
+			int ur = grid[i+1 + (j+1) * grid_width];
+			int nvalid = (ll >= 0) + (lr >= 0) + (ul >= 0) + (ur >= 0);
+			if (nvalid == 4) {
+				// Split along the shorter diagonal
+				if (dist2(vertices[ll], vertices[ur]) <
+				    dist2(vertices[lr], vertices[ul])) {
+					faces.push_back(Face(ll, lr, ur));
+					faces.push_back(Face(ll, ur, ul));
+				} else {
+					faces.push_back(Face(ll, lr, ul));
+					faces.push_back(Face(lr, ur, ul));
+				}
+			} else if (nvalid == 3) {
+				if (ll < 0)
+					faces.push_back(Face(lr, ur, ul));
+				else if (lr < 0)
+					faces.push_back(Face(ll, ur, ul));
+				else if (ul < 0)
+					faces.push_back(Face(ll, lr, ur));
+				else
+					faces.push_back(Face(ll, lr, ul));
+			}
+		}
+	}
+
+	dprintf("Done.\n  %d triangles\n", int(faces.size()));
+}
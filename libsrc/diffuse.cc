@@ -0,0 +1,362 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+diffuse.cc
+Smoothing of meshes and of fields on them (normals, curvature, dcurv)
+by convolution with a Gaussian over the surface.
+
+Each vertex gathers from the connected patch of vertices around it
+whose normals face the same way and that lie within 3 sigma, weighting
+each by a Gaussian of its distance, its point area and the agreement
+of the normals.
+
+The vertices are done in parallel, in chunks, each thread walking the
+patches with its own scratch space.  Every vertex is computed the same
+way whatever thread does it, and results are written in vertex order,
+so they don't depend on the number of threads.  With a progress hook
+(see set_diffuse_progress_hook), the chunks are run in batches, and
+between batches, outside the parallel region, the calling thread reports
+progress and finds out whether to stop; if it is told to, the mesh is
+left as it was.
+*/
+
+
+#include <stdio.h>
+#include <algorithm>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+using namespace std;
+
+// Vertices per chunk of the parallel loop
+#define DIFFUSE_CHUNK 256
+
+// With a progress hook, a pass is split into about this many batches of
+// chunks, with the hook called after each
+#define DIFFUSE_BATCHES 50
+
+
+// Called with the fraction of the work done, if not NULL
+static bool (*diffuse_progress_hook)(float done) = NULL;
+
+void set_diffuse_progress_hook(bool (*hook)(float done))
+{
+	diffuse_progress_hook = hook;
+}
+
+
+// Which thread of the current parallel region this is
+static inline int thread_num()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+// How many threads a parallel region can have
+static inline int max_threads()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+// Scratch space for one thread's walks over the patches
+struct DiffuseScratch {
+	vector<unsigned> flags;
+	unsigned flag;
+	vector<int> boundary;
+	DiffuseScratch() : flag(0) {}
+};
+
+
+// Approximation to Gaussian...  Used in filtering
+static inline float wt(const point &p1, const point &p2, float invsigma2)
+{
+	float d2 = invsigma2 * dist2(p1, p2);
+	return (d2 >= 9.0f) ? 0.0f : exp(-0.5f * d2);
+}
+
+
+// Functors for adding up per-vertex fields of various sorts: each adds
+// w times the value at vertex i, expressed as needed at vertex v.  (Not
+// with +=, which is an atomic update per component under OpenMP.)
+template <class T>
+struct AccumVec {
+	const vector<T> &field;
+	AccumVec(const vector<T> &field_) : field(field_) {}
+	void operator () (const TriMesh *, int, T &sum, float w, int i)
+	{
+		sum = sum + w * field[i];
+	}
+};
+
+struct AccumCurv {
+	void operator () (const TriMesh *themesh, int v, vec &sum,
+			  float w, int i)
+	{
+		vec ncurv;
+		proj_curv(themesh->pdir1[i], themesh->pdir2[i],
+			  themesh->curv1[i], 0, themesh->curv2[i],
+			  themesh->pdir1[v], themesh->pdir2[v],
+			  ncurv[0], ncurv[1], ncurv[2]);
+		sum = sum + w * ncurv;
+	}
+};
+
+struct AccumDCurv {
+	void operator () (const TriMesh *themesh, int v, Vec<4> &sum,
+			  float w, int i)
+	{
+		Vec<4> ndcurv;
+		proj_dcurv(themesh->pdir1[i], themesh->pdir2[i],
+			   themesh->dcurv[i],
+			   themesh->pdir1[v], themesh->pdir2[v],
+			   ndcurv);
+		sum = sum + w * ndcurv;
+	}
+};
+
+
+// Diffuse a field at one vertex, weighted by a Gaussian of width
+// 1/sqrt(invsigma2).  flags and flag are used to mark the vertices
+// already visited.
+template <class ACCUM, class T>
+static void diffuse_vert_field(const TriMesh *themesh, ACCUM accum, int v,
+			       float invsigma2, vector<unsigned> &flags,
+			       unsigned &flag, vector<int> &boundary, T &flt)
+{
+	flt = T();
+	if (themesh->neighbors[v].empty()) {
+		accum(themesh, v, flt, 1.0f, v);
+		return;
+	}
+
+	accum(themesh, v, flt, themesh->pointareas[v], v);
+	float sum_w = themesh->pointareas[v];
+	const vec &nv = themesh->normals[v];
+
+	flag++;
+	flags[v] = flag;
+	TriMesh::AdjList nbrs = themesh->neighbors[v];
+	boundary.assign(nbrs.begin(), nbrs.end());
+	while (!boundary.empty()) {
+		int n = boundary.back();
+		boundary.pop_back();
+		if (flags[n] == flag)
+			continue;
+		flags[n] = flag;
+		if ((nv DOT themesh->normals[n]) <= 0.0f)
+			continue;
+		// Gaussian weight
+		float w = wt(themesh->vertices[n], themesh->vertices[v],
+			     invsigma2);
+		if (w == 0.0f)
+			continue;
+		// Downweight things pointing in different directions
+		w *= nv DOT themesh->normals[n];
+		// Surface area "belonging" to each point
+		w *= themesh->pointareas[n];
+		// Accumulate weight times field at neighbor
+		accum(themesh, v, flt, w, n);
+		sum_w += w;
+		TriMesh::AdjList nn_list = themesh->neighbors[n];
+		for (int i = 0; i < nn_list.size(); i++) {
+			int nn = nn_list[i];
+			if (flags[nn] != flag)
+				boundary.push_back(nn);
+		}
+	}
+	flt = flt / sum_w;
+}
+
+
+// Diffuse a field at every vertex into result.  This is pass pass of
+// npasses that make up the call, for reporting progress.  Returns false
+// if cancelled, with result incomplete.
+template <class ACCUM, class T>
+static bool diffuse_field(TriMesh *themesh, ACCUM accum, float sigma,
+			  vector<T> &result, int pass, int npasses)
+{
+	int nv = themesh->vertices.size();
+	float invsigma2 = 1.0f / sqr(sigma);
+	result.resize(nv);
+
+	int nchunks = (nv + DIFFUSE_CHUNK - 1) / DIFFUSE_CHUNK;
+	int batch = nchunks;
+	if (diffuse_progress_hook)
+		batch = max(1, (nchunks + DIFFUSE_BATCHES - 1) / DIFFUSE_BATCHES);
+	vector<DiffuseScratch> scratch(max_threads());
+	int percent = -1;
+	for (int c0 = 0; c0 < nchunks; c0 += batch) {
+		int c1 = min(nchunks, c0 + batch);
+#pragma omp parallel for schedule(dynamic)
+		for (int c = c0; c < c1; c++) {
+			DiffuseScratch &s = scratch[thread_num()];
+			if (s.flags.empty())
+				s.flags.resize(nv);
+			int end = min(nv, (c + 1) * DIFFUSE_CHUNK);
+			for (int i = c * DIFFUSE_CHUNK; i < end; i++)
+				diffuse_vert_field(themesh, accum, i, invsigma2,
+						   s.flags, s.flag, s.boundary,
+						   result[i]);
+		}
+
+		// No other thread is running now, so the hook may let the
+		// program look at the mesh.  Only called when the percentage
+		// changes.
+		if (!diffuse_progress_hook)
+			continue;
+		float frac = (pass + float(c1) / nchunks) / npasses;
+		if (int(100.0f * frac) == percent)
+			continue;
+		percent = int(100.0f * frac);
+		if (!diffuse_progress_hook(frac))
+			return false;
+	}
+	return true;
+}
+
+
+// Diffuse the normals across the mesh, as pass pass of npasses
+static bool diffuse_normals(TriMesh *themesh, float sigma,
+			    int pass, int npasses)
+{
+	themesh->need_normals();
+	themesh->need_pointareas();
+	themesh->need_neighbors();
+	int nv = themesh->vertices.size();
+
+	TriMesh::dprintf("\rSmoothing normals... ");
+	timestamp t = now();
+
+	vector<vec> nflt;
+	if (!diffuse_field(themesh, AccumVec<vec>(themesh->normals), sigma,
+			   nflt, pass, npasses)) {
+		TriMesh::dprintf("Cancelled.\n");
+		return false;
+	}
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		normalize(nflt[i]);
+	themesh->normals.swap(nflt);
+
+	TriMesh::dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	return true;
+}
+
+
+// Smooth the mesh geometry.  The Gaussian-smoothed surface G*v shrinks,
+// so move each vertex to 2 G*v - G*G*v instead, which undoes most of
+// that: with d = G*v - v, this is v + d - G*d.
+bool smooth_mesh(TriMesh *themesh, float sigma)
+{
+	themesh->need_faces();
+	themesh->need_normals();
+	vector<vec> normals = themesh->normals;
+	if (!diffuse_normals(themesh, 0.5f * sigma, 0, 3))
+		return false;
+	themesh->need_neighbors();
+	int nv = themesh->vertices.size();
+
+	TriMesh::dprintf("\rSmoothing... ");
+	timestamp t = now();
+
+	// Displacement towards the smoothed surface, and its smoothed version
+	vector<point> dflt, dflt2;
+	bool ok = diffuse_field(themesh, AccumVec<point>(themesh->vertices),
+				sigma, dflt, 1, 3);
+	if (ok) {
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++)
+			dflt[i] = dflt[i] - themesh->vertices[i];
+		ok = diffuse_field(themesh, AccumVec<point>(dflt), sigma,
+				   dflt2, 2, 3);
+	}
+	if (!ok) {
+		themesh->normals.swap(normals);
+		TriMesh::dprintf("Cancelled.\n");
+		return false;
+	}
+
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		themesh->vertices[i] = themesh->vertices[i] +
+				       (dflt[i] - dflt2[i]);
+
+	themesh->bbox.valid = false;
+	themesh->bsphere.valid = false;
+	TriMesh::dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	return true;
+}
+
+
+// Diffuse the normals across the mesh
+bool diffuse_normals(TriMesh *themesh, float sigma)
+{
+	return diffuse_normals(themesh, sigma, 0, 1);
+}
+
+
+// Diffuse the curvatures across the mesh
+bool diffuse_curv(TriMesh *themesh, float sigma)
+{
+	themesh->need_normals();
+	themesh->need_pointareas();
+	themesh->need_curvatures();
+	themesh->need_neighbors();
+	int nv = themesh->vertices.size();
+
+	TriMesh::dprintf("\rSmoothing curvatures... ");
+	timestamp t = now();
+
+	vector<vec> cflt;
+	if (!diffuse_field(themesh, AccumCurv(), sigma, cflt, 0, 1)) {
+		TriMesh::dprintf("Cancelled.\n");
+		return false;
+	}
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		diagonalize_curv(themesh->pdir1[i], themesh->pdir2[i],
+				 cflt[i][0], cflt[i][1], cflt[i][2],
+				 themesh->normals[i],
+				 themesh->pdir1[i], themesh->pdir2[i],
+				 themesh->curv1[i], themesh->curv2[i]);
+
+	TriMesh::dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	return true;
+}
+
+
+// Diffuse the curvature derivatives across the mesh
+bool diffuse_dcurv(TriMesh *themesh, float sigma)
+{
+	themesh->need_normals();
+	themesh->need_pointareas();
+	themesh->need_curvatures();
+	themesh->need_dcurv();
+	themesh->need_neighbors();
+
+	TriMesh::dprintf("\rSmoothing curvature derivatives... ");
+	timestamp t = now();
+
+	vector< Vec<4> > dflt;
+	if (!diffuse_field(themesh, AccumDCurv(), sigma, dflt, 0, 1)) {
+		TriMesh::dprintf("Cancelled.\n");
+		return false;
+	}
+	themesh->dcurv.swap(dflt);
+
+	TriMesh::dprintf("Done.  Filtering took %f sec.\n", now() - t);
+	return true;
+}
@@ -0,0 +1,344 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+reorder_verts.cc
+Renumber the vertices and faces of a mesh, carrying every per-vertex and
+per-face property along.
+
+reorder_mesh_locality() puts vertices close together in space close
+together in memory, by sorting them along a Morton (Z-order) curve
+through the bounding box.  Triangle strips are then grown through the
+faces in that order, the faces are put in the order the strips visit
+them, and the vertices are renumbered once more in the order the strips
+use them.  Loops over vertices or faces then walk through memory in
+order while touching neighboring data that is mostly already in the
+cache.  Following the strips, rather than just sorting the faces along
+the curve, also keeps the faces around each vertex in much the same
+order from one vertex to the next, which the branches in per-vertex
+loops such as compute_Dt1q1 depend on nearly as much as on the cache.
+*/
+
+
+#include <stdio.h>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include <algorithm>
+using namespace std;
+
+
+// Permute a per-element array: the new element i is the old element
+// order[i]
+template <class T>
+static void permute(vector<T> &v, const vector<int> &order)
+{
+	if (v.empty())
+		return;
+	vector<T> tmp(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+		tmp[i] = v[order[i]];
+	v.swap(tmp);
+}
+
+
+// Remap vertices according to the given table: vertex i becomes vertex
+// remap_table[i], or is deleted if that is -1.  Faces using a deleted
+// vertex are deleted too.
+void remap_verts(TriMesh *mesh, const vector<int> &remap_table)
+{
+	int nv = mesh->vertices.size();
+	if (int(remap_table.size()) != nv) {
+		TriMesh::eprintf("remap_verts called with wrong table size!\n");
+		return;
+	}
+
+	// The new vertex numbered n is the old vertex order[n]
+	int newnv = 0;
+	for (int i = 0; i < nv; i++)
+		newnv = max(newnv, remap_table[i] + 1);
+	vector<int> order(newnv, -1);
+	for (int i = 0; i < nv; i++)
+		if (remap_table[i] >= 0)
+			order[remap_table[i]] = i;
+	for (int i = 0; i < newnv; i++) {
+		if (order[i] < 0) {
+			TriMesh::eprintf("remap_verts called with a table "
+					 "that leaves holes!\n");
+			return;
+		}
+	}
+	bool deleting = (newnv != nv);
+	if (deleting)
+		mesh->need_faces();
+
+	permute(mesh->vertices, order);
+	permute(mesh->colors, order);
+	permute(mesh->confidences, order);
+	permute(mesh->flags, order);
+	permute(mesh->normals, order);
+	permute(mesh->pdir1, order);
+	permute(mesh->pdir2, order);
+	permute(mesh->curv1, order);
+	permute(mesh->curv2, order);
+	permute(mesh->dcurv, order);
+	permute(mesh->pointareas, order);
+	permute(mesh->tracked_vertices, order);
+	int nmoved = 0;
+	for (size_t i = 0; i < mesh->moved.size(); i++) {
+		int v = remap_table[mesh->moved[i]];
+		if (v >= 0)
+			mesh->moved[nmoved++] = v;
+	}
+	mesh->moved.resize(nmoved);
+
+	// Faces, dropping any that lost a vertex
+	int nf = mesh->faces.size(), newnf = 0;
+	for (int i = 0; i < nf; i++) {
+		TriMesh::Face f = mesh->faces[i];
+		for (int j = 0; j < 3; j++)
+			f[j] = remap_table[f[j]];
+		if (f[0] < 0 || f[1] < 0 || f[2] < 0)
+			continue;
+		mesh->faces[newnf++] = f;
+	}
+	mesh->faces.resize(newnf);
+	if (newnf != nf) {
+		mesh->cornerareas.clear();
+		mesh->across_edge.clear();
+	}
+
+	// Strips only survive if nothing was deleted
+	if (deleting) {
+		mesh->tstrips.clear();
+	} else {
+		mesh->convert_strips(TriMesh::TSTRIP_TERM);
+		for (size_t i = 0; i < mesh->tstrips.size(); i++)
+			if (mesh->tstrips[i] >= 0)
+				mesh->tstrips[i] = remap_table[mesh->tstrips[i]];
+		mesh->convert_strips(TriMesh::TSTRIP_LENGTH);
+	}
+
+	for (size_t i = 0; i < mesh->grid.size(); i++)
+		if (mesh->grid[i] >= 0)
+			mesh->grid[i] = remap_table[mesh->grid[i]];
+
+	mesh->neighbors.clear();
+	mesh->adjacentfaces.clear();
+	if (deleting) {
+		mesh->bbox.valid = false;
+		mesh->bsphere.valid = false;
+	}
+}
+
+
+// Number the vertices in the order in which they are referenced by the
+// tstrips or faces, with unreferenced ones at the end
+static void first_use_order(TriMesh *mesh, vector<int> &remap)
+{
+	int nv = mesh->vertices.size();
+	remap.assign(nv, -1);
+	int next = 0;
+	if (!mesh->tstrips.empty()) {
+		mesh->convert_strips(TriMesh::TSTRIP_TERM);
+		for (size_t i = 0; i < mesh->tstrips.size(); i++) {
+			int v = mesh->tstrips[i];
+			if (v >= 0 && remap[v] < 0)
+				remap[v] = next++;
+		}
+	} else {
+		for (size_t i = 0; i < mesh->faces.size(); i++) {
+			for (int j = 0; j < 3; j++) {
+				int v = mesh->faces[i][j];
+				if (remap[v] < 0)
+					remap[v] = next++;
+			}
+		}
+	}
+	for (int i = 0; i < nv; i++)
+		if (remap[i] < 0)
+			remap[i] = next++;
+}
+
+
+// Reorder vertices in a mesh according to the order in which
+// they are referenced by the tstrips or faces.
+void reorder_verts(TriMesh *mesh)
+{
+	TriMesh::dprintf("Reordering vertices... ");
+	vector<int> remap;
+	first_use_order(mesh, remap);
+	remap_verts(mesh, remap);
+	TriMesh::dprintf("Done.\n");
+}
+
+
+// Spread the low 10 bits of x out to every third bit
+static inline unsigned spread_bits(unsigned x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x <<  8)) & 0x0300f00f;
+	x = (x | (x <<  4)) & 0x030c30c3;
+	x = (x | (x <<  2)) & 0x09249249;
+	return x;
+}
+
+
+// Position of p along a Morton curve through the box, with 10 bits per axis
+static inline unsigned morton_code(const point &p, const point &lo,
+				   const vec &scale)
+{
+	unsigned c[3];
+	for (int k = 0; k < 3; k++) {
+		float x = (p[k] - lo[k]) * scale[k];
+		c[k] = (unsigned) min(max(x, 0.0f), 1023.0f);
+	}
+	return spread_bits(c[0]) | (spread_bits(c[1]) << 1) |
+	       (spread_bits(c[2]) << 2);
+}
+
+
+// The face with corners a, b and c (in any order) not yet marked used
+static int find_face(const TriMesh *mesh, int a, int b, int c,
+		     const vector<bool> &used)
+{
+	TriMesh::AdjList af = mesh->adjacentfaces[a];
+	for (int k = 0; k < af.size(); k++) {
+		int f = af[k];
+		if (used[f])
+			continue;
+		const TriMesh::Face &face = mesh->faces[f];
+		if (face.indexof(b) >= 0 && face.indexof(c) >= 0)
+			return f;
+	}
+	return -1;
+}
+
+
+// The faces in the order the triangle strips visit them, followed by
+// any the strips missed.  first is set to the corner of each face that
+// comes first in its strip.
+static void strip_face_order(TriMesh *mesh, vector<int> &order,
+			     vector<int> &first)
+{
+	int nf = mesh->faces.size();
+	mesh->convert_strips(TriMesh::TSTRIP_LENGTH);
+	mesh->need_adjacentfaces();
+	vector<bool> used(nf);
+	order.clear();
+	order.reserve(nf);
+	first.assign(nf, 0);
+
+	const int *t = mesh->tstrips.empty() ? 0 : &mesh->tstrips[0];
+	const int *end = t + mesh->tstrips.size();
+	while (t < end) {
+		int striplen = *t++;
+		for (int i = 2; i < striplen; i++) {
+			int f = find_face(mesh, t[i-2], t[i-1], t[i], used);
+			if (f < 0)
+				continue;
+			used[f] = true;
+			order.push_back(f);
+			// Odd faces are flipped, as in unpack_tstrips
+			int a = (i & 1) ? t[i-1] : t[i-2];
+			first[f] = mesh->faces[f].indexof(a);
+		}
+		t += striplen;
+	}
+	for (int i = 0; i < nf; i++)
+		if (!used[i])
+			order.push_back(i);
+}
+
+
+// Rotate the corners of each face (and its corner areas) so that corner
+// first[i] of face i comes first
+static void rotate_faces(TriMesh *mesh, const vector<int> &first)
+{
+	int nf = mesh->faces.size();
+	bool have_cornerareas = (int(mesh->cornerareas.size()) == nf);
+	for (int i = 0; i < nf; i++) {
+		int j = first[i];
+		if (!j)
+			continue;
+		TriMesh::Face &f = mesh->faces[i];
+		f = TriMesh::Face(f[j], f[(j+1)%3], f[(j+2)%3]);
+		if (have_cornerareas) {
+			vec &c = mesh->cornerareas[i];
+			c = vec(c[j], c[(j+1)%3], c[(j+2)%3]);
+		}
+	}
+}
+
+
+// Renumber vertices and faces so that ones that are close together on
+// the mesh are close together in memory.  The triangle strips are
+// rebuilt along the way, and connectivity is cleared.
+// If remap is given, it is set to the new number of each old vertex.
+void reorder_mesh_locality(TriMesh *mesh, vector<int> *remap)
+{
+	mesh->need_faces();
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	if (!nv)
+		return;
+
+	TriMesh::dprintf("Reordering mesh for locality... ");
+	mesh->tstrips.clear();
+	mesh->across_edge.clear();
+
+	// Vertices along a Morton curve, ties broken by the old order
+	mesh->need_bbox();
+	point lo = mesh->bbox.min;
+	vec scale = mesh->bbox.size();
+	for (int k = 0; k < 3; k++)
+		scale[k] = (scale[k] > 0.0f) ? 1024.0f / scale[k] : 0.0f;
+	vector< pair<unsigned, int> > vkeys(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		vkeys[i] = make_pair(morton_code(mesh->vertices[i], lo, scale), i);
+	sort(vkeys.begin(), vkeys.end());
+	vector<int> curve_remap(nv);
+	for (int i = 0; i < nv; i++)
+		curve_remap[vkeys[i].second] = i;
+	remap_verts(mesh, curve_remap);
+
+	// Faces in order of their lowest-numbered vertex, so that the strips
+	// start near the beginning of the curve and grow along it...
+	vector< pair<int, int> > fkeys(nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		fkeys[i] = make_pair(min(min(f[0], f[1]), f[2]), i);
+	}
+	sort(fkeys.begin(), fkeys.end());
+	vector<int> order(nf);
+	for (int i = 0; i < nf; i++)
+		order[i] = fkeys[i].second;
+	permute(mesh->faces, order);
+	permute(mesh->cornerareas, order);
+	mesh->adjacentfaces.clear();
+
+	// ... then in the order the strips visit them, each starting at the
+	// corner its strip does
+	mesh->need_tstrips();
+	vector<int> first;
+	strip_face_order(mesh, order, first);
+	rotate_faces(mesh, first);
+	permute(mesh->faces, order);
+	permute(mesh->cornerareas, order);
+	mesh->adjacentfaces.clear();
+	mesh->across_edge.clear();
+
+	// ... and the vertices once more, in the order the strips use them
+	vector<int> use_remap;
+	first_use_order(mesh, use_remap);
+	remap_verts(mesh, use_remap);
+
+	if (remap) {
+		remap->resize(nv);
+		for (int i = 0; i < nv; i++)
+			(*remap)[i] = use_remap[curve_remap[i]];
+	}
+
+	TriMesh::dprintf("Done.\n");
+}
@@ -0,0 +1,168 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+subdiv.cc
+One iteration of planar or Loop subdivision.  Each face is split into
+four, with a new vertex on every edge.  Boundary edges and vertices use
+the usual cubic B-spline curve rules.
+*/
+
+
+#include <stdio.h>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+using namespace std;
+
+
+// The weight given to the neighbors of an interior vertex of valence n
+static inline float loop_beta(int scheme, int n)
+{
+	if (scheme == SUBDIV_LOOP_ORIG) {
+		float c = 0.375f + 0.25f * cos(float(2.0 * M_PI) / n);
+		return (0.625f - sqr(c)) / n;
+	}
+	// Warren's simplified weights
+	return (n == 3) ? 0.1875f : 0.375f / n;
+}
+
+
+// Position of the new vertex on edge j (the one opposite corner j) of face i
+static point edge_point(const TriMesh *mesh, int scheme, int i, int j)
+{
+	const TriMesh::Face &f = mesh->faces[i];
+	const point &v1 = mesh->vertices[f[(j+1)%3]];
+	const point &v2 = mesh->vertices[f[(j+2)%3]];
+	int ae = mesh->across_edge[i][j];
+	if (scheme == SUBDIV_PLANAR || ae < 0)
+		return 0.5f * (v1 + v2);
+
+	const TriMesh::Face &g = mesh->faces[ae];
+	int k = (g.indexof(f[(j+1)%3]) + 1) % 3;
+	const point &o1 = mesh->vertices[f[j]];
+	const point &o2 = mesh->vertices[g[k]];
+	return 0.375f * (v1 + v2) + 0.125f * (o1 + o2);
+}
+
+
+// Perform one iteration of subdivision on a mesh
+void subdiv(TriMesh *mesh, int scheme)
+{
+	if (scheme == SUBDIV_BUTTERFLY || scheme == SUBDIV_BUTTERFLY_MODIFIED) {
+		TriMesh::eprintf("Butterfly subdivision not supported - "
+				 "using Loop\n");
+		scheme = SUBDIV_LOOP;
+	}
+
+	mesh->need_faces();
+	mesh->tstrips.clear();
+	mesh->grid.clear();
+	mesh->grid_width = mesh->grid_height = -1;
+	mesh->need_across_edge();
+	if (scheme != SUBDIV_PLANAR)
+		mesh->need_neighbors();
+
+	TriMesh::dprintf("Subdividing mesh... ");
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	bool have_colors = (int(mesh->colors.size()) == nv);
+
+	// Number the new edge vertices, sharing each between the two
+	// faces on either side of its edge, and place them
+	vector<TriMesh::Face> newverts(nf, TriMesh::Face(-1,-1,-1));
+	vector<point> verts(nv);
+	vector<Color> colors(have_colors ? nv : 0);
+	verts.reserve(nv + 3 * nf / 2 + 1);
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (newverts[i][j] >= 0)
+				continue;
+			int v1 = mesh->faces[i][(j+1)%3];
+			int v2 = mesh->faces[i][(j+2)%3];
+			newverts[i][j] = verts.size();
+			int ae = mesh->across_edge[i][j];
+			if (ae >= 0) {
+				int k = (mesh->faces[ae].indexof(v1) + 1) % 3;
+				newverts[ae][k] = verts.size();
+			}
+			verts.push_back(edge_point(mesh, scheme, i, j));
+			if (have_colors)
+				colors.push_back(0.5f * (mesh->colors[v1] +
+							 mesh->colors[v2]));
+		}
+	}
+
+	// ... and of the old ones
+	if (scheme == SUBDIV_PLANAR) {
+		copy(mesh->vertices.begin(), mesh->vertices.end(), verts.begin());
+	} else {
+		// Boundary vertices only see their two boundary neighbors
+		vector<int> nbdy(nv);
+		vector<point> bdysum(nv);
+		for (int i = 0; i < nf; i++) {
+			for (int j = 0; j < 3; j++) {
+				if (mesh->across_edge[i][j] >= 0)
+					continue;
+				int v1 = mesh->faces[i][(j+1)%3];
+				int v2 = mesh->faces[i][(j+2)%3];
+				nbdy[v1]++;  bdysum[v1] += mesh->vertices[v2];
+				nbdy[v2]++;  bdysum[v2] += mesh->vertices[v1];
+			}
+		}
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++) {
+			const point &p = mesh->vertices[i];
+			TriMesh::AdjList nbrs = mesh->neighbors[i];
+			int n = nbrs.size();
+			if (nbdy[i] == 2) {
+				verts[i] = 0.75f * p + 0.125f * bdysum[i];
+			} else if (nbdy[i] || n < 3) {
+				// Corner or non-manifold: leave it alone
+				verts[i] = p;
+			} else {
+				point sum;
+				for (int k = 0; k < n; k++)
+					sum += mesh->vertices[nbrs[k]];
+				float beta = loop_beta(scheme, n);
+				verts[i] = (1.0f - n * beta) * p + beta * sum;
+			}
+		}
+	}
+	if (have_colors)
+		copy(mesh->colors.begin(), mesh->colors.end(), colors.begin());
+
+	// Each face becomes three corner faces and a middle one
+	vector<TriMesh::Face> faces(4 * nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		const TriMesh::Face &e = newverts[i];
+		faces[4*i  ] = TriMesh::Face(f[0], e[2], e[1]);
+		faces[4*i+1] = TriMesh::Face(f[1], e[0], e[2]);
+		faces[4*i+2] = TriMesh::Face(f[2], e[1], e[0]);
+		faces[4*i+3] = TriMesh::Face(e[0], e[1], e[2]);
+	}
+
+	mesh->vertices.swap(verts);
+	mesh->colors.swap(colors);
+	mesh->faces.swap(faces);
+
+	// Everything else is out of date
+	mesh->confidences.clear();
+	mesh->flags.clear();
+	mesh->normals.clear();
+	mesh->pdir1.clear();
+	mesh->pdir2.clear();
+	mesh->curv1.clear();
+	mesh->curv2.clear();
+	mesh->dcurv.clear();
+	mesh->pointareas.clear();
+	mesh->cornerareas.clear();
+	mesh->neighbors.clear();
+	mesh->adjacentfaces.clear();
+	mesh->across_edge.clear();
+	mesh->clear_moved();
+	mesh->bbox.valid = false;
+	mesh->bsphere.valid = false;
+
+	TriMesh::dprintf("Done.\n");
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# The parts of the TriMesh library (trimesh2) that the line drawing
+# code uses, built from source: mesh I/O, connectivity, normals,
+# curvatures, smoothing, subdivision and reordering.  Include this
+# from a .pro file.
+#-------------------------------------------------
+
+SOURCES += \
+    $$PWD/TriMesh_io.cc \
+    $$PWD/TriMesh_connectivity.cc \
+    $$PWD/TriMesh_bounding.cc \
+    $$PWD/TriMesh_normals.cc \
+    $$PWD/TriMesh_pointareas.cc \
+    $$PWD/TriMesh_curvature.cc \
+    $$PWD/TriMesh_moved.cc \
+    $$PWD/TriMesh_tstrips.cc \
+    $$PWD/TriMesh_stats.cc \
+    $$PWD/diffuse.cc \
+    $$PWD/subdiv.cc \
+    $$PWD/reorder_verts.cc
+
+INCLUDEPATH += $$PWD/../include
@@ -0,0 +1,66 @@
+#-------------------------------------------------
+#
+# linedrawing-batch: headless line extraction
+#
+# Runs the rtsc line extraction (lineextractor.cpp) over a list of views
+# and writes the segments to text files.  No Qt or OpenGL needed.
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = linedrawing-batch
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+
+SOURCES += batch.cpp \
+    lineextractor.cpp \
+    perview.cpp \
+    isotree.cpp \
+    meshcache.cpp \
+    mappedfile.cpp \
+    ldmesh.cpp \
+    profiler.cpp \
+    apparentridge.cpp \
+    linestyle.cpp \
+    depthbuffer.cpp \
+    svgexport.cpp \
+    lineimage.cpp \
+    multiview.cpp \
+    outofcore.cpp
+
+HEADERS  += \
+    lineextractor.h \
+    perview.h \
+    isotree.h \
+    meshcache.h \
+    mappedfile.h \
+    ldmesh.h \
+    profiler.h \
+    linestyle.h \
+    depthbuffer.h \
+    svgexport.h \
+    lineimage.h \
+    multiview.h \
+    outofcore.h
+
+INCLUDEPATH += .\include
+
+# The SIMD and scalar perview kernels only agree bit for bit
+# if the compiler doesn't fuse multiplies and adds
+*-g++*|*clang* {
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
+
+# Per-vertex and per-face loops run in parallel with OpenMP
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+
+include(libsrc/trimesh.pri)
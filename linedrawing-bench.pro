@@ -0,0 +1,55 @@
+#-------------------------------------------------
+#
+# linedrawing-bench: timing of every stage across mesh sizes
+#
+# Times the preprocessing, compute_perview and each line family on a
+# mesh and its subdivisions, and writes the median and 99th percentile
+# of each stage as CSV and JSON.  See bench.cpp.  No Qt or OpenGL needed.
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = linedrawing-bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+
+SOURCES += bench.cpp \
+    lineextractor.cpp \
+    perview.cpp \
+    isotree.cpp \
+    meshcache.cpp \
+    mappedfile.cpp \
+    ldmesh.cpp \
+    profiler.cpp \
+    apparentridge.cpp
+
+HEADERS  += \
+    lineextractor.h \
+    perview.h \
+    isotree.h \
+    meshcache.h \
+    mappedfile.h \
+    ldmesh.h \
+    profiler.h
+
+INCLUDEPATH += .\include
+
+# The SIMD and scalar perview kernels only agree bit for bit
+# if the compiler doesn't fuse multiplies and adds
+*-g++*|*clang* {
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
+
+# Per-vertex and per-face loops run in parallel with OpenMP
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+
+include(libsrc/trimesh.pri)
@@ -0,0 +1,55 @@
+#-------------------------------------------------
+#
+# linedrawing-locality: measures the effect of reordering a mesh for
+# locality (reorder_mesh_locality) on the per-frame loops
+#
+# Reports cache misses from the hardware counters on Linux.
+# No Qt or OpenGL needed.
+#-------------------------------------------------
+
+QT       -= core gui
+
+TARGET = linedrawing-locality
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle qt
+
+
+SOURCES += locality.cpp \
+    lineextractor.cpp \
+    perview.cpp \
+    isotree.cpp \
+    meshcache.cpp \
+    mappedfile.cpp \
+    ldmesh.cpp \
+    profiler.cpp \
+    apparentridge.cpp
+
+HEADERS  += \
+    lineextractor.h \
+    perview.h \
+    isotree.h \
+    meshcache.h \
+    mappedfile.h \
+    ldmesh.h \
+    profiler.h
+
+INCLUDEPATH += .\include
+
+# The SIMD and scalar perview kernels only agree bit for bit
+# if the compiler doesn't fuse multiplies and adds
+*-g++*|*clang* {
+    QMAKE_CXXFLAGS += -ffp-contract=off
+}
+
+# Per-vertex and per-face loops run in parallel with OpenMP
+*-g++* {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32-msvc* {
+    QMAKE_CXXFLAGS += /openmp
+}
+
+
+include(libsrc/trimesh.pri)
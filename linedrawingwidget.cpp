@@ -23,6 +23,8 @@
 */
 
 #include "linedrawingwidget.h"
+#include "meshcache.h"
+#include "ldmesh.h"
 extern const int ncolor_styles = 5;
 extern const int nlighting_styles = 7;
 Mouse::button btn = Mouse::NONE;
@@ -41,6 +43,8 @@ LineDrawingWidget::LineDrawingWidget(QWidget *parent) :
     isCtrlPressed = false;
 
     themesh = NULL;
+    extractor.profiler = &profiler;
+    show_profile = false;
     init_rtsc();
 }
 
@@ -51,26 +55,15 @@ void LineDrawingWidget::init_rtsc()
     dual_vpmode = false, mouse_moves_alt = false;
     fov = 0.7f;
 
-    // Toggles for drawing various lines
-    draw_extsil = 0, draw_c = 1, draw_sc = 0;
-    draw_sh = 0, draw_phridges = 0, draw_phvalleys = 0;
-    draw_ridges = 0, draw_valleys = 0, draw_apparent = 0;
-    draw_K = 0, draw_H = 0, draw_DwKr = 0;
-    draw_bdy = 0, draw_isoph = 0, draw_topo = 0;
-    niso = 20, ntopo = 20;
-    topo_offset = 0.0f;
-
-    // Toggles for tests we perform
-    draw_hidden = 0;
-    test_c = 1, test_sc = 1, test_sh = 1, test_ph = 1, test_rv = 1, test_ar = 1;
-    sug_thresh = 0.01, sh_thresh = 0.02, ph_thresh = 0.04;
-    rv_thresh = 0.1, ar_thresh = 0.1;
+    // Lines, tests and thresholds: the rtsc defaults,
+    // but without suggestive contours
+    opts = LineOptions();
+    opts.draw_sc = 0;
+    // Tuning the thresholds only filters the lines of the view again
+    opts.threshold_sweep = 1;
 
     // Toggles for style
-    use_texture = 0;
-    draw_faded = 1;
     draw_colors = 0;
-    use_hermite = 0;
 
     // Mesh colorization
     color_style = COLOR_WHITE;
@@ -78,7 +71,6 @@ void LineDrawingWidget::init_rtsc()
 
     // Lighting
     lighting_style = LIGHTING_NONE;
-    light_wrt_camera = true;
 
     // Per-vertex vectors
     draw_norm = 0, draw_curv1 = 0, draw_curv2 = 0, draw_asymp = 0;
@@ -93,7 +85,12 @@ bool LineDrawingWidget::readMesh(const char *filename, const char* xffilename)
         themesh = NULL;
     }
 
-    themesh = TriMesh::read(filename);
+    // Loading happens outside paintGL, so it gets a frame of its own
+    profiler.begin_frame();
+    profiler.enter("read_mesh");
+    float feature_size;
+    themesh = read_mesh(filename, &feature_size);
+    profiler.leave();
     if(!themesh)
     {
         cout<<"read file "<<filename<<" error."<<endl;
@@ -101,13 +98,17 @@ bool LineDrawingWidget::readMesh(const char *filename, const char* xffilename)
     }
 //    pca_rotate(themesh);
 
-    themesh->need_tstrips();
-    themesh->need_bsphere();
-    themesh->need_normals();
-    themesh->need_curvatures();
-    themesh->need_dcurv();
-    compute_feature_size();
+    std::string cachename = mesh_cache_name(filename);
+    profiler.enter("prepare_mesh");
+    feature_size = prepare_mesh(themesh, cachename.c_str(), true,
+                                feature_size);
+    profiler.leave();
+    profiler.enter("set_mesh");
+    extractor.set_mesh(themesh, feature_size);
+    profiler.leave();
+    profiler.end_frame();
     currsmooth = 0.5f * themesh->feature_size();
+    move_tolerance = 0.0f;
 
     //xf,ʹģӿ֮
     strcpy(xfFileName, xffilename);
@@ -145,9 +146,12 @@ void LineDrawingWidget::paintGL()
         return;
     }
 
+    profiler.begin_frame();
     viewpos = inv(xf) * point(0,0,0);
 
+    profiler.enter("camera setup");
     camera.setupGL(xf * themesh->bsphere.center, themesh->bsphere.r);
+    profiler.leave();
 
     cls();
 
@@ -156,6 +160,10 @@ void LineDrawingWidget::paintGL()
     glMultMatrixd((double *)xf);
     draw_mesh();
     glPopMatrix();
+    profiler.end_frame();
+
+    if(show_profile)
+        draw_profile();
 }
 
 //꽻
@@ -255,28 +263,31 @@ void LineDrawingWidget::keyPressEvent(QKeyEvent *e)
         reset();
         break;
     case Qt::Key_A:
-        draw_apparent = !draw_apparent;
+        opts.draw_apparent = !opts.draw_apparent;
         break;
     case Qt::Key_B:
-        draw_bdy = !draw_bdy;
+        opts.draw_bdy = !opts.draw_bdy;
+        break;
+    case Qt::Key_C:
+        opts.coherent = !opts.coherent;
         break;
     case Qt::Key_Y:
         draw_colors = !draw_colors;
         break;
     case Qt::Key_W:
-        draw_c = !draw_c;
+        opts.draw_c = !opts.draw_c;
         break;
     case Qt::Key_S:
-        draw_sc = !draw_sc;
+        opts.draw_sc = !opts.draw_sc;
         break;
     case Qt::Key_E:
         draw_edges = !draw_edges;
         break;
     case Qt::Key_T:
-        draw_extsil = !draw_extsil;
+        opts.draw_extsil = !opts.draw_extsil;
         break;
     case Qt::Key_I:
-        draw_isoph = !draw_isoph;
+        opts.draw_isoph = !opts.draw_isoph;
         break;
     case Qt::Key_L:
         lighting_style++;
@@ -290,23 +301,35 @@ void LineDrawingWidget::keyPressEvent(QKeyEvent *e)
         draw_norm = !draw_norm;
         break;
     case Qt::Key_0:
-        rv_thresh /= 1.1f;
+        opts.rv_thresh /= 1.1f;
         break;
     case Qt::Key_1:
-        rv_thresh *= 1.1f;
+        opts.rv_thresh *= 1.1f;
         break;
     case Qt::Key_3:
-        sug_thresh /= 1.1f;
+        opts.sug_thresh /= 1.1f;
         break;
     case Qt::Key_4:
-        sug_thresh *= 1.1f;
+        opts.sug_thresh *= 1.1f;
         break;
     case Qt::Key_2:
-        draw_hidden = !draw_hidden;
+        opts.draw_hidden = !opts.draw_hidden;
         break;
     case Qt::Key_6:
         clearMesh();
         break;
+    case Qt::Key_P:
+        show_profile = !show_profile;
+        break;
+    case Qt::Key_J:
+        if(profiler.write_chrome_trace("linedrawing-trace.json"))
+            cout<<"Wrote the last "<<profiler.num_frames()
+                <<" frames to linedrawing-trace.json"<<endl;
+        break;
+    case Qt::Key_V:
+        if(export_svg("linedrawing.svg"))
+            cout<<"Wrote the lines to linedrawing.svg"<<endl;
+        break;
 
     default:
         QGLWidget::keyPressEvent(e);
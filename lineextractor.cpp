@@ -0,0 +1,1974 @@
+/*
+Authors:
+  Szymon Rusinkiewicz, Princeton University
+  Doug DeCarlo, Rutgers University
+
+With contributions by:
+  Xiaofeng Mi, Rutgers University
+  Tilke Judd, MIT
+
+lineextractor.cpp
+The line extraction half of rtsc: computes the per-view quantities and
+the various families of lines into SegmentBuffers, without touching GL.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "lineextractor.h"
+#include "TriMesh_algo.h"
+#include "meshcache.h"
+
+#ifndef M_SQRT1_2
+#	define M_SQRT1_2 0.707106781186547524401 /* 1/sqrt(2)*/
+#endif
+
+using namespace std;
+
+
+const char *line_family_names[NUM_LINE_FAMILIES] = {
+	"extsil", "terminator", "isoph", "negisoph", "topo",
+	"K", "H", "DwKr", "apparent", "ridges", "valleys",
+	"ph", "sh", "kr0", "sc", "c", "bdy"
+};
+
+
+// Default options: these match the initial state of the viewer
+LineOptions::LineOptions() :
+	draw_extsil(0), draw_c(1), draw_sc(1),
+	draw_sh(0), draw_phridges(0), draw_phvalleys(0),
+	draw_ridges(0), draw_valleys(0), draw_apparent(0),
+	draw_K(0), draw_H(0), draw_DwKr(0),
+	draw_bdy(0), draw_isoph(0), draw_topo(0),
+	niso(20), ntopo(20), topo_offset(0.0f),
+	draw_hidden(0),
+	test_c(1), test_sc(1), test_sh(1), test_ph(1), test_rv(1), test_ar(1),
+	sug_thresh(0.01f), sh_thresh(0.02f), ph_thresh(0.04f),
+	rv_thresh(0.1f), ar_thresh(0.1f),
+	draw_faded(1), use_hermite(0), use_texture(0),
+	lightdir(0, 0, 1), light_wrt_camera(1),
+	coherent(0), coherence_slack(0.05f),
+	chain_lines(0), threshold_sweep(0)
+{
+}
+
+
+LineExtractor::LineExtractor() : themesh(NULL), feature_size(0.0f),
+	perview_recomputed(0), profiler(NULL), coherent_slack(0.0f),
+	perview_valid(false), gradkr_view(1)
+{
+	candidates_changed();
+}
+
+
+// Set the mesh, and compute its feature size if not given
+void LineExtractor::set_mesh(TriMesh *mesh, float feature_size_)
+{
+	themesh = mesh;
+	feature_size = feature_size_ > 0.0f ? feature_size_ :
+		       mesh_feature_size(themesh);
+	mesh_changed();
+}
+
+
+// Call after changing the vertices, normals or curvatures of the mesh
+void LineExtractor::mesh_changed()
+{
+	pack.build(themesh);
+	perview_from.clear();
+	K_tree.clear();
+	H_tree.clear();
+	gradkr_changed();
+	candidates_changed();
+	perview_valid = false;
+	sweep_cache[0].valid = sweep_cache[1].valid = false;
+}
+
+
+// Forget the view-independent candidate faces
+void LineExtractor::candidates_changed()
+{
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			rv_found[i][j] = ph_found[i][j] = false;
+			rv_segments[i][j].clear();
+			ph_candidates[i][j].clear();
+		}
+	}
+}
+
+
+// Compute everything the options need that doesn't depend on the view,
+// in the mesh or in the extractor.  Afterwards, copies of the extractor
+// can extract lines for different views at the same time.
+void LineExtractor::prepare_views()
+{
+	themesh->need_faces();
+	if (opts.draw_apparent)
+		themesh->need_adjacentfaces();
+	if (opts.draw_bdy || opts.chain_lines)
+		themesh->need_across_edge();
+	if (pack.nv != int(themesh->vertices.size()))
+		pack.build(themesh);
+
+	if (opts.draw_K)
+		need_K_tree();
+	if (opts.draw_H)
+		need_H_tree();
+	if (opts.draw_ridges)
+		ridge_segments(true, opts.test_rv);
+	if (opts.draw_valleys)
+		ridge_segments(false, opts.test_rv);
+	if (opts.draw_phridges)
+		ph_faces(true, opts.test_ph);
+	if (opts.draw_phvalleys)
+		ph_faces(false, opts.test_ph);
+}
+
+
+// Set the camera, and find the view position in mesh coordinates
+void LineExtractor::set_view(const xform &xf_)
+{
+	xf = xf_;
+	viewpos = inv(xf) * point(0,0,0);
+	gradkr_changed();
+}
+
+
+// Set the options
+void LineExtractor::set_options(const LineOptions &opts_)
+{
+	opts = opts_;
+}
+
+
+// Compute a "feature size" for the mesh: computed as 1% of
+// the reciprocal of the 10-th percentile curvature.  The curvatures are
+// sampled at pseudo-random vertices; a remap from reorder_mesh_locality
+// makes those the same vertices that were sampled before reordering.
+float mesh_feature_size(TriMesh *themesh, const vector<int> *remap)
+{
+	vector<int> which;
+	feature_size_samples(themesh->curv1.size(), which);
+
+	vector<float> samples;
+	samples.reserve(which.size() * 2);
+	for (size_t i = 0; i < which.size(); i++) {
+		int ind = which[i];
+		if (remap)
+			ind = (*remap)[ind];
+		samples.push_back(fabs(themesh->curv1[ind]));
+		samples.push_back(fabs(themesh->curv2[ind]));
+	}
+
+	themesh->need_bsphere();
+	return feature_size_of_samples(samples, themesh->bsphere.r);
+}
+
+
+// The vertices, out of nv, whose curvatures mesh_feature_size() samples
+void feature_size_samples(int nv, vector<int> &which)
+{
+	int nsamp = min(nv, 500);
+	which.resize(nsamp);
+
+	// Quick 'n dirty portable random number generator
+	unsigned randq = 0;
+	for (int i = 0; i < nsamp; i++) {
+		randq = unsigned(1664525) * randq + unsigned(1013904223);
+		which[i] = randq % nv;
+	}
+}
+
+
+// The feature size given the absolute curvatures at those vertices, on a
+// mesh whose bounding sphere has radius r
+float feature_size_of_samples(vector<float> &samples, float r)
+{
+	const float frac = 0.1f;
+	const float mult = 0.01f;
+	float max_feature_size = 0.05f * r;
+
+	int which = int(frac * samples.size());
+	nth_element(samples.begin(), samples.begin() + which, samples.end());
+
+	return min(mult / samples[which], max_feature_size);
+}
+
+
+// Get one empty bucket per chunk of face_chunk faces, and return the
+// number of chunks
+int LineExtractor::start_buckets(int nf)
+{
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(buckets.size()) < nchunks)
+		buckets.resize(nchunks);
+	for (int c = 0; c < nchunks; c++)
+		buckets[c].clear();
+	return nchunks;
+}
+
+
+// Append the buckets to out, in chunk order.  Since each chunk always
+// covers the same faces, the result is the same for any number of
+// threads.
+void LineExtractor::gather_buckets(int nchunks, SegmentBuffer &out)
+{
+	size_t total = out.pts.size();
+	for (int c = 0; c < nchunks; c++)
+		total += buckets[c].pts.size();
+	out.pts.reserve(total);
+	out.alpha.reserve(total);
+	for (int c = 0; c < nchunks; c++)
+		out.append(buckets[c]);
+}
+
+
+// Do a and b compute the same per-view quantities (apart from the view
+// position)?
+static bool same_perview_args(const PerviewArgs &a, const PerviewArgs &b)
+{
+	return a.scthresh == b.scthresh && a.shthresh == b.shthresh &&
+	       a.extra_sin2theta == b.extra_sin2theta &&
+	       !a.sctest_num == !b.sctest_num &&
+	       !a.shtest_num == !b.shtest_num;
+}
+
+
+// Compute per-vertex n dot v, radial curvature, and
+// derivative of curvature for the current view
+void LineExtractor::compute_perview()
+{
+	if (opts.draw_apparent)
+		themesh->need_adjacentfaces();
+
+	int nv = themesh->vertices.size();
+
+	float scthresh = opts.sug_thresh / sqr(feature_size);
+	float shthresh = opts.sh_thresh / sqr(feature_size);
+	bool need_DwKr = (opts.draw_sc || opts.draw_sh || opts.draw_DwKr);
+
+	ndotv.resize(nv);
+	kr.resize(nv);
+	if (opts.draw_apparent) {
+		q1.resize(nv);
+		t1.resize(nv);
+		Dt1q1.resize(nv);
+	}
+	if (need_DwKr) {
+		sctest_num.resize(nv);
+		sctest_den.resize(nv);
+		if (opts.draw_sh)
+			shtest_num.resize(nv);
+	}
+
+	if (nv == 0)
+		return;
+	if (pack.nv != nv)
+		pack.build(themesh);
+
+	// Compute n dot v, kr, and the sc/sh tests with the SIMD kernel,
+	// in blocks whose size is a multiple of the vector width.  In a
+	// threshold sweep, the thresholds are left for extract().
+	PerviewArgs args;
+	args.viewpos = viewpos;
+	args.scthresh = sweeping() ? 0.0f : scthresh;
+	args.shthresh = sweeping() ? 0.0f : shthresh;
+	args.extra_sin2theta = opts.use_texture;
+	args.ndotv = &ndotv[0];
+	args.kr = &kr[0];
+	args.sctest_num = need_DwKr ? &sctest_num[0] : NULL;
+	args.sctest_den = need_DwKr ? &sctest_den[0] : NULL;
+	args.shtest_num = (need_DwKr && opts.draw_sh) ? &shtest_num[0] : NULL;
+
+	// Nothing to do if only the thresholds have changed
+	if (sweeping() && perview_valid && perview_pos == viewpos &&
+	    same_perview_args(perview_args, args) &&
+	    perview_apparent == opts.draw_apparent) {
+		perview_recomputed = 0;
+		return;
+	}
+	perview_valid = sweeping();
+	perview_pos = viewpos;
+	perview_args = args;
+	perview_apparent = opts.draw_apparent;
+
+	const int block = perview_block;
+	int nblocks = (nv + block - 1) / block;
+	PerviewKernel kernel = perview_kernel();
+	if (!opts.coherent || opts.draw_apparent) {
+		PROFILE_ZONE(profiler, "n dot v and kr");
+		perview_from.clear();
+#pragma omp parallel for
+		for (int b = 0; b < nblocks; b++)
+			compute_perview_pack(pack, args, b * block,
+					     min(nv, (b + 1) * block), kernel);
+		perview_recomputed = nv;
+	} else {
+		PROFILE_ZONE(profiler, "n dot v and kr, coherent");
+		// Start over if there is nothing to reuse
+		bool all = (int(perview_from.size()) != nv ||
+			    !same_perview_params(args));
+		if (all) {
+			perview_from.resize(nv);
+			perview_radius2.resize(nv);
+			coherent_args = args;
+			coherent_slack = opts.coherence_slack;
+		}
+		int recomputed = 0;
+#pragma omp parallel for reduction(+:recomputed)
+		for (int b = 0; b < nblocks; b++)
+			recomputed += update_perview(args, b * block,
+				min(nv, (b + 1) * block), all, kernel);
+		perview_recomputed = recomputed;
+	}
+
+	if (opts.draw_apparent) {
+		PROFILE_ZONE(profiler, "view-dependent curvature");
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++) {
+			vec viewdir = viewpos - themesh->vertices[i];
+			viewdir *= 1.0f / len(viewdir);
+			float u = viewdir DOT themesh->pdir1[i], u2 = u*u;
+			float v = viewdir DOT themesh->pdir2[i], v2 = v*v;
+			float csc2theta = 1.0f / (u2 + v2);
+			compute_viewdep_curv(themesh, i, ndotv[i],
+				u2*csc2theta, u*v*csc2theta, v2*csc2theta,
+				q1[i], t1[i]);
+		}
+	}
+	if (opts.draw_apparent) {
+		PROFILE_ZONE(profiler, "Dt1q1");
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++)
+			compute_Dt1q1(themesh, i, ndotv[i], q1, t1, Dt1q1[i]);
+	}
+}
+
+
+// Were the per-view quantities being reused computed with these
+// parameters (apart from the view position)?
+bool LineExtractor::same_perview_params(const PerviewArgs &args) const
+{
+	return same_perview_args(coherent_args, args) &&
+	       coherent_slack == opts.coherence_slack;
+}
+
+
+// Recompute the per-view quantities of the vertices in [begin, end) that
+// the view has moved too far for (or all of them), a run of consecutive
+// vertices at a time, and return how many there were
+int LineExtractor::update_perview(const PerviewArgs &args, int begin, int end,
+				  bool all, PerviewKernel kernel)
+{
+	// Mark the vertices to recompute
+	unsigned char stale[perview_block];
+	const point p = viewpos;
+	const point *from = &perview_from[0];
+	const float *r2 = &perview_radius2[0];
+	int nstale = 0;
+	if (all) {
+		memset(stale, 1, end - begin);
+		nstale = end - begin;
+	} else {
+		for (int i = begin; i < end; i++) {
+			float dx = p[0] - from[i][0], dy = p[1] - from[i][1],
+			      dz = p[2] - from[i][2];
+			stale[i - begin] = (dx*dx + dy*dy + dz*dz >= r2[i]);
+			nstale += stale[i - begin];
+		}
+	}
+	if (!nstale)
+		return 0;
+
+	// Recompute them a run at a time
+	int i = begin;
+	while (i < end) {
+		if (!stale[i - begin]) {
+			i++;
+			continue;
+		}
+		int j = i + 1;
+		while (j < end && stale[j - begin])
+			j++;
+		compute_perview_pack(pack, args, i, j, kernel);
+		compute_perview_radius(pack, args, opts.coherence_slack,
+				       i, j, &perview_radius2[0]);
+		for (int k = i; k < j; k++)
+			perview_from[k] = p;
+		i = j;
+	}
+	return nstale;
+}
+
+
+// Find a zero crossing between val0 and val1 by linear interpolation
+// Returns 0 if zero crossing is at val0, 1 if at val1, etc.
+inline float LineExtractor::find_zero_linear(float val0, float val1)
+{
+	return val0 / (val0 - val1);
+}
+
+
+// Find the cubic a*s^3 + b*s^2 + c*s + val0 along the edge from p0 to p1
+// for Hermite interpolation, given the gradients at its ends
+static inline void hermite_cubic(const point &p0, const point &p1,
+				 const vec &grad0, const vec &grad1,
+				 float val0, float val1,
+				 float &a, float &b, float &c)
+{
+	// Find derivatives along edge (of interpolation parameter in [0,1]
+	// which means that e01 doesn't get normalized)
+	vec e01 = p1 - p0;
+	float d0 = e01 DOT grad0, d1 = e01 DOT grad1;
+
+	// This next line would reduce val to linear interpolation
+	//d0 = d1 = (val1 - val0);
+
+	// Use hermite interpolation:
+	//   val(s) = h1(s)*val0 + h2(s)*val1 + h3(s)*d0 + h4(s)*d1
+	// where
+	//  h1(s) = 2*s^3 - 3*s^2 + 1
+	//  h2(s) = 3*s^2 - 2*s^3
+	//  h3(s) = s^3 - 2*s^2 + s
+	//  h4(s) = s^3 - s^2
+	//
+	//  val(s)  = [2(val0-val1) +d0+d1]*s^3 +
+	//            [3(val1-val0)-2d0-d1]*s^2 + d0*s + val0
+	// where
+	//
+	//  val(0) = val0; val(1) = val1; val'(0) = d0; val'(1) = d1
+	//
+
+	// Coeffs of cubic a*s^3 + b*s^2 + c*s + d
+	a = 2 * (val0 - val1) + d0 + d1;
+	b = 3 * (val1 - val0) - 2 * d0 - d1;
+	c = d0;
+}
+
+
+// Make sure gradkr_cache holds the gradient of kr for the current view at
+// every vertex in the first nlists lists.  The vertices that need it are found
+// in one pass, then computed in parallel with compute_gradkr_pack.
+void LineExtractor::need_gradkr(const vector< vector<int> > &lists,
+				int nlists)
+{
+	int nv = themesh->vertices.size();
+	if (int(gradkr_stamp.size()) != nv) {
+		gradkr_stamp.assign(nv, 0);
+		gradkr_cache.resize(nv);
+	}
+
+	gradkr_verts.clear();
+	for (int l = 0; l < nlists; l++) {
+		const vector<int> &list = lists[l];
+		for (size_t i = 0; i < list.size(); i++) {
+			int v = list[i];
+			if (gradkr_stamp[v] == gradkr_view)
+				continue;
+			gradkr_stamp[v] = gradkr_view;
+			gradkr_verts.push_back(v);
+		}
+	}
+
+	if (pack.nv != nv)
+		pack.build(themesh);
+
+	// Compute them with the SIMD kernel, in blocks of the list
+	int n = gradkr_verts.size();
+	const int block = perview_block;
+	int nblocks = (n + block - 1) / block;
+	PerviewKernel kernel = perview_kernel();
+#pragma omp parallel for
+	for (int b = 0; b < nblocks; b++)
+		compute_gradkr_pack(pack, viewpos, &gradkr_verts[b * block],
+				    min(n, (b + 1) * block) - b * block,
+				    &gradkr_cache[0], kernel);
+}
+
+
+// Mark the cached gradients of kr out of date
+void LineExtractor::gradkr_changed()
+{
+	if (++gradkr_view == 0) {
+		gradkr_stamp.assign(gradkr_stamp.size(), 0);
+		gradkr_view = 1;
+	}
+}
+
+
+// Extract part of a zero-crossing curve on one triangle face, but only if
+// "test_num/test_den" is positive.  v0,v1,v2 are the indices of the 3
+// vertices of face, and w10 and w20 how far along edges v0-v1 and v0-v2 the zero
+// crossings of the scalar field are, which assumes that its value at v0
+// has opposite sign from those at v1 and v2 - isoline_face_corner
+// figures out which vertex actually has the different sign.  "test_*"
+// are the values we are testing to make sure they are positive, with
+// thresh * test_den taken off test_num at each vertex.
+void LineExtractor::extract_face_isoline2(int face, int v0, int v1, int v2,
+			float w10, float w20,
+			const vector<float> &test_num,
+			const vector<float> &test_den,
+			float thresh, bool do_test, float fade,
+			SegmentBuffer &out)
+{
+	// How far along each edge?
+	float w01 = 1.0f - w10;
+	float w02 = 1.0f - w20;
+
+	// Points along edges
+	point p1 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
+	point p2 = w02 * themesh->vertices[v0] + w20 * themesh->vertices[v2];
+
+	float test_num1 = 1.0f, test_num2 = 1.0f;
+	float test_den1 = 1.0f, test_den2 = 1.0f;
+	float z1 = 0.0f, z2 = 0.0f;
+	bool valid1 = true;
+	if (do_test) {
+		// Interpolate to find value of test at p1, p2
+		float num0 = test_num[v0], num1 = test_num[v1],
+		      num2 = test_num[v2];
+		if (thresh != 0.0f) {
+			num0 -= thresh * test_den[v0];
+			num1 -= thresh * test_den[v1];
+			num2 -= thresh * test_den[v2];
+		}
+		test_num1 = w01 * num0 + w10 * num1;
+		test_num2 = w02 * num0 + w20 * num2;
+		if (!test_den.empty()) {
+			test_den1 = w01 * test_den[v0] + w10 * test_den[v1];
+			test_den2 = w02 * test_den[v0] + w20 * test_den[v2];
+		}
+		// First point is valid iff num1/den1 is positive,
+		// i.e. the num and den have the same sign
+		valid1 = ((test_num1 >= 0.0f) == (test_den1 >= 0.0f));
+		// There are two possible zero crossings of the test,
+		// corresponding to zeros of the num and den
+		if ((test_num1 >= 0.0f) != (test_num2 >= 0.0f))
+			z1 = test_num1 / (test_num1 - test_num2);
+		if ((test_den1 >= 0.0f) != (test_den2 >= 0.0f))
+			z2 = test_den1 / (test_den1 - test_den2);
+		// Sort and order the zero crossings
+		if (z1 == 0.0f)
+			z1 = z2, z2 = 0.0f;
+		else if (z2 < z1)
+			swap(z1, z2);
+	}
+
+	// If the beginning of the segment was not valid, and
+	// no zero crossings, then whole segment invalid
+	if (!valid1 && !z1 && !z2)
+		return;
+
+	// Collect the valid piece(s): either one or two segments.  Only
+	// p1 and p2 are on edges of the face.
+	point p[4];
+	float a[4];
+	int e[4] = { -1, -1, -1, -1 };
+	int npts = 0;
+	if (valid1) {
+		p[npts] = p1;
+		e[npts] = 0;
+		a[npts++] = test_num1 / (test_den1 * fade + test_num1);
+	}
+	if (z1) {
+		float num = (1.0f - z1) * test_num1 + z1 * test_num2;
+		float den = (1.0f - z1) * test_den1 + z1 * test_den2;
+		p[npts] = (1.0f - z1) * p1 + z1 * p2;
+		a[npts++] = num / (den * fade + num);
+	}
+	if (z2) {
+		float num = (1.0f - z2) * test_num1 + z2 * test_num2;
+		float den = (1.0f - z2) * test_den1 + z2 * test_den2;
+		p[npts] = (1.0f - z2) * p1 + z2 * p2;
+		a[npts++] = num / (den * fade + num);
+	}
+	if (npts != 2) {
+		p[npts] = p2;
+		e[npts] = 1;
+		a[npts++] = test_num2 / (test_den2 * fade + test_num2);
+	}
+	for (int i = 0; i < npts; i += 2)
+		out.add(p[i], a[i], p[i+1], a[i+1]);
+
+	// The edges p1 and p2 are on are opposite v2 and v1
+	if (opts.chain_lines) {
+		int edge[2] = { face_edge(face, v2), face_edge(face, v1) };
+		for (int i = 0; i < npts; i += 2)
+			out.add_edges(e[i] < 0 ? -1 : edge[e[i]],
+				      e[i+1] < 0 ? -1 : edge[e[i+1]]);
+	}
+}
+
+
+// Is the test negative at all three vertices of a face, with thresh *
+// test_den taken off test_num?  Then there is nothing to extract on it.
+bool LineExtractor::face_test_fails(int v0, int v1, int v2,
+		       const vector<float> &test_num,
+		       const vector<float> &test_den,
+		       float thresh) const
+{
+	if (test_den.empty())
+		return test_num[v0] <= 0.0f &&
+		       test_num[v1] <= 0.0f &&
+		       test_num[v2] <= 0.0f;
+
+	float num0 = test_num[v0], num1 = test_num[v1], num2 = test_num[v2];
+	if (thresh != 0.0f) {
+		num0 -= thresh * test_den[v0];
+		num1 -= thresh * test_den[v1];
+		num2 -= thresh * test_den[v2];
+	}
+	if (num0 <= 0.0f && test_den[v0] >= 0.0f &&
+	    num1 <= 0.0f && test_den[v1] >= 0.0f &&
+	    num2 <= 0.0f && test_den[v2] >= 0.0f)
+		return true;
+	if (num0 >= 0.0f && test_den[v0] <= 0.0f &&
+	    num1 >= 0.0f && test_den[v1] <= 0.0f &&
+	    num2 >= 0.0f && test_den[v2] <= 0.0f)
+		return true;
+	return false;
+}
+
+
+// See above.  This figures out which of v0, v1, v2 has a different
+// sign from the others, for the isoline val = level, or returns -1 if
+// the face is culled or fails the test.
+int LineExtractor::isoline_face_corner(int v0, int v1, int v2,
+		       const vector<float> &val, float level,
+		       const vector<float> &test_num,
+		       const vector<float> &test_den,
+		       const vector<float> &ndotv,
+		       bool do_bfcull, bool do_test)
+{
+	// Backface culling
+	if (likely(do_bfcull && ndotv[v0] <= 0.0f &&
+		   ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+		return -1;
+
+	// Quick reject if derivs are negative
+	if (do_test && face_test_fails(v0, v1, v2, test_num, test_den, 0.0f))
+		return -1;
+
+	// Figure out which val has different sign
+	float val0 = val[v0] - level;
+	float val1 = val[v1] - level;
+	float val2 = val[v2] - level;
+	if ((val0 < 0.0f && val1 >= 0.0f && val2 >= 0.0f) ||
+	    (val0 > 0.0f && val1 <= 0.0f && val2 <= 0.0f))
+		return 0;
+	else if ((val1 < 0.0f && val2 >= 0.0f && val0 >= 0.0f) ||
+		 (val1 > 0.0f && val2 <= 0.0f && val0 <= 0.0f))
+		return 1;
+	else if ((val2 < 0.0f && val0 >= 0.0f && val1 >= 0.0f) ||
+		 (val2 > 0.0f && val0 <= 0.0f && val1 <= 0.0f))
+		return 2;
+	return -1;
+}
+
+
+// The cubics along the crossed edges of a chunk's faces, for Hermite
+// interpolation, solved all together by find_zeros_hermite
+struct HermiteBatch {
+	vector<float> a, b, c, val0, val1, s;
+
+	void clear()
+	{
+		a.clear(); b.clear(); c.clear();
+		val0.clear(); val1.clear();
+	}
+	void add(const TriMesh *mesh, const vector<vec> &grad,
+		 int v0, int v1, float value0, float value1)
+	{
+		float ea, eb, ec;
+		hermite_cubic(mesh->vertices[v0], mesh->vertices[v1],
+			      grad[v0], grad[v1], value0, value1, ea, eb, ec);
+		a.push_back(ea); b.push_back(eb); c.push_back(ec);
+		val0.push_back(value0); val1.push_back(value1);
+	}
+	void solve()
+	{
+		int n = a.size();
+		s.resize(n);
+		if (n)
+			find_zeros_hermite(n, &a[0], &b[0], &c[0],
+					   &val0[0], &val1[0], &s[0]);
+	}
+};
+
+
+// Find the faces on which val changes sign, in one streaming pass over
+// the faces.  The list it leaves in faces is in face order.
+void LineExtractor::find_isoline_faces(const vector<float> &val,
+				       vector<int> &faces)
+{
+	int nf = themesh->faces.size();
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(face_buckets.size()) < nchunks)
+		face_buckets.resize(nchunks);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		vector<int> &bucket = face_buckets[c];
+		bucket.clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			if (!face_drawn(i))
+				continue;
+			const TriMesh::Face &f = themesh->faces[i];
+			const float &v0 = val[f[0]], &v1 = val[f[1]],
+				    &v2 = val[f[2]];
+			if (unlikely((v0 > 0.0f || v1 > 0.0f || v2 > 0.0f) &&
+				     (v0 < 0.0f || v1 < 0.0f || v2 < 0.0f)))
+				bucket.push_back(i);
+		}
+	}
+
+	gather_face_buckets(nchunks, faces);
+}
+
+
+// Concatenate the first nchunks face_buckets into faces
+void LineExtractor::gather_face_buckets(int nchunks, vector<int> &faces)
+{
+	size_t total = 0;
+	for (int c = 0; c < nchunks; c++)
+		total += face_buckets[c].size();
+	faces.clear();
+	faces.reserve(total);
+	for (int c = 0; c < nchunks; c++)
+		faces.insert(faces.end(), face_buckets[c].begin(),
+			     face_buckets[c].end());
+}
+
+
+// Find the crossings of val = level, looking only at the given faces
+// (as found by find_isoline_faces or an IsoTree), but only where
+// test_num/test_den is greater than 0.  If crossings isn't NULL, the
+// crossings are added to it instead, and the test is left for
+// extract_crossings.
+void LineExtractor::extract_isolines_on(const vector<int> &faces,
+		   const vector<float> &val, float level,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite,
+		   bool do_test, float fade, SegmentBuffer &out,
+		   IsolineCrossings *crossings)
+{
+	if (do_hermite) {
+		extract_isolines_hermite(faces, val, level, test_num, test_den,
+					 ndotv, do_bfcull, do_test, fade, out,
+					 crossings);
+		return;
+	}
+
+	// Walk through the faces in parallel, a chunk at a time
+	int nf = faces.size();
+	int nchunks = start_buckets(nf);
+	if (crossings) {
+		if (int(crossing_buckets.size()) < nchunks)
+			crossing_buckets.resize(nchunks);
+		for (int c = 0; c < nchunks; c++)
+			crossing_buckets[c].clear();
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		SegmentBuffer &bucket = buckets[c];
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			const TriMesh::Face &f = themesh->faces[faces[i]];
+			// Extract a line if, among the values in this
+			// triangle, at least one is positive and one
+			// is negative
+			float v0 = val[f[0]] - level, v1 = val[f[1]] - level,
+			      v2 = val[f[2]] - level;
+			if (!((v0 > 0.0f || v1 > 0.0f || v2 > 0.0f) &&
+			      (v0 < 0.0f || v1 < 0.0f || v2 < 0.0f)))
+				continue;
+			int k = isoline_face_corner(f[0], f[1], f[2],
+						    val, level,
+						    test_num, test_den, ndotv,
+						    do_bfcull, do_test);
+			if (k < 0)
+				continue;
+			int i0 = f[k], i1 = f[(k+1)%3], i2 = f[(k+2)%3];
+			float val0 = val[i0] - level;
+			float w10 = find_zero_linear(val0, val[i1] - level);
+			float w20 = find_zero_linear(val0, val[i2] - level);
+			if (crossings)
+				crossing_buckets[c].add(faces[i], i0, i1, i2,
+							w10, w20);
+			else
+				extract_face_isoline2(faces[i], i0, i1, i2,
+					w10, w20, test_num, test_den, 0.0f,
+					do_test, fade, bucket);
+		}
+	}
+	if (crossings) {
+		for (int c = 0; c < nchunks; c++)
+			crossings->append(crossing_buckets[c]);
+	} else {
+		gather_buckets(nchunks, out);
+	}
+}
+
+
+// The same for the crossings of kr = level, placed by Hermite
+// interpolation
+void LineExtractor::extract_isolines_hermite(const vector<int> &faces,
+		   const vector<float> &val, float level,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_test, float fade, SegmentBuffer &out,
+		   IsolineCrossings *crossings)
+{
+	// The faces to extract from, each with its vertices rotated for
+	// extract_face_isoline2
+	int nf = faces.size();
+	int nchunks = start_buckets(nf);
+	if (int(hermite_buckets.size()) < nchunks) {
+		hermite_buckets.resize(nchunks);
+		hermite_faces.resize(nchunks);
+	}
+	if (crossings) {
+		if (int(crossing_buckets.size()) < nchunks)
+			crossing_buckets.resize(nchunks);
+		for (int c = 0; c < nchunks; c++)
+			crossing_buckets[c].clear();
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		vector<int> &verts = hermite_buckets[c];
+		verts.clear();
+		hermite_faces[c].clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			const TriMesh::Face &f = themesh->faces[faces[i]];
+			float v0 = val[f[0]] - level, v1 = val[f[1]] - level,
+			      v2 = val[f[2]] - level;
+			if (!((v0 > 0.0f || v1 > 0.0f || v2 > 0.0f) &&
+			      (v0 < 0.0f || v1 < 0.0f || v2 < 0.0f)))
+				continue;
+			int k = isoline_face_corner(f[0], f[1], f[2],
+						    val, level,
+						    test_num, test_den, ndotv,
+						    do_bfcull, do_test);
+			if (k < 0)
+				continue;
+			verts.push_back(f[k]);
+			verts.push_back(f[(k+1)%3]);
+			verts.push_back(f[(k+2)%3]);
+			hermite_faces[c].push_back(faces[i]);
+		}
+	}
+
+	// The gradient of kr at their vertices
+	need_gradkr(hermite_buckets, nchunks);
+
+	// The crossings along edges v0-v1 and v0-v2 of each face
+#pragma omp parallel
+	{
+		HermiteBatch batch;
+#pragma omp for schedule(dynamic)
+		for (int c = 0; c < nchunks; c++) {
+			const vector<int> &verts = hermite_buckets[c];
+			int n = verts.size() / 3;
+			batch.clear();
+			for (int j = 0; j < n; j++) {
+				int i0 = verts[3*j], i1 = verts[3*j+1],
+				    i2 = verts[3*j+2];
+				float val0 = val[i0] - level;
+				batch.add(themesh, gradkr_cache, i0, i1,
+					  val0, val[i1] - level);
+				batch.add(themesh, gradkr_cache, i0, i2,
+					  val0, val[i2] - level);
+			}
+			batch.solve();
+			for (int j = 0; j < n; j++) {
+				if (crossings) {
+					crossing_buckets[c].add(
+						hermite_faces[c][j],
+						verts[3*j], verts[3*j+1],
+						verts[3*j+2], batch.s[2*j],
+						batch.s[2*j+1]);
+					continue;
+				}
+				extract_face_isoline2(hermite_faces[c][j],
+					verts[3*j], verts[3*j+1],
+					verts[3*j+2], batch.s[2*j],
+					batch.s[2*j+1], test_num, test_den,
+					0.0f, do_test, fade, buckets[c]);
+			}
+		}
+	}
+	if (crossings) {
+		for (int c = 0; c < nchunks; c++)
+			crossings->append(crossing_buckets[c]);
+	} else {
+		gather_buckets(nchunks, out);
+	}
+}
+
+
+// Takes a scalar field and finds the zero crossings, but only where
+// test_num/test_den is greater than 0.  The faces with a sign change
+// are found first, and only those are visited.
+void LineExtractor::extract_isolines(const vector<float> &val,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite,
+		   bool do_test, float fade, SegmentBuffer &out)
+{
+	PROFILE_ZONE(profiler, "isolines");
+
+	find_isoline_faces(val, isoline_faces);
+	extract_isolines_on(isoline_faces, val, 0.0f, test_num, test_den,
+			    ndotv, do_bfcull, do_hermite, do_test, fade, out);
+}
+
+
+// Find the crossings of the zeros of val (see IsolineCrossings), which
+// are added to out
+void LineExtractor::find_isoline_crossings(const vector<float> &val,
+		   const vector<float> &ndotv,
+		   bool do_bfcull, bool do_hermite, IsolineCrossings &out)
+{
+	PROFILE_ZONE(profiler, "isoline crossings");
+
+	vector<float> none;
+	SegmentBuffer unused;
+	find_isoline_faces(val, isoline_faces);
+	extract_isolines_on(isoline_faces, val, 0.0f, none, none, ndotv,
+			    do_bfcull, do_hermite, false, 0.0f, unused, &out);
+}
+
+
+// Extract the segments on crossings found by find_isoline_crossings,
+// where test_num - thresh * test_den has the same sign as test_den.
+// With the same thresh, these are the segments extract_isolines finds.
+void LineExtractor::extract_crossings(const IsolineCrossings &crossings,
+		   const vector<float> &test_num,
+		   const vector<float> &test_den,
+		   float thresh, float fade, SegmentBuffer &out)
+{
+	PROFILE_ZONE(profiler, "isoline tests");
+
+	int n = crossings.size();
+	int nchunks = start_buckets(n);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		SegmentBuffer &bucket = buckets[c];
+		int end = min(n, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < end; i++) {
+			const int *v = &crossings.verts[3*i];
+			if (face_test_fails(v[0], v[1], v[2],
+					    test_num, test_den, thresh))
+				continue;
+			extract_face_isoline2(crossings.faces[i],
+				v[0], v[1], v[2],
+				crossings.w[2*i], crossings.w[2*i+1],
+				test_num, test_den, thresh, true, fade,
+				bucket);
+		}
+	}
+	gather_buckets(nchunks, out);
+}
+
+
+// Find part of a ridge/valley curve on one triangle face: its endpoints
+// and the curvatures there.  v0,v1,v2 are the indices of the 3 vertices;
+// this function assumes that the curve connects points on the edges
+// v0-v1 and v1-v2 (or connects point on v0-v1 to center if to_center is
+// true)
+void LineExtractor::find_segment_ridge(int v0, int v1, int v2,
+			float emax0, float emax1, float emax2,
+			float kmax0, float kmax1, float kmax2,
+			bool to_center, point &p01, float &k01,
+			point &p12, float &k12) const
+{
+	// Interpolate to find ridge/valley line segment endpoints
+	// in this triangle and the curvatures there
+	float w10 = fabs(emax0) / (fabs(emax0) + fabs(emax1));
+	float w01 = 1.0f - w10;
+	p01 = w01 * themesh->vertices[v0] + w10 * themesh->vertices[v1];
+	k01 = fabs(w01 * kmax0 + w10 * kmax1);
+
+	if (to_center) {
+		// Connect first point to center of triangle
+		p12 = (themesh->vertices[v0] +
+		       themesh->vertices[v1] +
+		       themesh->vertices[v2]) / 3.0f;
+		k12 = fabs(kmax0 + kmax1 + kmax2) / 3.0f;
+	} else {
+		// Connect first point to second one (on next edge)
+		float w21 = fabs(emax1) / (fabs(emax1) + fabs(emax2));
+		float w12 = 1.0f - w21;
+		p12 = w12 * themesh->vertices[v1] + w21 * themesh->vertices[v2];
+		k12 = fabs(w12 * kmax1 + w21 * kmax2);
+	}
+}
+
+
+// Which segments of the ridges or valleys (depending on do_ridge) cross
+// triangle v0,v1,v2: -1 if none, 0, 1 or 2 if they connect the edges
+// other than v1-v2, v2-v0 or v0-v1 respectively, 3 if all three edges
+// are connected to the center.
+// - do_test checks for curvature maxima/minina for ridges/valleys
+//   (when off, it finds positive minima and negative maxima)
+// None of this depends on the view, so it is found once for each face
+// (see ridge_segments).
+// Algorithm based on formulas of Ohtake et al., 2004.
+int LineExtractor::ridge_face_kind(int v0, int v1, int v2, bool do_ridge,
+				   bool do_test) const
+{
+	// Check if ridge possible at vertices just based on curvatures
+	if (do_ridge) {
+		if ((themesh->curv1[v0] <= 0.0f) ||
+		    (themesh->curv1[v1] <= 0.0f) ||
+		    (themesh->curv1[v2] <= 0.0f))
+			return -1;
+	} else {
+		if ((themesh->curv1[v0] >= 0.0f) ||
+		    (themesh->curv1[v1] >= 0.0f) ||
+		    (themesh->curv1[v2] >= 0.0f))
+			return -1;
+	}
+
+	// Sign of curvature on ridge/valley
+	float rv_sign = do_ridge ? 1.0f : -1.0f;
+
+	// The "tmax" are the principal directions of maximal curvature,
+	// flipped to point in the direction in which the curvature
+	// is increasing (decreasing for valleys).  Note that this
+	// is a bit different from the notation in Ohtake et al.,
+	// but the tests below are equivalent.
+	vec tmax0 = rv_sign * themesh->dcurv[v0][0] * themesh->pdir1[v0];
+	vec tmax1 = rv_sign * themesh->dcurv[v1][0] * themesh->pdir1[v1];
+	vec tmax2 = rv_sign * themesh->dcurv[v2][0] * themesh->pdir1[v2];
+
+	// We have a "zero crossing" if the tmaxes along an edge
+	// point in opposite directions
+	bool z01 = ((tmax0 DOT tmax1) <= 0.0f);
+	bool z12 = ((tmax1 DOT tmax2) <= 0.0f);
+	bool z20 = ((tmax2 DOT tmax0) <= 0.0f);
+
+	if (z01 + z12 + z20 < 2)
+		return -1;
+
+	if (do_test) {
+		const point &p0 = themesh->vertices[v0],
+			    &p1 = themesh->vertices[v1],
+			    &p2 = themesh->vertices[v2];
+
+		// Check whether we have the correct flavor of extremum:
+		// Is the curvature increasing along the edge?
+		z01 = z01 && ((tmax0 DOT (p1 - p0)) >= 0.0f ||
+			      (tmax1 DOT (p1 - p0)) <= 0.0f);
+		z12 = z12 && ((tmax1 DOT (p2 - p1)) >= 0.0f ||
+			      (tmax2 DOT (p2 - p1)) <= 0.0f);
+		z20 = z20 && ((tmax2 DOT (p0 - p2)) >= 0.0f ||
+			      (tmax0 DOT (p0 - p2)) <= 0.0f);
+
+		if (z01 + z12 + z20 < 2)
+			return -1;
+	}
+
+	return !z01 ? 0 : !z12 ? 1 : !z20 ? 2 : 3;
+}
+
+
+// Add part of a ridge/valley curve on one triangle face (see
+// find_segment_ridge) to segs
+void LineExtractor::add_segment_ridge(int face, int v0, int v1, int v2,
+				      bool to_center,
+				      RidgeSegments &segs) const
+{
+	point p01, p12;
+	float k01, k12;
+	find_segment_ridge(v0, v1, v2, themesh->dcurv[v0][0],
+			   themesh->dcurv[v1][0], themesh->dcurv[v2][0],
+			   themesh->curv1[v0], themesh->curv1[v1],
+			   themesh->curv1[v2], to_center, p01, k01, p12, k12);
+	segs.add(face, p01, k01, face_edge(face, v2),
+		 p12, k12, to_center ? -1 : face_edge(face, v0));
+}
+
+
+// Find the segments of kind ridge_face_kind() in triangle v0,v1,v2
+void LineExtractor::find_face_ridges(int face, int v0, int v1, int v2,
+				     int kind, RidgeSegments &segs) const
+{
+	if (kind == 0) {
+		add_segment_ridge(face, v1, v2, v0, false, segs);
+	} else if (kind == 1) {
+		add_segment_ridge(face, v2, v0, v1, false, segs);
+	} else if (kind == 2) {
+		add_segment_ridge(face, v0, v1, v2, false, segs);
+	} else {
+		// All three edges have crossings -- connect all to center
+		add_segment_ridge(face, v1, v2, v0, true, segs);
+		add_segment_ridge(face, v2, v0, v1, true, segs);
+		add_segment_ridge(face, v0, v1, v2, true, segs);
+	}
+}
+
+
+// The faces crossed by ridges (valleys), as 4 * face + ridge_face_kind(),
+// in face order
+void LineExtractor::find_ridge_faces(bool do_ridge, bool do_test,
+				     vector<int> &faces)
+{
+	int nf = themesh->faces.size();
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(face_buckets.size()) < nchunks)
+		face_buckets.resize(nchunks);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		vector<int> &bucket = face_buckets[c];
+		bucket.clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			if (!face_drawn(i))
+				continue;
+			const TriMesh::Face &f = themesh->faces[i];
+			int kind = ridge_face_kind(f[0], f[1], f[2],
+						   do_ridge, do_test);
+			if (kind >= 0)
+				bucket.push_back(4 * i + kind);
+		}
+	}
+	gather_face_buckets(nchunks, faces);
+}
+
+
+// The segments of the ridges (valleys), in face order.  They are found
+// the first time they are needed, and kept until the mesh changes.
+const RidgeSegments &LineExtractor::ridge_segments(bool do_ridge,
+						   bool do_test)
+{
+	RidgeSegments &segs = rv_segments[do_ridge][do_test];
+	if (rv_found[do_ridge][do_test])
+		return segs;
+
+	vector<int> faces;
+	find_ridge_faces(do_ridge, do_test, faces);
+	segs.clear();
+	for (size_t i = 0; i < faces.size(); i++) {
+		int face = faces[i] >> 2;
+		const TriMesh::Face &f = themesh->faces[face];
+		find_face_ridges(face, f[0], f[1], f[2], faces[i] & 3, segs);
+	}
+	rv_found[do_ridge][do_test] = true;
+	return segs;
+}
+
+
+// Take thresh off the curvature at n ends of segments, stopping at 0,
+// and find the fade there: a loop the compiler can vectorize
+static inline void threshold_ends(const float *kin, int n, float thresh,
+				  bool faded, float *k, float *alpha)
+{
+	for (int j = 0; j < n; j++) {
+		k[j] = max(kin[j] - thresh, 0.0f);
+		alpha[j] = faded ? k[j] / (k[j] + thresh) : 1.0f;
+	}
+}
+
+
+// Extract the ridges (valleys) of the mesh, from the segments found once
+// by ridge_segments.  The threshold and fade are applied to the ends of a
+// chunk of segments at a time, in a loop the compiler can vectorize, and
+// then the segments are culled.
+// - uses ndotv for backface culling (enabled with do_bfcull)
+void LineExtractor::extract_mesh_ridges(bool do_ridge, const vector<float> &ndotv,
+		      bool do_bfcull, bool do_test, float thresh,
+		      SegmentBuffer &out)
+{
+	PROFILE_ZONE(profiler, "ridges and valleys");
+	const RidgeSegments &segs = ridge_segments(do_ridge, do_test);
+
+	int n = segs.size();
+	int nchunks = start_buckets(n);
+	bool faded = opts.draw_faded;
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		SegmentBuffer &bucket = buckets[c];
+		int begin = c * face_chunk, end = min(n, (c + 1) * face_chunk);
+
+		// Curvature above the threshold, and the fade, at each end
+		float k[2 * face_chunk], alpha[2 * face_chunk];
+		threshold_ends(&segs.k[2 * begin], 2 * (end - begin), thresh,
+			       faded, k, alpha);
+
+		for (int i = begin; i < end; i++) {
+			int j = 2 * (i - begin);
+			// Skip lines that you can't see...
+			if (k[j] == 0.0f && k[j+1] == 0.0f)
+				continue;
+			const TriMesh::Face &f = themesh->faces[segs.faces[i]];
+			if (likely(do_bfcull && ndotv[f[0]] <= 0.0f &&
+				   ndotv[f[1]] <= 0.0f && ndotv[f[2]] <= 0.0f))
+				continue;
+			bucket.add(segs.pts[2*i], alpha[j],
+				   segs.pts[2*i+1], alpha[j+1]);
+			if (opts.chain_lines)
+				bucket.add_edges(segs.edges[2*i],
+						 segs.edges[2*i+1]);
+		}
+	}
+	gather_buckets(nchunks, out);
+}
+
+
+// Add the segments of segs that are visible with the threshold thresh to
+// out, faded by how far their curvature is above it
+void LineExtractor::fade_segments(const ThresholdSegments &segs,
+				  float thresh, SegmentBuffer &out)
+{
+	int n = segs.size();
+	int nchunks = start_buckets(n);
+	bool faded = opts.draw_faded;
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		SegmentBuffer &bucket = buckets[c];
+		int begin = c * face_chunk, end = min(n, (c + 1) * face_chunk);
+
+		float k[2 * face_chunk], alpha[2 * face_chunk];
+		threshold_ends(&segs.k[2 * begin], 2 * (end - begin), thresh,
+			       faded, k, alpha);
+
+		for (int i = begin; i < end; i++) {
+			if (!(thresh < segs.limit[i]))
+				continue;
+			int j = 2 * (i - begin);
+			bucket.add(segs.pts[2*i], alpha[j],
+				   segs.pts[2*i+1], alpha[j+1]);
+			if (opts.chain_lines)
+				bucket.add_edges(segs.edges[2*i],
+						 segs.edges[2*i+1]);
+		}
+	}
+	gather_buckets(nchunks, out);
+}
+
+
+// Might principal highlights cross triangle v0,v1,v2?  Not if do_test
+// and the curvatures have the wrong sign, or if the principal directions
+// turn by more than 45 degrees across it.  Since this doesn't depend on
+// the view, it is found once for each face (see ph_faces).
+bool LineExtractor::ph_face_candidate(int v0, int v1, int v2, bool do_ridge,
+				      bool do_test) const
+{
+	float k0 = themesh->curv1[v0];
+	float k1 = themesh->curv1[v1];
+	float k2 = themesh->curv1[v2];
+	if (do_test && do_ridge && min(min(k0,k1),k2) < 0.0f)
+		return false;
+	if (do_test && !do_ridge && max(max(k0,k1),k2) > 0.0f)
+		return false;
+
+	vec d0, d1, d2;
+	return ph_face_directions(v0, v1, v2, d0, d1, d2);
+}
+
+
+// Orient the principal directions of a face based on the largest
+// principal curvature, returning false if they have flipped
+bool LineExtractor::ph_face_directions(int v0, int v1, int v2,
+				       vec &d0, vec &d1, vec &d2) const
+{
+	d0 = themesh->pdir1[v0];
+	d1 = themesh->pdir1[v1];
+	d2 = themesh->pdir1[v2];
+	float kmax = fabs(themesh->curv1[v0]);
+        // dref is the e1 vector with the largest |k1|
+	vec dref = d0;
+	if (fabs(themesh->curv1[v1]) > kmax)
+		kmax = fabs(themesh->curv1[v1]), dref = d1;
+	if (fabs(themesh->curv1[v2]) > kmax)
+		kmax = fabs(themesh->curv1[v2]), dref = d2;
+        
+        // Flip all the e1 to agree with dref
+	if ((d0 DOT dref) < 0.0f) d0 = -d0;
+	if ((d1 DOT dref) < 0.0f) d1 = -d1;
+	if ((d2 DOT dref) < 0.0f) d2 = -d2;
+
+        // If directions have flipped (more than 45 degrees), then give up
+        return !((d0 DOT dref) < M_SQRT1_2 ||
+                 (d1 DOT dref) < M_SQRT1_2 ||
+                 (d2 DOT dref) < M_SQRT1_2);
+}
+
+
+// Find principal highlights on a face that passed ph_face_candidate,
+// before the threshold
+void LineExtractor::find_face_ph(int face, int v0, int v1, int v2,
+		  const vector<float> &ndotv, bool do_bfcull,
+		  ThresholdSegments &out)
+{
+	// Backface culling
+	if (likely(do_bfcull &&
+		   ndotv[v0] <= 0.0f && ndotv[v1] <= 0.0f && ndotv[v2] <= 0.0f))
+		return;
+
+	vec d0, d1, d2;
+	ph_face_directions(v0, v1, v2, d0, d1, d2);
+
+	// Compute view directions, dot products @ each vertex
+	vec viewdir0 = viewpos - themesh->vertices[v0];
+	vec viewdir1 = viewpos - themesh->vertices[v1];
+	vec viewdir2 = viewpos - themesh->vertices[v2];
+
+        // Normalize these for cos(theta) later...
+        normalize(viewdir0);
+        normalize(viewdir1);
+        normalize(viewdir2);
+
+        // e1 DOT w sin(theta) 
+        // -- which is zero when looking down e2
+	float dot0 = viewdir0 DOT d0;
+	float dot1 = viewdir1 DOT d1;
+	float dot2 = viewdir2 DOT d2;
+
+	// We have a "zero crossing" if the dot products along an edge
+	// have opposite signs
+	int z01 = (dot0*dot1 <= 0.0f);
+	int z12 = (dot1*dot2 <= 0.0f);
+	int z20 = (dot2*dot0 <= 0.0f);
+
+	if (z01 + z12 + z20 < 2)
+		return;
+
+	// Extract line segment
+	float test0 = (sqr(themesh->curv1[v0]) - sqr(themesh->curv2[v0])) *
+                      viewdir0 DOT themesh->normals[v0];
+	float test1 = (sqr(themesh->curv1[v1]) - sqr(themesh->curv2[v1])) *
+                      viewdir0 DOT themesh->normals[v1];
+	float test2 = (sqr(themesh->curv1[v2]) - sqr(themesh->curv2[v2])) *
+                      viewdir0 DOT themesh->normals[v2];
+
+	// The segment runs from the first of the edges it crosses to the
+	// second, in the order of find_segment_ridge
+	point p01, p12;
+	float k01, k12;
+	int e01, e12;
+	if (!z01) {
+		find_segment_ridge(v1, v2, v0, dot1, dot2, dot0,
+				   test1, test2, test0, false,
+				   p01, k01, p12, k12);
+		e01 = face_edge(face, v0), e12 = face_edge(face, v1);
+	} else if (!z12) {
+		find_segment_ridge(v2, v0, v1, dot2, dot0, dot1,
+				   test2, test0, test1, false,
+				   p01, k01, p12, k12);
+		e01 = face_edge(face, v1), e12 = face_edge(face, v2);
+	} else if (!z20) {
+		find_segment_ridge(v0, v1, v2, dot0, dot1, dot2,
+				   test0, test1, test2, false,
+				   p01, k01, p12, k12);
+		e01 = face_edge(face, v2), e12 = face_edge(face, v0);
+	} else {
+		return;
+	}
+	out.add(p01, k01, e01, p12, k12, e12, max(k01, k12));
+}
+
+
+// The faces principal highlights might cross, in face order.  They are
+// found the first time they are needed, and kept until the mesh changes.
+const vector<int> &LineExtractor::ph_faces(bool do_ridge, bool do_test)
+{
+	vector<int> &faces = ph_candidates[do_ridge][do_test];
+	if (ph_found[do_ridge][do_test])
+		return faces;
+
+	int nf = themesh->faces.size();
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(face_buckets.size()) < nchunks)
+		face_buckets.resize(nchunks);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		vector<int> &bucket = face_buckets[c];
+		bucket.clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			if (!face_drawn(i))
+				continue;
+			const TriMesh::Face &f = themesh->faces[i];
+			if (ph_face_candidate(f[0], f[1], f[2],
+					      do_ridge, do_test))
+				bucket.push_back(i);
+		}
+	}
+	gather_face_buckets(nchunks, faces);
+	ph_found[do_ridge][do_test] = true;
+	return faces;
+}
+
+
+// Find the principal highlights of the view, before the threshold, and
+// add them to out
+void LineExtractor::find_mesh_ph(bool do_ridge, const vector<float> &ndotv,
+		  bool do_bfcull, bool do_test, ThresholdSegments &out)
+{
+	PROFILE_ZONE(profiler, "principal highlights");
+	const vector<int> &faces = ph_faces(do_ridge, do_test);
+
+	// Walk through the faces in parallel, a chunk at a time
+	int nf = faces.size();
+	int nchunks = (nf + face_chunk - 1) / face_chunk;
+	if (int(threshold_buckets.size()) < nchunks)
+		threshold_buckets.resize(nchunks);
+#pragma omp parallel for schedule(dynamic)
+	for (int c = 0; c < nchunks; c++) {
+		ThresholdSegments &bucket = threshold_buckets[c];
+		bucket.clear();
+		int fend = min(nf, (c + 1) * face_chunk);
+		for (int i = c * face_chunk; i < fend; i++) {
+			const TriMesh::Face &f = themesh->faces[faces[i]];
+			find_face_ph(faces[i], f[0], f[1], f[2], ndotv,
+				     do_bfcull, bucket);
+		}
+	}
+	for (int c = 0; c < nchunks; c++)
+		out.append(threshold_buckets[c]);
+}
+
+
+// Extract principal highlights
+void LineExtractor::extract_mesh_ph(bool do_ridge, const vector<float> &ndotv, bool do_bfcull,
+		  bool do_test, float thresh, SegmentBuffer &out)
+{
+	threshold_segs.clear();
+	find_mesh_ph(do_ridge, ndotv, do_bfcull, do_test, threshold_segs);
+	fade_segments(threshold_segs, thresh, out);
+}
+
+
+// Extract the boundaries on the mesh
+void LineExtractor::extract_boundaries(SegmentBuffer &out)
+{
+	PROFILE_ZONE(profiler, "boundaries");
+
+	themesh->need_faces();
+	themesh->need_across_edge();
+	int nf = themesh->faces.size();
+	for (int i = 0; i < nf; i++) {
+		if (!face_drawn(i))
+			continue;
+		for (int j = 0; j < 3; j++) {
+			if (themesh->across_edge[i][j] >= 0)
+				continue;
+			int v1 = themesh->faces[i][(j+1)%3];
+			int v2 = themesh->faces[i][(j+2)%3];
+			out.add(themesh->vertices[v1], 1.0f,
+				themesh->vertices[v2], 1.0f);
+			// Their ends are at vertices, so aren't chained
+			if (opts.chain_lines)
+				out.add_edges(-1, -1);
+		}
+	}
+}
+
+
+// Extract lines of n.l = const.
+void LineExtractor::extract_isophotes(const vector<float> &ndotv,
+				      SegmentBuffer &terminator,
+				      SegmentBuffer &pos, SegmentBuffer &neg)
+{
+	PROFILE_ZONE(profiler, "isophotes");
+
+	// Light direction
+	vec lightdir = opts.lightdir;
+	if (opts.light_wrt_camera)
+		lightdir = rot_only(inv(xf)) * lightdir;
+
+	// Compute N dot L
+	int nv = themesh->vertices.size();
+	ndotl.resize(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		ndotl[i] = themesh->normals[i] DOT lightdir;
+
+	// Each level only visits the faces the tree says it crosses
+	level_tree.build(themesh, ndotl, &drawn_faces);
+	int niso = opts.niso;
+	float dt = 1.0f / niso;
+	for (int it = 0; it < niso; it++) {
+		level_tree.find(dt * it, level_faces);
+		extract_isolines_on(level_faces, ndotl, dt * it,
+				    vector<float>(), vector<float>(),
+				    ndotv, true, false, false, 0.0f,
+				    it == 0 ? terminator : pos);
+	}
+
+	// Negative isophotes (useful when light is not at camera)
+	for (int it = 1; it < niso; it++) {
+		level_tree.find(-dt * it, level_faces);
+		extract_isolines_on(level_faces, ndotl, -dt * it,
+				    vector<float>(), vector<float>(),
+				    ndotv, true, false, false, 0.0f, neg);
+	}
+}
+
+
+// Extract lines of constant depth
+void LineExtractor::extract_topolines(const vector<float> &ndotv,
+				      SegmentBuffer &out)
+{
+	PROFILE_ZONE(profiler, "topo lines");
+
+	// Camera direction and scale
+	vec camdir(xf[2], xf[6], xf[10]);
+	float depth_scale = 0.5f / themesh->bsphere.r * opts.ntopo;
+	float depth_offset = 0.5f * opts.ntopo - opts.topo_offset;
+
+	// Compute depth
+	int nv = themesh->vertices.size();
+	depth.resize(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		depth[i] = ((themesh->vertices[i] - themesh->bsphere.center)
+			     DOT camdir) * depth_scale + depth_offset;
+	}
+
+	// Extract the topo lines at depth = 0, 1, ...
+	level_tree.build(themesh, depth, &drawn_faces);
+	for (int it = 0; it < opts.ntopo; it++) {
+		level_tree.find(float(it), level_faces);
+		extract_isolines_on(level_faces, depth, float(it),
+				    vector<float>(), vector<float>(),
+				    ndotv, true, false, false, 0.0f, out);
+	}
+}
+
+
+// Chain segments into strokes.  Two ends of segments are linked if they
+// lie on the same mesh edge, seen from the faces on either side of it,
+// and each is the nearest to the other of the ends on the other side -
+// there can be several, for isophotes and topo lines of different
+// levels.  The chains are then walked from their open ends (or anywhere
+// around a loop), keeping the point and alpha of the first of each two
+// linked ends.  Segments without edges become strokes of their own.
+void LineExtractor::chain_segments(const SegmentBuffer &segs,
+				   StrokeBuffer &out)
+{
+	out.clear();
+	int nends = segs.pts.size(), nsegs = nends / 2;
+	chain_link.assign(nends, -1);
+
+	if (nends && int(segs.edges.size()) == nends) {
+		themesh->need_across_edge();
+		int nf = themesh->faces.size();
+		if (int(chain_head.size()) != 3 * nf)
+			chain_head.assign(3 * nf, -1);
+
+		// The ends on each edge, in lists starting at chain_head
+		chain_next.resize(nends);
+		for (int i = 0; i < nends; i++) {
+			int e = segs.edges[i];
+			if (e < 0)
+				continue;
+			chain_next[i] = chain_head[e];
+			chain_head[e] = i;
+		}
+
+		// The nearest end across the edge of each one, in parallel
+#pragma omp parallel for
+		for (int i = 0; i < nends; i++) {
+			int e = segs.edges[i];
+			if (e < 0)
+				continue;
+
+			// The same edge, seen from the face across it
+			int f = e / 3, j = e % 3;
+			int g = themesh->across_edge[f][j];
+			if (g < 0)
+				continue;
+			int a = themesh->faces[f][(j+1)%3];
+			int b = themesh->faces[f][(j+2)%3];
+			const TriMesh::Face &fg = themesh->faces[g];
+			int k = 0;
+			while (k < 3 && (fg[k] == a || fg[k] == b))
+				k++;
+			if (k == 3)
+				continue;
+
+			int best = -1;
+			float bestd2 = 0.0f;
+			for (int c = chain_head[3*g+k]; c >= 0; c = chain_next[c]) {
+				if ((c >> 1) == (i >> 1))
+					continue;
+				float d2 = dist2(segs.pts[i], segs.pts[c]);
+				if (best < 0 || d2 < bestd2)
+					best = c, bestd2 = d2;
+			}
+			chain_link[i] = best;
+		}
+
+		// Keep only the links that go both ways.  Dropping one that
+		// doesn't can't break one that does, so this works in place.
+		for (int i = 0; i < nends; i++) {
+			int j = chain_link[i];
+			if (j >= 0 && chain_link[j] != i)
+				chain_link[i] = -1;
+		}
+
+		// Leave chain_head all -1 for next time
+		for (int i = 0; i < nends; i++)
+			if (segs.edges[i] >= 0)
+				chain_head[segs.edges[i]] = -1;
+	}
+
+	// Walk the chains.  The other end of the segment with end i is i^1.
+	chain_done.assign(nsegs, false);
+	for (int s = 0; s < nsegs; s++) {
+		if (chain_done[s])
+			continue;
+
+		// Back to the open end of the chain, unless it is a loop
+		int first = 2 * s;
+		while (chain_link[first] >= 0) {
+			int prev = chain_link[first] ^ 1;
+			if ((prev >> 1) == s)
+				break;
+			first = prev;
+		}
+
+		out.start.push_back(out.pts.size());
+		out.pts.push_back(segs.pts[first]);
+		out.alpha.push_back(segs.alpha[first]);
+		int i = first;
+		while (i >= 0 && !chain_done[i >> 1]) {
+			chain_done[i >> 1] = true;
+			out.pts.push_back(segs.pts[i ^ 1]);
+			out.alpha.push_back(segs.alpha[i ^ 1]);
+			i = chain_link[i ^ 1];
+		}
+	}
+}
+
+
+// Gaussian curvature K and its tree, if not there already
+void LineExtractor::need_K_tree()
+{
+	if (!K_tree.empty())
+		return;
+	int nv = themesh->vertices.size();
+	K.resize(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		K[i] = themesh->curv1[i] * themesh->curv2[i];
+	K_tree.build(themesh, K, &drawn_faces);
+}
+
+
+// Mean curvature H and its tree, if not there already
+void LineExtractor::need_H_tree()
+{
+	if (!H_tree.empty())
+		return;
+	int nv = themesh->vertices.size();
+	H.resize(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++)
+		H[i] = 0.5f * (themesh->curv1[i] + themesh->curv2[i]);
+	H_tree.build(themesh, H, &drawn_faces);
+}
+
+
+// Do two sets of options ask for the same lines, apart from the
+// thresholds?
+static bool same_but_thresholds(const LineOptions &a, const LineOptions &b)
+{
+	LineOptions a0 = a, b0 = b;
+	a0.sug_thresh = a0.sh_thresh = a0.ph_thresh = 0.0f;
+	a0.rv_thresh = a0.ar_thresh = 0.0f;
+	b0.sug_thresh = b0.sh_thresh = b0.ph_thresh = 0.0f;
+	b0.rv_thresh = b0.ar_thresh = 0.0f;
+	return memcmp(&a0, &b0, sizeof(LineOptions)) == 0;
+}
+
+
+// Extract all the lines requested by the options, with the same tests
+// and thresholds used by the two rendering passes of the viewer.
+// Assumes compute_perview() has been called for the current view.  In a
+// threshold sweep, the families the thresholds don't change are kept,
+// with what the others were extracted from, and reused until the view
+// or the other options change.
+void LineExtractor::extract(LineSet &lines, bool do_hidden)
+{
+	if (!sweeping()) {
+		extract_lines(lines, do_hidden, NULL);
+		return;
+	}
+
+	SweepCache &sweep = sweep_cache[do_hidden];
+	if (!sweep.valid || !(sweep.xf == xf) ||
+	    !same_but_thresholds(sweep.opts, opts)) {
+		extract_lines(sweep.fixed, do_hidden, &sweep);
+		sweep.valid = true;
+		sweep.xf = xf;
+		sweep.opts = opts;
+	}
+	lines = sweep.fixed;
+	apply_thresholds(sweep, do_hidden, lines);
+}
+
+
+// The body of extract().  With sweep, the families the thresholds apply
+// to are left empty, and what they are extracted from goes to sweep.
+void LineExtractor::extract_lines(LineSet &lines, bool do_hidden,
+				  SweepCache *sweep)
+{
+	lines.clear();
+	vector<float> none;
+
+	// Exterior silhouette
+	if (opts.draw_extsil && !do_hidden)
+		extract_isolines(ndotv, none, none, ndotv,
+				 false, false, false, 0.0f,
+				 lines[LINES_SILHOUETTE]);
+
+	// Isophotes and topo lines are only drawn in the main pass
+	if (opts.draw_isoph && !do_hidden)
+		extract_isophotes(ndotv, lines[LINES_TERMINATOR],
+				  lines[LINES_ISOPHOTES],
+				  lines[LINES_NEG_ISOPHOTES]);
+	if (opts.draw_topo && !do_hidden)
+		extract_topolines(ndotv, lines[LINES_TOPO]);
+
+	// K=0, H=0, DwKr=thresh.  K and H don't depend on the view, so
+	// their fields and trees are kept until the mesh changes.
+	if (opts.draw_K) {
+		PROFILE_ZONE(profiler, "K = 0");
+		need_K_tree();
+		K_tree.find(0.0f, level_faces);
+		extract_isolines_on(level_faces, K, 0.0f, none, none, ndotv,
+				    !do_hidden, false, false, 0.0f,
+				    lines[LINES_K]);
+	}
+	if (opts.draw_H) {
+		PROFILE_ZONE(profiler, "H = 0");
+		need_H_tree();
+		H_tree.find(0.0f, level_faces);
+		extract_isolines_on(level_faces, H, 0.0f, none, none, ndotv,
+				    !do_hidden, false, false, 0.0f,
+				    lines[LINES_H]);
+	}
+	if (opts.draw_DwKr && !sweep)
+		extract_isolines(sctest_num, none, none, ndotv,
+				 !do_hidden, false, false, 0.0f,
+				 lines[LINES_DWKR]);
+
+	// Apparent ridges
+	if (opts.draw_apparent && sweep) {
+		sweep->apparent.clear();
+		find_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true, opts.test_ar,
+				     0.0f, sweep->apparent);
+	} else if (opts.draw_apparent) {
+		extract_mesh_app_ridges(ndotv, q1, t1, Dt1q1, true,
+					opts.test_ar,
+					opts.ar_thresh / sqr(feature_size),
+					lines[LINES_APPARENT]);
+	}
+
+	// Ridges and valleys, which only need their threshold applied to
+	// the segments kept for the mesh in any case
+	float rvthresh = opts.rv_thresh / feature_size;
+	if (opts.draw_ridges && !sweep)
+		extract_mesh_ridges(true, ndotv, !do_hidden, opts.test_rv,
+				    rvthresh, lines[LINES_RIDGES]);
+	if (opts.draw_valleys && !sweep)
+		extract_mesh_ridges(false, ndotv, !do_hidden, opts.test_rv,
+				    rvthresh, lines[LINES_VALLEYS]);
+
+	// Principal highlights
+	float phthresh = opts.ph_thresh / sqr(feature_size);
+	if (sweep) {
+		sweep->ph.clear();
+		if (opts.draw_phridges)
+			find_mesh_ph(true, ndotv, !do_hidden, opts.test_ph,
+				     sweep->ph);
+		if (opts.draw_phvalleys)
+			find_mesh_ph(false, ndotv, !do_hidden, opts.test_ph,
+				     sweep->ph);
+	} else {
+		if (opts.draw_phridges)
+			extract_mesh_ph(true, ndotv, !do_hidden, opts.test_ph,
+					phthresh, lines[LINES_PH]);
+		if (opts.draw_phvalleys)
+			extract_mesh_ph(false, ndotv, !do_hidden, opts.test_ph,
+					phthresh, lines[LINES_PH]);
+	}
+
+	// Suggestive highlights
+	float fade = opts.draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
+	if (opts.draw_sh && opts.test_sh && sweep) {
+		sweep->sh.clear();
+		find_isoline_crossings(kr, ndotv, !do_hidden,
+				       opts.use_hermite, sweep->sh);
+	} else if (opts.draw_sh) {
+		extract_isolines(kr, shtest_num, sctest_den, ndotv,
+				 !do_hidden, opts.use_hermite, opts.test_sh,
+				 fade, lines[LINES_SH]);
+	}
+
+	// Suggestive contours and contours
+	if (do_hidden) {
+		if (opts.draw_sc && opts.test_sc && sweep) {
+			sweep->sc.clear();
+			find_isoline_crossings(kr, ndotv, false,
+					       opts.use_hermite, sweep->sc);
+		} else if (opts.draw_sc) {
+			extract_isolines(kr, sctest_num, sctest_den, ndotv,
+					 false, opts.use_hermite, opts.test_sc,
+					 opts.test_sc ? fade : 0.0f,
+					 lines[LINES_SC]);
+		}
+		if (opts.draw_c)
+			extract_isolines(ndotv, kr, none, ndotv,
+					 false, false, opts.test_c, 0.0f,
+					 lines[LINES_C]);
+	} else {
+		// Kr = 0 loops
+		if (opts.draw_sc && !opts.test_sc && !opts.draw_hidden)
+			extract_isolines(kr, sctest_num, sctest_den, ndotv,
+					 true, opts.use_hermite, false, 0.0f,
+					 lines[LINES_KR_ZERO]);
+		if (opts.draw_sc && !opts.use_texture && sweep) {
+			sweep->sc.clear();
+			find_isoline_crossings(kr, ndotv, true,
+					       opts.use_hermite, sweep->sc);
+		} else if (opts.draw_sc && !opts.use_texture) {
+			extract_isolines(kr, sctest_num, sctest_den, ndotv,
+					 true, opts.use_hermite, true, fade,
+					 lines[LINES_SC]);
+		}
+		if (opts.draw_c && !opts.use_texture)
+			extract_isolines(ndotv, kr, none, ndotv,
+					 false, false, true, 0.0f,
+					 lines[LINES_C]);
+	}
+
+	// Boundaries
+	if (opts.draw_bdy)
+		extract_boundaries(lines[LINES_BOUNDARIES]);
+
+	// Strokes
+	if (opts.chain_lines) {
+		PROFILE_ZONE(profiler, "chain lines");
+		for (int i = 0; i < NUM_LINE_FAMILIES; i++)
+			if (!lines[i].empty())
+				chain_segments(lines[i], lines.strokes[i]);
+	}
+}
+
+
+// Apply the thresholds to what extract_lines() kept in sweep, and add the
+// resulting families to lines
+void LineExtractor::apply_thresholds(const SweepCache &sweep, bool do_hidden,
+				     LineSet &lines)
+{
+	PROFILE_ZONE(profiler, "thresholds");
+	vector<float> none;
+	float scthresh = opts.sug_thresh / sqr(feature_size);
+	float shthresh = opts.sh_thresh / sqr(feature_size);
+
+	// DwKr = thresh moves with the threshold, so it has to be found
+	// again, but only its own field is recomputed
+	if (opts.draw_DwKr) {
+		int nv = themesh->vertices.size();
+		DwKr.resize(nv);
+#pragma omp parallel for
+		for (int i = 0; i < nv; i++)
+			DwKr[i] = sctest_num[i] - scthresh * sctest_den[i];
+		extract_isolines(DwKr, none, none, ndotv,
+				 !do_hidden, false, false, 0.0f,
+				 lines[LINES_DWKR]);
+	}
+
+	if (opts.draw_apparent)
+		fade_segments(sweep.apparent,
+			      opts.ar_thresh / sqr(feature_size),
+			      lines[LINES_APPARENT]);
+
+	float rvthresh = opts.rv_thresh / feature_size;
+	if (opts.draw_ridges)
+		extract_mesh_ridges(true, ndotv, !do_hidden, opts.test_rv,
+				    rvthresh, lines[LINES_RIDGES]);
+	if (opts.draw_valleys)
+		extract_mesh_ridges(false, ndotv, !do_hidden, opts.test_rv,
+				    rvthresh, lines[LINES_VALLEYS]);
+
+	if (opts.draw_phridges || opts.draw_phvalleys)
+		fade_segments(sweep.ph, opts.ph_thresh / sqr(feature_size),
+			      lines[LINES_PH]);
+
+	// The tests of suggestive highlights and contours are done again on
+	// the crossings, with the new thresholds
+	float fade = opts.draw_faded ? 0.03f / sqr(feature_size) : 0.0f;
+	if (opts.draw_sh && opts.test_sh)
+		extract_crossings(sweep.sh, shtest_num, sctest_den, shthresh,
+				  fade, lines[LINES_SH]);
+	if (opts.draw_sc && (opts.test_sc || !do_hidden))
+		extract_crossings(sweep.sc, sctest_num, sctest_den, scthresh,
+				  fade, lines[LINES_SC]);
+
+	if (opts.chain_lines) {
+		PROFILE_ZONE(profiler, "chain lines");
+		static const int families[] = {
+			LINES_DWKR, LINES_APPARENT, LINES_RIDGES,
+			LINES_VALLEYS, LINES_PH, LINES_SH, LINES_SC
+		};
+		const int nfamilies = sizeof(families) / sizeof(families[0]);
+		for (int i = 0; i < nfamilies; i++) {
+			int family = families[i];
+			if (!lines[family].empty())
+				chain_segments(lines[family],
+					       lines.strokes[family]);
+		}
+	}
+}
+
+
+// Compute everything the extractor needs on a freshly-loaded mesh
+float prepare_mesh(TriMesh *mesh, const char *cachename, bool reorder,
+		   float stored_feature_size)
+{
+	mesh->need_faces();
+
+	// The bounding sphere is found in the mesh's own order, as convert
+	// and OutOfCoreMesh find it, since Miniball's roundoff depends on it
+	mesh->need_bsphere();
+
+	// Only a mesh with nothing computed yet is renumbered, so that one
+	// read from a prepared .ldm file is left as it was stored
+	vector<int> remap;
+	bool reordered = (reorder && mesh->normals.empty());
+	if (reordered)
+		reorder_mesh_locality(mesh, &remap);
+
+	unsigned long long hash = 0;
+	float feature_size;
+	if (cachename) {
+		hash = mesh_hash(mesh);
+		if (read_mesh_cache(cachename, hash, mesh, feature_size))
+			return stored_feature_size ? stored_feature_size :
+						     feature_size;
+	}
+
+	mesh->need_tstrips();
+	mesh->need_normals();
+	mesh->need_curvatures();
+	mesh->need_dcurv();
+	feature_size = stored_feature_size ? stored_feature_size :
+		mesh_feature_size(mesh, reordered ? &remap : NULL);
+
+	if (cachename)
+		write_mesh_cache(cachename, hash, mesh, feature_size);
+	return feature_size;
+}
@@ -0,0 +1,637 @@
+/*
+lineextractor.h
+Extraction of the lines drawn by rtsc, independent of Qt and OpenGL.
+
+LineExtractor holds a mesh and a view, computes the per-view quantities
+(n dot v, radial curvature, ...) and writes each family of lines into a
+SegmentBuffer instead of emitting glVertex calls, so that the same code
+drives the viewer and the headless batch renderer.  Optionally, the
+segments of each family are also chained into polylines (a StrokeBuffer)
+by linking the ends that cross the same mesh edge.
+*/
+
+#ifndef LINEEXTRACTOR_H
+#define LINEEXTRACTOR_H
+
+#include <vector>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "perview.h"
+#include "isotree.h"
+#include "profiler.h"
+
+
+// A list of line segments.  Segment i runs from pts[2*i] to pts[2*i+1],
+// and alpha holds the opacity (fade) at each of those endpoints.  When
+// the lines are being chained, edges holds the mesh edge each endpoint
+// lies on, as 3 * face + the index in the face of the vertex opposite
+// the edge (as in across_edge), or -1 if it isn't on an edge.
+struct SegmentBuffer {
+	std::vector<point> pts;
+	std::vector<float> alpha;
+	std::vector<int> edges;
+
+	int size() const { return pts.size() / 2; }
+	bool empty() const { return pts.empty(); }
+	void clear() { pts.clear(); alpha.clear(); edges.clear(); }
+	void add(const point &p0, float a0, const point &p1, float a1)
+	{
+		pts.push_back(p0); alpha.push_back(a0);
+		pts.push_back(p1); alpha.push_back(a1);
+	}
+	void add_edges(int e0, int e1)
+	{
+		edges.push_back(e0); edges.push_back(e1);
+	}
+	void append(const SegmentBuffer &b)
+	{
+		pts.insert(pts.end(), b.pts.begin(), b.pts.end());
+		alpha.insert(alpha.end(), b.alpha.begin(), b.alpha.end());
+		edges.insert(edges.end(), b.edges.begin(), b.edges.end());
+	}
+};
+
+
+// A list of polylines sharing one pool of points.  Stroke i runs through
+// pts[start[i]] to pts[start[i+1]-1] (or to the last point, for the last
+// stroke); a closed loop ends with its first point again.  alpha is the
+// opacity at each point.
+struct StrokeBuffer {
+	std::vector<point> pts;
+	std::vector<float> alpha;
+	std::vector<int> start;
+
+	int size() const { return start.size(); }
+	bool empty() const { return start.empty(); }
+	void clear() { pts.clear(); alpha.clear(); start.clear(); }
+	int stroke_begin(int i) const { return start[i]; }
+	int stroke_end(int i) const
+	{
+		return i + 1 < (int) start.size() ? start[i+1] : pts.size();
+	}
+};
+
+
+// Ridge or valley segments, which don't depend on the view: the two ends
+// of each, the curvature there before the threshold is taken off, the
+// mesh edge each end is on (as in SegmentBuffer), and the face.
+struct RidgeSegments {
+	std::vector<point> pts;
+	std::vector<float> k;
+	std::vector<int> edges;
+	std::vector<int> faces;
+
+	int size() const { return faces.size(); }
+	void clear() { pts.clear(); k.clear(); edges.clear(); faces.clear(); }
+	void add(int face, const point &p0, float k0, int e0,
+		 const point &p1, float k1, int e1)
+	{
+		pts.push_back(p0); k.push_back(k0); edges.push_back(e0);
+		pts.push_back(p1); k.push_back(k1); edges.push_back(e1);
+		faces.push_back(face);
+	}
+};
+
+
+// Segments of principal highlights or apparent ridges, found for one view
+// before the threshold is applied: the two ends of each, the curvature
+// there (which the threshold is taken off), and the mesh edge each end is
+// on (as in SegmentBuffer).  Segment i is visible for thresholds below
+// limit[i].
+struct ThresholdSegments {
+	std::vector<point> pts;
+	std::vector<float> k;
+	std::vector<int> edges;
+	std::vector<float> limit;
+
+	int size() const { return limit.size(); }
+	void clear() { pts.clear(); k.clear(); edges.clear(); limit.clear(); }
+	void add(const point &p0, float k0, int e0,
+		 const point &p1, float k1, int e1, float lim)
+	{
+		pts.push_back(p0); k.push_back(k0); edges.push_back(e0);
+		pts.push_back(p1); k.push_back(k1); edges.push_back(e1);
+		limit.push_back(lim);
+	}
+	void append(const ThresholdSegments &b)
+	{
+		pts.insert(pts.end(), b.pts.begin(), b.pts.end());
+		k.insert(k.end(), b.k.begin(), b.k.end());
+		edges.insert(edges.end(), b.edges.begin(), b.edges.end());
+		limit.insert(limit.end(), b.limit.begin(), b.limit.end());
+	}
+};
+
+
+// The faces an isoline crosses in one view, before its test is applied:
+// for each, its vertices in the order extract_face_isoline2 takes them,
+// and how far along edges v0-v1 and v0-v2 the crossings are.
+struct IsolineCrossings {
+	std::vector<int> faces, verts;
+	std::vector<float> w;
+
+	int size() const { return faces.size(); }
+	void clear() { faces.clear(); verts.clear(); w.clear(); }
+	void add(int face, int v0, int v1, int v2, float w10, float w20)
+	{
+		faces.push_back(face);
+		verts.push_back(v0); verts.push_back(v1); verts.push_back(v2);
+		w.push_back(w10); w.push_back(w20);
+	}
+	void append(const IsolineCrossings &b)
+	{
+		faces.insert(faces.end(), b.faces.begin(), b.faces.end());
+		verts.insert(verts.end(), b.verts.begin(), b.verts.end());
+		w.insert(w.end(), b.w.begin(), b.w.end());
+	}
+};
+
+
+// The families of lines produced by LineExtractor::extract
+enum LineFamily {
+	LINES_SILHOUETTE,	// Exterior silhouette (untested contours)
+	LINES_TERMINATOR,	// The n.l = 0 isophote
+	LINES_ISOPHOTES,	// Lines of n.l = const > 0
+	LINES_NEG_ISOPHOTES,	// Lines of n.l = const < 0
+	LINES_TOPO,		// Lines of constant depth
+	LINES_K,		// K = 0
+	LINES_H,		// H = 0
+	LINES_DWKR,		// DwKr = thresh
+	LINES_APPARENT,		// Apparent ridges
+	LINES_RIDGES,		// Ridges
+	LINES_VALLEYS,		// Valleys
+	LINES_PH,		// Principal highlights (ridges and valleys)
+	LINES_SH,		// Suggestive highlights
+	LINES_KR_ZERO,		// Kr = 0 loops (untested suggestive contours)
+	LINES_SC,		// Suggestive contours
+	LINES_C,		// Contours
+	LINES_BOUNDARIES,	// Mesh boundaries
+	NUM_LINE_FAMILIES
+};
+
+// Short names of the above, as used on the linedrawing-batch command line
+extern const char *line_family_names[NUM_LINE_FAMILIES];
+
+
+// One SegmentBuffer per line family, and the same lines as strokes if
+// they were chained
+struct LineSet {
+	SegmentBuffer lines[NUM_LINE_FAMILIES];
+	StrokeBuffer strokes[NUM_LINE_FAMILIES];
+
+	SegmentBuffer &operator [] (int i) { return lines[i]; }
+	const SegmentBuffer &operator [] (int i) const { return lines[i]; }
+	void clear()
+	{
+		for (int i = 0; i < NUM_LINE_FAMILIES; i++) {
+			lines[i].clear();
+			strokes[i].clear();
+		}
+	}
+};
+
+
+// Which lines to extract, and the tests and thresholds applied to them.
+// The defaults are those of the rtsc viewer.
+struct LineOptions {
+	// Toggles for drawing various lines
+	int draw_extsil, draw_c, draw_sc;
+	int draw_sh, draw_phridges, draw_phvalleys;
+	int draw_ridges, draw_valleys, draw_apparent;
+	int draw_K, draw_H, draw_DwKr;
+	int draw_bdy, draw_isoph, draw_topo;
+	int niso, ntopo;
+	float topo_offset;
+
+	// Toggles for tests we perform.  draw_hidden only matters for
+	// the Kr = 0 loops, which are left out when hidden lines are drawn.
+	int draw_hidden;
+	int test_c, test_sc, test_sh, test_ph, test_rv, test_ar;
+	float sug_thresh, sh_thresh, ph_thresh;
+	float rv_thresh, ar_thresh;
+
+	// Toggles for style
+	int draw_faded;
+	int use_hermite;
+	// Contours and suggestive contours are drawn using texture mapping,
+	// which wants sctest_num scaled by an extra sin^2 theta
+	int use_texture;
+
+	// Light direction for isophotes: either in camera coordinates
+	// (if light_wrt_camera) or in mesh coordinates
+	vec lightdir;
+	int light_wrt_camera;
+
+	// Temporal coherence: when the view moves a little, only recompute
+	// the per-view quantities of vertices where they could have changed
+	// sign, or where the view direction has turned by more than
+	// coherence_slack.  Not used with apparent ridges.
+	int coherent;
+	float coherence_slack;
+
+	// Also chain the segments of each family into strokes
+	int chain_lines;
+
+	// Threshold sweep: keep what the lines of the current view were
+	// extracted from before the thresholds were applied, so that when
+	// only sug_thresh, sh_thresh, ph_thresh, rv_thresh or ar_thresh
+	// change, compute_perview() does nothing and extract() just applies
+	// them again.  Not used with use_texture.
+	int threshold_sweep;
+
+	LineOptions();
+};
+
+
+class LineExtractor {
+public:
+	LineExtractor();
+
+	// Set the mesh.  It should have been prepared with prepare_mesh(),
+	// whose result can be passed as the feature size (which makes
+	// thresholds dimensionless); otherwise it is computed here.
+	void set_mesh(TriMesh *mesh, float feature_size = 0.0f);
+	// Let the extractor know that the mesh's vertices, normals, or
+	// curvatures have changed, e.g. after smoothing or subdivision
+	void mesh_changed();
+	// Set the camera: xf maps mesh coordinates to camera coordinates
+	void set_view(const xform &xf);
+	// Set the options used by compute_perview() and extract()
+	void set_options(const LineOptions &opts);
+	// Compute what the lines of every view share: the candidate faces
+	// of ridges, valleys and principal highlights, the K and H trees, and
+	// the mesh connectivity the options need.  After this, copies of the
+	// extractor can work on different views at the same time (see
+	// multiview.h).
+	void prepare_views();
+
+	// Compute per-vertex n dot v, radial curvature, and
+	// derivative of curvature for the current view
+	void compute_perview();
+	// Extract all the lines requested by the options, using the
+	// per-view quantities from the last compute_perview().  With
+	// do_hidden, extracts the lines for the hidden-line pass instead
+	// of the main one.
+	void extract(LineSet &lines, bool do_hidden = false);
+
+	// Takes a scalar field and finds the zero crossings, but only where
+	// test_num/test_den is greater than 0.  Only the faces on which val
+	// changes sign are visited.
+	void extract_isolines(const std::vector<float> &val,
+			      const std::vector<float> &test_num,
+			      const std::vector<float> &test_den,
+			      const std::vector<float> &ndotv,
+			      bool do_bfcull, bool do_hermite,
+			      bool do_test, float fade, SegmentBuffer &out);
+	// Extract the ridges (valleys) of the mesh
+	void extract_mesh_ridges(bool do_ridge, const std::vector<float> &ndotv,
+				 bool do_bfcull, bool do_test, float thresh,
+				 SegmentBuffer &out);
+	// Extract principal highlights
+	void extract_mesh_ph(bool do_ridge, const std::vector<float> &ndotv,
+			     bool do_bfcull, bool do_test, float thresh,
+			     SegmentBuffer &out);
+	// Extract apparent ridges of the mesh
+	void extract_mesh_app_ridges(const std::vector<float> &ndotv,
+				     const std::vector<float> &q1,
+				     const std::vector<vec2> &t1,
+				     const std::vector<float> &Dt1q1,
+				     bool do_bfcull, bool do_test, float thresh,
+				     SegmentBuffer &out);
+	// Extract the boundaries of the mesh
+	void extract_boundaries(SegmentBuffer &out);
+	// Extract lines of n.l = const.  The n.l = 0 line goes to
+	// terminator, the others to pos and neg.
+	void extract_isophotes(const std::vector<float> &ndotv,
+			       SegmentBuffer &terminator,
+			       SegmentBuffer &pos, SegmentBuffer &neg);
+	// Extract lines of constant depth
+	void extract_topolines(const std::vector<float> &ndotv,
+			       SegmentBuffer &out);
+	// Chain segments extracted with chain_lines on into strokes: two
+	// ends are joined if they lie on the two sides of a mesh edge
+	void chain_segments(const SegmentBuffer &segs, StrokeBuffer &out);
+
+public:
+	TriMesh *themesh;
+	LineOptions opts;
+	xform xf;
+	point viewpos;		// Current view position
+	float feature_size;	// Used to make thresholds dimensionless
+	// If not empty, lines are only extracted on the faces i with
+	// drawn_faces[i] set, e.g. to leave out the halo around one piece of
+	// a larger mesh (see outofcore.h).  Set it before set_mesh().
+	std::vector<char> drawn_faces;
+
+	// Per-view quantities, valid after compute_perview()
+	std::vector<float> ndotv, kr;
+	std::vector<float> sctest_num, sctest_den, shtest_num;
+	std::vector<float> q1, Dt1q1;
+	std::vector<vec2> t1;
+	// Number of vertices compute_perview() last recomputed
+	int perview_recomputed;
+	// If set, the stages of compute_perview() and extract() are timed
+	// as zones of the current frame
+	FrameProfiler *profiler;
+
+private:
+	// Fields for isophotes, topo lines, and K=0/H=0
+	std::vector<float> ndotl, depth, K, H;
+	// Per-vertex mesh data in the layout used by the perview kernels,
+	// which run on blocks of this many vertices in parallel
+	PerviewPack pack;
+	static const int perview_block = 1024;
+
+	// For temporal coherence: the view position each vertex's per-view
+	// quantities were computed from, the square of how far the view can
+	// move from there before they need recomputing, and the parameters
+	// they were computed with
+	std::vector<point> perview_from;
+	std::vector<float> perview_radius2;
+	PerviewArgs coherent_args;
+	float coherent_slack;
+	bool same_perview_params(const PerviewArgs &args) const;
+	int update_perview(const PerviewArgs &args, int begin, int end,
+			   bool all, PerviewKernel kernel);
+	// For threshold sweeps: the view position and parameters of the
+	// last compute_perview(), if it can be skipped when they are the same
+	bool perview_valid;
+	point perview_pos;
+	PerviewArgs perview_args;
+	int perview_apparent;
+
+	// For threshold sweeps: what the lines of the last view were
+	// extracted from, for the main and the hidden-line pass.  fixed
+	// holds the families the thresholds don't change.
+	struct SweepCache {
+		bool valid;
+		xform xf;
+		LineOptions opts;
+		LineSet fixed;
+		ThresholdSegments apparent, ph;
+		IsolineCrossings sc, sh;
+		SweepCache() : valid(false) {}
+	};
+	SweepCache sweep_cache[2];
+	// The field whose zeros are DwKr = thresh, when the per-view
+	// quantities were computed without the threshold
+	std::vector<float> DwKr;
+	bool sweeping() const
+	{
+		return opts.threshold_sweep && !opts.use_texture;
+	}
+	// Extract the lines, or with sweep, everything but the families the
+	// thresholds apply to, whose segments or crossings go to sweep
+	void extract_lines(LineSet &lines, bool do_hidden, SweepCache *sweep);
+	// Add the families the thresholds apply to from sweep
+	void apply_thresholds(const SweepCache &sweep, bool do_hidden,
+			      LineSet &lines);
+
+	// Are lines extracted on face i?
+	bool face_drawn(int i) const
+		{ return drawn_faces.empty() || drawn_faces[i]; }
+
+	// Faces are processed in parallel in chunks of this many, each of
+	// which writes into its own bucket
+	static const int face_chunk = 2048;
+	std::vector<SegmentBuffer> buckets;
+	int start_buckets(int nf);
+	void gather_buckets(int nchunks, SegmentBuffer &out);
+	// The same for segments before their threshold, and isoline crossings
+	std::vector<ThresholdSegments> threshold_buckets;
+	std::vector<IsolineCrossings> crossing_buckets;
+	ThresholdSegments threshold_segs;
+	// Add the segments visible with thresh to out, faded
+	void fade_segments(const ThresholdSegments &segs, float thresh,
+			   SegmentBuffer &out);
+
+	// Candidate faces for the isolines being extracted: those on which
+	// a field changes sign, found a chunk at a time into face_buckets,
+	// and those crossed by one level of a field in an IsoTree
+	std::vector<int> isoline_faces, level_faces;
+	std::vector< std::vector<int> > face_buckets;
+	void find_isoline_faces(const std::vector<float> &val,
+				std::vector<int> &faces);
+	void gather_face_buckets(int nchunks, std::vector<int> &faces);
+	// The segments of the ridges and valleys, and the faces principal
+	// highlights might cross, for each [do_ridge][do_test], which don't
+	// depend on the view.  They are found when first needed, and kept
+	// until the mesh changes.
+	RidgeSegments rv_segments[2][2];
+	std::vector<int> ph_candidates[2][2];
+	bool rv_found[2][2], ph_found[2][2];
+	const RidgeSegments &ridge_segments(bool do_ridge, bool do_test);
+	const std::vector<int> &ph_faces(bool do_ridge, bool do_test);
+	// The faces crossed by ridges (valleys), as 4 * face +
+	// ridge_face_kind()
+	void find_ridge_faces(bool do_ridge, bool do_test,
+			      std::vector<int> &faces);
+	void candidates_changed();
+	// Trees for the isophote or topo field of the current view, and for
+	// K and H, which are kept until the mesh changes
+	IsoTree level_tree, K_tree, H_tree;
+	void need_K_tree();
+	void need_H_tree();
+	// Find the crossings of val = level on the given faces.  If
+	// crossings isn't NULL, they go there instead of out, before the
+	// test.
+	void extract_isolines_on(const std::vector<int> &faces,
+				 const std::vector<float> &val, float level,
+				 const std::vector<float> &test_num,
+				 const std::vector<float> &test_den,
+				 const std::vector<float> &ndotv,
+				 bool do_bfcull, bool do_hermite,
+				 bool do_test, float fade, SegmentBuffer &out,
+				 IsolineCrossings *crossings = NULL);
+	// The same, placing the crossings by Hermite interpolation.  The
+	// faces that pass the test are found first, a chunk at a time into
+	// hermite_buckets (their vertices) and hermite_faces, then the
+	// gradient of kr at their vertices, then the crossings on each
+	// chunk's faces all together.
+	std::vector< std::vector<int> > hermite_buckets, hermite_faces;
+	void extract_isolines_hermite(const std::vector<int> &faces,
+				      const std::vector<float> &val, float level,
+				      const std::vector<float> &test_num,
+				      const std::vector<float> &test_den,
+				      const std::vector<float> &ndotv,
+				      bool do_bfcull, bool do_test, float fade,
+				      SegmentBuffer &out,
+				      IsolineCrossings *crossings);
+	// The crossings of the zeros of val, before any test
+	void find_isoline_crossings(const std::vector<float> &val,
+				    const std::vector<float> &ndotv,
+				    bool do_bfcull, bool do_hermite,
+				    IsolineCrossings &out);
+	// Extract the segments on the crossings where test_num - thresh *
+	// test_den has the sign of test_den
+	void extract_crossings(const IsolineCrossings &crossings,
+			       const std::vector<float> &test_num,
+			       const std::vector<float> &test_den,
+			       float thresh, float fade, SegmentBuffer &out);
+
+	// The gradient of (kr * sin^2 theta), for Hermite interpolation:
+	// computed once per view for each vertex in the first nlists lists
+	// that doesn't have it yet, and kept in gradkr_cache.  Vertex i's is
+	// current if gradkr_stamp[i] is gradkr_view, which changes with the
+	// view.
+	std::vector<vec> gradkr_cache;
+	std::vector<unsigned> gradkr_stamp;
+	unsigned gradkr_view;
+	std::vector<int> gradkr_verts;
+	void need_gradkr(const std::vector< std::vector<int> > &lists,
+			 int nlists);
+	void gradkr_changed();
+	// For chaining: the edge of face opposite vertex v, in the form
+	// used by SegmentBuffer::edges.  chain_head has an entry for each
+	// such edge, all -1 between calls to chain_segments.
+	int face_edge(int face, int v) const
+	{
+		const TriMesh::Face &f = themesh->faces[face];
+		return 3 * face + (f[0] == v ? 0 : f[1] == v ? 1 : 2);
+	}
+	std::vector<int> chain_head, chain_next, chain_link;
+	std::vector<bool> chain_done;
+	// Find a zero crossing between val0 and val1 by linear interpolation
+	// Returns 0 if zero crossing is at val0, 1 if at val1, etc.
+	static inline float find_zero_linear(float val0, float val1);
+	// Is test_num/test_den negative (or 0) at all three vertices, with
+	// thresh * test_den taken off test_num?
+	bool face_test_fails(int v0, int v1, int v2,
+			     const std::vector<float> &test_num,
+			     const std::vector<float> &test_den,
+			     float thresh) const;
+	// Decide whether to extract the isoline val = level on a face: not
+	// if it is backface culled, or the test is negative at all three
+	// vertices.  Otherwise returns which of v0, v1, v2 (0, 1 or 2) has
+	// a value with a different sign from the other two.
+	int isoline_face_corner(int v0, int v1, int v2,
+				const std::vector<float> &val, float level,
+				const std::vector<float> &test_num,
+				const std::vector<float> &test_den,
+				const std::vector<float> &ndotv,
+				bool do_bfcull, bool do_test);
+	// Extract part of a zero-crossing curve on one triangle face, but
+	// only if "test_num/test_den" is positive.  v0,v1,v2 are the indices
+	// of the 3 vertices of face, v0 being the one whose value has a
+	// different sign from the other two, and w10 and w20 are how far
+	// along edges v0-v1 and v0-v2 the zero crossings are.  "test_*" are the values
+	// we are testing to make sure they are positive, after taking
+	// thresh * test_den off test_num.
+	void extract_face_isoline2(int face, int v0, int v1, int v2,
+				   float w10, float w20,
+				   const std::vector<float> &test_num,
+				   const std::vector<float> &test_den,
+				   float thresh, bool do_test, float fade,
+				   SegmentBuffer &out);
+	// Find part of a ridge/valley curve on one triangle face: its ends
+	// and the curvature there.  v0,v1,v2 are the indices of its 3
+	// vertices; this function assumes that the curve connects points on
+	// the edges v0-v1 and v1-v2 (or connects point on v0-v1 to center if
+	// to_center is true)
+	void find_segment_ridge(int v0, int v1, int v2,
+				float emax0, float emax1, float emax2,
+				float kmax0, float kmax1, float kmax2,
+				bool to_center, point &p01, float &k01,
+				point &p12, float &k12) const;
+	// The same, added to segs with the curvature of dcurv and curv1
+	void add_segment_ridge(int face, int v0, int v1, int v2,
+			       bool to_center, RidgeSegments &segs) const;
+	// Which segments of the ridges or valleys (depending on do_ridge)
+	// cross a triangle: -1 if none, 0, 1 or 2 if they connect the edges
+	// other than v1-v2, v2-v0 or v0-v1, 3 if all three edges are
+	// connected to the center.  do_test checks for curvature
+	// maxima/minima.  Algorithm based on formulas of Ohtake et al., 2004.
+	int ridge_face_kind(int v0, int v1, int v2, bool do_ridge,
+			    bool do_test) const;
+	// Find the segments of a given kind in a triangle
+	void find_face_ridges(int face, int v0, int v1, int v2, int kind,
+			      RidgeSegments &segs) const;
+	// Might principal highlights cross a triangle, as far as can be
+	// told without the view?
+	bool ph_face_candidate(int v0, int v1, int v2, bool do_ridge,
+			       bool do_test) const;
+	// Orient the principal directions of a triangle by the one with
+	// the largest curvature; false if they turn by more than 45 degrees
+	bool ph_face_directions(int v0, int v1, int v2,
+				vec &d0, vec &d1, vec &d2) const;
+	// Find principal highlights on a face that is a candidate
+	void find_face_ph(int face, int v0, int v1, int v2,
+			  const std::vector<float> &ndotv, bool do_bfcull,
+			  ThresholdSegments &out);
+	// Find the principal highlights of the view, before the threshold
+	void find_mesh_ph(bool do_ridge, const std::vector<float> &ndotv,
+			  bool do_bfcull, bool do_test, ThresholdSegments &out);
+
+	// apparentridge.cpp
+	// Compute principal view-dependent curvatures and directions at
+	// vertex i.  ndotv = cosine of angle between normal and view
+	// direction, (u,v) = coordinates of w (projected view) in principal
+	// coordinates.  Pass in u^2, u*v, and v^2, since those are readily
+	// available.  Fills in q1 and t1 (using the paper's notation).
+	// Note that the latter is expressed in the (pdir1,pdir2) basis
+	void compute_viewdep_curv(const TriMesh *mesh, int i, float ndotv,
+				  float u2, float uv, float v2,
+				  float &q1, vec2 &t1);
+	// Compute D_{t_1} q_1 - the derivative of max view-dependent
+	// curvature in the principal max view-dependent curvature direction.
+	void compute_Dt1q1(const TriMesh *mesh, int i, float ndotv,
+			   const std::vector<float> &q1,
+			   const std::vector<vec2> &t1, float &Dt1q1);
+	// Find part of an apparent ridge/valley curve on one triangle
+	// face, before the threshold.  v0,v1,v2 are the indices of its 3
+	// vertices; this function assumes that the curve connects points
+	// on the edges v0-v1 and v1-v2 (or connects point on v0-v1 to
+	// center if to_center is true).  It is visible for thresholds
+	// below both limit and the curvature at one of its ends.
+	void find_segment_app_ridge(int face, int v0, int v1, int v2,
+				    float emax0, float emax1, float emax2,
+				    float kmax0, float kmax1, float kmax2,
+				    const vec &tmax0, const vec &tmax1,
+				    const vec &tmax2, float limit,
+				    bool to_center, bool do_test,
+				    ThresholdSegments &out);
+	// Find apparent ridges in a triangle, unless they are all below
+	// the threshold reject
+	void find_face_app_ridges(int face, int v0, int v1, int v2,
+				  const std::vector<float> &ndotv,
+				  const std::vector<float> &q1,
+				  const std::vector<vec2> &t1,
+				  const std::vector<float> &Dt1q1,
+				  bool do_bfcull, bool do_test, float reject,
+				  ThresholdSegments &out);
+	// Find the apparent ridges of the view, before the threshold
+	void find_mesh_app_ridges(const std::vector<float> &ndotv,
+				  const std::vector<float> &q1,
+				  const std::vector<vec2> &t1,
+				  const std::vector<float> &Dt1q1,
+				  bool do_bfcull, bool do_test, float reject,
+				  ThresholdSegments &out);
+};
+
+
+// Compute a "feature size" for the mesh: computed as 1% of
+// the reciprocal of the 10-th percentile curvature.  If the mesh has
+// been reordered, passing the remap keeps the result the same.
+extern float mesh_feature_size(TriMesh *mesh,
+			       const std::vector<int> *remap = NULL);
+// The same in two steps, for meshes that aren't in memory all at once
+// (see outofcore.h): the vertices, out of nv, it samples, and the
+// feature size given the absolute values of both curvatures at each of
+// them (which get reordered) and the radius of the bounding sphere
+extern void feature_size_samples(int nv, std::vector<int> &which);
+extern float feature_size_of_samples(std::vector<float> &samples, float r);
+
+// Compute everything the extractor needs on a freshly-loaded mesh:
+// faces, triangle strips, bounding sphere, normals, curvatures and dcurv.
+// Unless reorder is false, the mesh is first renumbered for locality
+// (see reorder_mesh_locality in TriMesh_algo.h).
+// If cachename is given, these are read from that cache file when it
+// matches the mesh, and written to it otherwise (see meshcache.h).
+// Returns the feature size of the mesh: stored_feature_size, if it isn't
+// 0 (as read_mesh finds in a prepared .ldm file, whose vertices have been
+// reordered already), and otherwise the one mesh_feature_size finds.
+extern float prepare_mesh(TriMesh *mesh, const char *cachename = NULL,
+			  bool reorder = true,
+			  float stored_feature_size = 0.0f);
+
+#endif
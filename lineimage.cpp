@@ -0,0 +1,387 @@
+/*
+lineimage.cpp
+Line drawings rendered on the CPU: see lineimage.h.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include "lineimage.h"
+
+using namespace std;
+
+// Size of the tiles lines are binned into, in pixels
+#define LINE_TILE 32
+
+
+void LineImage::clear(int width_, int height_, const vec &color)
+{
+	width = max(width_, 0);
+	height = max(height_, 0);
+	rgb.resize(3 * width * height);
+	for (int i = 0; i < width * height; i++) {
+		rgb[3*i  ] = color[0];
+		rgb[3*i+1] = color[1];
+		rgb[3*i+2] = color[2];
+	}
+}
+
+
+void LineImage::fill_mesh(const DepthBuffer &depth, const vec &color)
+{
+	int w = min(width, depth.width / depth.oversample);
+	int h = min(height, depth.height / depth.oversample);
+#pragma omp parallel for
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			float c = depth.coverage(x, y);
+			if (c == 0.0f)
+				continue;
+			float *p = &rgb[3 * (y * width + x)];
+			p[0] += c * (color[0] - p[0]);
+			p[1] += c * (color[1] - p[1]);
+			p[2] += c * (color[2] - p[2]);
+		}
+	}
+}
+
+
+// A segment, in pixels
+struct LineSegment {
+	float x0, y0, q0, a0;
+	float x1, y1, q1, a1;
+	int ixmin, ixmax, iymin, iymax;	// Pixels it might touch
+};
+
+
+// Draw the part of a segment within [x0, x1) x [y0, y1).  The coverage of
+// a pixel falls off over one pixel across the edge of the line, which has
+// round ends.
+static void raster_segment(const LineSegment &s, float halfwidth,
+			   const vec &color, const DepthBuffer *depth,
+			   int x0, int x1, int y0, int y1, int width,
+			   float *rgb)
+{
+	float dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+	float len2 = sqr(dx) + sqr(dy);
+	float rlen2 = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+
+	int ixmin = max(s.ixmin, x0), ixmax = min(s.ixmax, x1 - 1);
+	int iymin = max(s.iymin, y0), iymax = min(s.iymax, y1 - 1);
+	for (int iy = iymin; iy <= iymax; iy++) {
+		float py = iy + 0.5f;
+		for (int ix = ixmin; ix <= ixmax; ix++) {
+			float px = ix + 0.5f;
+			float t = ((px - s.x0) * dx + (py - s.y0) * dy) * rlen2;
+			t = min(max(t, 0.0f), 1.0f);
+			float d = sqrt(sqr(s.x0 + t * dx - px) +
+				       sqr(s.y0 + t * dy - py));
+			float cov = min(halfwidth + 0.5f - d, 1.0f);
+			if (cov <= 0.0f)
+				continue;
+			if (depth &&
+			    !depth->visible(px, py, s.q0 + t * (s.q1 - s.q0)))
+				continue;
+			float alpha = cov * (s.a0 + t * (s.a1 - s.a0));
+			float *p = rgb + 3 * (iy * width + ix);
+			p[0] += alpha * (color[0] - p[0]);
+			p[1] += alpha * (color[1] - p[1]);
+			p[2] += alpha * (color[2] - p[2]);
+		}
+	}
+}
+
+
+void LineImage::draw_lines(const SegmentBuffer &segs, const LineStyle &style,
+			   const ScreenProjection &proj,
+			   const DepthBuffer *depth)
+{
+	int n = segs.size();
+	if (!n || !width || !height)
+		return;
+	float halfwidth = 0.5f * style.width;
+	float reach = halfwidth + 1.0f;
+
+	// Project the segments, and find the pixels each might touch
+	vector<LineSegment> lsegs(n);
+	vector<char> drawn(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		LineSegment &s = lsegs[i];
+		s.q0 = proj.project(segs.pts[2*i], s.x0, s.y0);
+		s.q1 = proj.project(segs.pts[2*i+1], s.x1, s.y1);
+		s.a0 = segs.alpha[2*i];
+		s.a1 = segs.alpha[2*i+1];
+		if (s.q0 == 0.0f || s.q1 == 0.0f ||
+		    (s.a0 <= 0.0f && s.a1 <= 0.0f)) {
+			drawn[i] = false;
+			continue;
+		}
+		float xlo = max(min(s.x0, s.x1) - reach, -1.0f);
+		float xhi = min(max(s.x0, s.x1) + reach, float(width));
+		float ylo = max(min(s.y0, s.y1) - reach, -1.0f);
+		float yhi = min(max(s.y0, s.y1) + reach, float(height));
+		s.ixmin = max(0, int(floor(xlo)));
+		s.ixmax = min(width - 1, int(floor(xhi)));
+		s.iymin = max(0, int(floor(ylo)));
+		s.iymax = min(height - 1, int(floor(yhi)));
+		drawn[i] = (s.ixmin <= s.ixmax && s.iymin <= s.iymax);
+	}
+
+	// Bin them, keeping each tile's segments in order
+	int ntx = (width + LINE_TILE - 1) / LINE_TILE;
+	int nty = (height + LINE_TILE - 1) / LINE_TILE;
+	int ntiles = ntx * nty;
+	vector<int> tile_start(ntiles + 1, 0);
+	for (int i = 0; i < n; i++) {
+		if (!drawn[i])
+			continue;
+		const LineSegment &s = lsegs[i];
+		int tx0 = s.ixmin / LINE_TILE, tx1 = s.ixmax / LINE_TILE;
+		int ty0 = s.iymin / LINE_TILE, ty1 = s.iymax / LINE_TILE;
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				tile_start[ty * ntx + tx + 1]++;
+	}
+	for (int i = 0; i < ntiles; i++)
+		tile_start[i+1] += tile_start[i];
+	vector<int> bin(tile_start[ntiles]);
+	vector<int> fill(tile_start.begin(), tile_start.end() - 1);
+	for (int i = 0; i < n; i++) {
+		if (!drawn[i])
+			continue;
+		const LineSegment &s = lsegs[i];
+		int tx0 = s.ixmin / LINE_TILE, tx1 = s.ixmax / LINE_TILE;
+		int ty0 = s.iymin / LINE_TILE, ty1 = s.iymax / LINE_TILE;
+		for (int ty = ty0; ty <= ty1; ty++)
+			for (int tx = tx0; tx <= tx1; tx++)
+				bin[fill[ty * ntx + tx]++] = i;
+	}
+
+#pragma omp parallel for schedule(dynamic)
+	for (int tile = 0; tile < ntiles; tile++) {
+		int x0 = (tile % ntx) * LINE_TILE, y0 = (tile / ntx) * LINE_TILE;
+		int x1 = min(x0 + LINE_TILE, width);
+		int y1 = min(y0 + LINE_TILE, height);
+		for (int j = tile_start[tile]; j < tile_start[tile+1]; j++)
+			raster_segment(lsegs[bin[j]], halfwidth, style.color,
+				       depth, x0, x1, y0, y1, width, &rgb[0]);
+	}
+}
+
+
+// PNG needs zlib streams and CRCs.  The stream is compressed only with
+// repeats of the previous pixel, which is most of what a line drawing is,
+// coded with the fixed Huffman codes of deflate.
+
+static unsigned long png_crc(const unsigned char *buf, size_t n,
+			     unsigned long crc = 0xffffffffUL)
+{
+	static unsigned long table[256];
+	static bool have_table = false;
+	if (!have_table) {
+		for (int i = 0; i < 256; i++) {
+			unsigned long c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		have_table = true;
+	}
+	for (size_t i = 0; i < n; i++)
+		crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+
+// Bits, least significant first, as deflate wants them
+class DeflateBits {
+	vector<unsigned char> &out;
+	unsigned long bits;
+	int nbits;
+public:
+	DeflateBits(vector<unsigned char> &out_) : out(out_), bits(0), nbits(0) {}
+	void put(unsigned long value, int n)
+	{
+		bits |= value << nbits;
+		nbits += n;
+		while (nbits >= 8) {
+			out.push_back(bits & 0xff);
+			bits >>= 8;
+			nbits -= 8;
+		}
+	}
+	// Huffman codes go most significant bit first
+	void put_code(unsigned long code, int n)
+	{
+		unsigned long r = 0;
+		for (int i = 0; i < n; i++)
+			r |= ((code >> i) & 1) << (n - 1 - i);
+		put(r, n);
+	}
+	void flush()
+	{
+		if (nbits)
+			out.push_back(bits & 0xff);
+		bits = nbits = 0;
+	}
+};
+
+
+// A literal or length symbol, in the fixed code
+static void put_fixed_symbol(DeflateBits &b, int sym)
+{
+	if (sym < 144)
+		b.put_code(0x30 + sym, 8);
+	else if (sym < 256)
+		b.put_code(0x190 + sym - 144, 9);
+	else if (sym < 280)
+		b.put_code(sym - 256, 7);
+	else
+		b.put_code(0xc0 + sym - 280, 8);
+}
+
+
+// Compress data into a zlib stream
+static void zlib_compress(const vector<unsigned char> &data,
+			  vector<unsigned char> &out)
+{
+	static const int length_base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const int length_extra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+
+	out.push_back(0x78);
+	out.push_back(0x01);
+	DeflateBits b(out);
+	b.put(1, 1);	// Final block
+	b.put(1, 2);	// Fixed codes
+
+	size_t n = data.size();
+	for (size_t i = 0; i < n; ) {
+		size_t len = 0;
+		if (i >= 3)
+			while (len < 258 && i + len < n &&
+			       data[i+len] == data[i+len-3])
+				len++;
+		if (len < 3) {
+			put_fixed_symbol(b, data[i++]);
+			continue;
+		}
+		int code = 28;
+		while (length_base[code] > (int) len)
+			code--;
+		put_fixed_symbol(b, 257 + code);
+		b.put(len - length_base[code], length_extra[code]);
+		b.put_code(2, 5);	// Distance 3: one pixel back
+		i += len;
+	}
+	put_fixed_symbol(b, 256);
+	b.flush();
+
+	unsigned long s1 = 1, s2 = 0;
+	for (size_t i = 0; i < n; i++) {
+		s1 = (s1 + data[i]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	unsigned long adler = (s2 << 16) | s1;
+	for (int i = 3; i >= 0; i--)
+		out.push_back((adler >> (8 * i)) & 0xff);
+}
+
+
+// Write a chunk: length, type, data and CRC
+static void write_png_chunk(FILE *f, const char *type,
+			    const vector<unsigned char> &data)
+{
+	unsigned char head[8];
+	unsigned long len = data.size();
+	for (int i = 0; i < 4; i++) {
+		head[i] = (len >> (24 - 8 * i)) & 0xff;
+		head[4+i] = type[i];
+	}
+	fwrite(head, 1, 8, f);
+	unsigned long crc = png_crc(head + 4, 4);
+	if (len) {
+		fwrite(&data[0], 1, len, f);
+		crc = png_crc(&data[0], len, crc);
+	}
+	crc ^= 0xffffffffUL;
+	unsigned char tail[4];
+	for (int i = 0; i < 4; i++)
+		tail[i] = (crc >> (24 - 8 * i)) & 0xff;
+	fwrite(tail, 1, 4, f);
+}
+
+
+bool LineImage::write_png(const char *filename) const
+{
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	static const unsigned char signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+	};
+	fwrite(signature, 1, 8, f);
+
+	vector<unsigned char> ihdr(13, 0);
+	for (int i = 0; i < 4; i++) {
+		ihdr[i] = (width >> (24 - 8 * i)) & 0xff;
+		ihdr[4+i] = (height >> (24 - 8 * i)) & 0xff;
+	}
+	ihdr[8] = 8;	// Bits per channel
+	ihdr[9] = 2;	// RGB
+	write_png_chunk(f, "IHDR", ihdr);
+
+	// Each row starts with its filter type, 0 (none)
+	vector<unsigned char> raw;
+	raw.reserve((3 * width + 1) * height);
+	for (int y = 0; y < height; y++) {
+		raw.push_back(0);
+		const float *p = width ? &rgb[3 * y * width] : NULL;
+		for (int i = 0; i < 3 * width; i++)
+			raw.push_back(int(255.0f *
+				min(max(p[i], 0.0f), 1.0f) + 0.5f));
+	}
+	vector<unsigned char> idat;
+	zlib_compress(raw, idat);
+	write_png_chunk(f, "IDAT", idat);
+	write_png_chunk(f, "IEND", vector<unsigned char>());
+
+	bool ok = !ferror(f);
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Couldn't write %s\n", filename);
+	return ok;
+}
+
+
+void render_line_image(LineImage &img, const TriMesh *mesh, const xform &xf,
+		       const LineSet &lines, const LineStyle *styles,
+		       const LineSet *hidden, const LineStyle *hidden_styles,
+		       const LineImageOptions &opts)
+{
+	ScreenProjection proj;
+	proj.set(mesh, xf, opts.width, opts.height, opts.fov);
+	DepthBuffer depth;
+	depth.render(mesh, proj, opts.oversample);
+
+	vec white(1, 1, 1);
+	img.clear(opts.width, opts.height, white);
+	img.draw_lines(lines[LINES_SILHOUETTE], styles[LINES_SILHOUETTE],
+		       proj, NULL);
+	img.fill_mesh(depth, white);
+	if (hidden)
+		for (int i = LINES_SILHOUETTE + 1; i < NUM_LINE_FAMILIES; i++)
+			img.draw_lines((*hidden)[i], hidden_styles[i], proj,
+				       NULL);
+	for (int i = LINES_SILHOUETTE + 1; i < NUM_LINE_FAMILIES; i++)
+		img.draw_lines(lines[i], styles[i], proj, &depth);
+}
@@ -0,0 +1,68 @@
+/*
+lineimage.h
+Line drawings rendered on the CPU into an image, for the batch renderer,
+so that no OpenGL context is needed.
+
+The image is made the way the viewer makes it with its default white mesh
+and no lighting: the exterior silhouette is drawn first and then partly
+covered by the mesh, the hidden-line pass (if any) goes on top without a
+depth test, and the other families follow with one against the mesh (see
+depthbuffer.h).  Lines are antialiased, as with GL_LINE_SMOOTH, and blended
+by their fade.
+
+The work is binned into tiles, and the tiles drawn in parallel.  Within a
+tile, lines are drawn in order, so the result doesn't depend on the number
+of threads.
+*/
+
+#ifndef LINEIMAGE_H
+#define LINEIMAGE_H
+
+#include <vector>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "lineextractor.h"
+#include "linestyle.h"
+#include "depthbuffer.h"
+
+
+class LineImage {
+public:
+	int width, height;
+	std::vector<float> rgb;	// 3 per pixel, row by row from the top
+
+	LineImage() : width(0), height(0) {}
+
+	// Resize and clear to a color
+	void clear(int width, int height, const vec &color);
+	// Paint the pixels covered by the mesh a flat color, partly covered
+	// ones in proportion
+	void fill_mesh(const DepthBuffer &depth, const vec &color);
+	// Draw one family of segments.  If depth isn't NULL, only the parts
+	// in front of the mesh are drawn.
+	void draw_lines(const SegmentBuffer &segs, const LineStyle &style,
+			const ScreenProjection &proj, const DepthBuffer *depth);
+	// Write as an 8-bit RGB PNG
+	bool write_png(const char *filename) const;
+};
+
+
+struct LineImageOptions {
+	int width, height;	// In pixels
+	float fov;		// Along the diagonal, as in GLCamera
+	int oversample;		// Depth samples per pixel along each axis
+
+	LineImageOptions() : width(1024), height(1024), fov(0.7f),
+		oversample(2) {}
+};
+
+
+// Draw lines (and, unless it is NULL, the hidden-line pass) of the mesh
+// seen through xf into img
+extern void render_line_image(LineImage &img, const TriMesh *mesh,
+			      const xform &xf, const LineSet &lines,
+			      const LineStyle *styles, const LineSet *hidden,
+			      const LineStyle *hidden_styles,
+			      const LineImageOptions &opts);
+
+#endif
@@ -0,0 +1,141 @@
+/*
+linestyle.cpp
+The colors and widths the viewer draws each family of lines with.
+*/
+
+#include "linestyle.h"
+
+
+// Find the color and width of each family of lines.  This follows the
+// order in which rtsc drew them, since some lines just keep the color
+// of the ones before them.
+void find_line_styles(const LineOptions &opts, bool draw_colors, bool gray,
+		      bool do_hidden, LineStyle *styles)
+{
+	vec currcolor;
+	for (int i = 0; i < NUM_LINE_FAMILIES; i++) {
+		styles[i].color = vec(0, 0, 0);
+		styles[i].width = 1;
+	}
+
+	// Exterior silhouette
+	styles[LINES_SILHOUETTE].color = vec(0.0, 0.0, 0.0);
+	styles[LINES_SILHOUETTE].width = 6;
+
+	if (do_hidden) {
+		// K=0, H=0, DwKr=thresh
+		currcolor = vec(1, 0.5, 0.5);
+		styles[LINES_K].color = styles[LINES_H].color =
+			styles[LINES_DWKR].color = currcolor;
+		styles[LINES_K].width = styles[LINES_H].width =
+			styles[LINES_DWKR].width = 1;
+
+		// Apparent ridges
+		if (draw_colors)
+			currcolor = vec(0.8, 0.8, 0.4);
+		else if (gray)
+			currcolor = vec(0.75, 0.75, 0.75);
+		else
+			currcolor = vec(0.55, 0.55, 0.55);
+		styles[LINES_APPARENT].color = currcolor;
+		styles[LINES_APPARENT].width = draw_colors ? 2 : 1;
+
+		// Ridges and valleys
+		currcolor = vec(0.55, 0.55, 0.55);
+		if (opts.draw_ridges && draw_colors)
+			currcolor = vec(0.72, 0.6, 0.72);
+		styles[LINES_RIDGES].color = currcolor;
+		styles[LINES_RIDGES].width = 1;
+		if (opts.draw_valleys && draw_colors)
+			currcolor = vec(0.8, 0.72, 0.68);
+		styles[LINES_VALLEYS].color = currcolor;
+		styles[LINES_VALLEYS].width = 1;
+
+		// Principal and suggestive highlights
+		vec hlcolor = draw_colors ? vec(0.5, 0, 0) :
+			      gray ? vec(0.75, 0.75, 0.75) :
+				     vec(0.55, 0.55, 0.55);
+		if (opts.draw_phridges || opts.draw_phvalleys)
+			currcolor = hlcolor;
+		styles[LINES_PH].color = hlcolor;
+		styles[LINES_PH].width = 2;
+		if (opts.draw_sh)
+			currcolor = hlcolor;
+		styles[LINES_SH].color = hlcolor;
+		styles[LINES_SH].width = 2.5;
+
+		// Suggestive contours and contours
+		if (opts.draw_sc && draw_colors)
+			currcolor = vec(0.5, 0.5, 1.0);
+		styles[LINES_SC].color = currcolor;
+		styles[LINES_SC].width = 1.5;
+		if (draw_colors)
+			currcolor = vec(0.4, 0.8, 0.4);
+		styles[LINES_C].color = currcolor;
+		styles[LINES_C].width = 1.5;
+
+		// Boundaries
+		styles[LINES_BOUNDARIES].color = vec(0.6, 0.6, 0.6);
+		styles[LINES_BOUNDARIES].width = 1.5;
+		return;
+	}
+
+	// Isophotes
+	styles[LINES_TERMINATOR].color = styles[LINES_ISOPHOTES].color =
+		draw_colors ? vec(0.4, 0.8, 0.4) : vec(0.6, 0.6, 0.6);
+	styles[LINES_TERMINATOR].width = 2;
+	styles[LINES_ISOPHOTES].width = 1;
+	styles[LINES_NEG_ISOPHOTES].color =
+		draw_colors ? vec(0.6, 0.9, 0.6) : vec(0.7, 0.7, 0.7);
+	styles[LINES_NEG_ISOPHOTES].width = 1;
+
+	// Topo lines
+	styles[LINES_TOPO].color = vec(0.5, 0.5, 0.5);
+	styles[LINES_TOPO].width = 1;
+
+	// K=0, H=0, DwKr=thresh
+	styles[LINES_K].color = styles[LINES_H].color =
+		styles[LINES_DWKR].color = vec(1, 0, 0);
+	styles[LINES_K].width = styles[LINES_H].width =
+		styles[LINES_DWKR].width = 2;
+
+	// Apparent ridges
+	styles[LINES_APPARENT].color =
+		draw_colors ? vec(0.4, 0.4, 0) : vec(0.0, 0.0, 0.0);
+	styles[LINES_APPARENT].width = 2.5;
+
+	// Ridges and valleys
+	styles[LINES_RIDGES].color =
+		draw_colors ? vec(0.3, 0.0, 0.3) : vec(0.0, 0.0, 0.0);
+	styles[LINES_RIDGES].width = 2;
+	styles[LINES_VALLEYS].color =
+		draw_colors ? vec(0.5, 0.3, 0.2) : vec(0.0, 0.0, 0.0);
+	styles[LINES_VALLEYS].width = 2;
+
+	// Principal highlights
+	styles[LINES_PH].color = draw_colors ? vec(0.5, 0, 0) :
+				 gray ? vec(1, 1, 1) : vec(0, 0, 0);
+	styles[LINES_PH].width = 2;
+
+	// Suggestive highlights
+	styles[LINES_SH].color = draw_colors ? vec(0.5, 0, 0) :
+				 gray ? vec(1.0, 1.0, 1.0) : vec(0.3, 0.3, 0.3);
+	styles[LINES_SH].width = 2.5;
+
+	// Kr = 0 loops
+	styles[LINES_KR_ZERO].color =
+		draw_colors ? vec(0.5, 0.5, 1.0) : vec(0.6, 0.6, 0.6);
+	styles[LINES_KR_ZERO].width = 1.5;
+
+	// Suggestive contours and contours
+	styles[LINES_SC].color =
+		draw_colors ? vec(0.0, 0.0, 0.8) : vec(0.0, 0.0, 0.0);
+	styles[LINES_SC].width = 2.5;
+	styles[LINES_C].color =
+		draw_colors ? vec(0.0, 0.6, 0.0) : vec(0.0, 0.0, 0.0);
+	styles[LINES_C].width = 2.5;
+
+	// Boundaries
+	styles[LINES_BOUNDARIES].color = vec(0.05, 0.05, 0.05);
+	styles[LINES_BOUNDARIES].width = 2.5;
+}
@@ -0,0 +1,26 @@
+/*
+linestyle.h
+The colors and widths the viewer draws each family of lines with, shared
+by the viewer and the CPU renderers so that their output looks the same.
+*/
+
+#ifndef LINESTYLE_H
+#define LINESTYLE_H
+
+#include "lineextractor.h"
+
+
+// How a family of lines is drawn
+struct LineStyle {
+	vec color;
+	float width;	// In pixels
+};
+
+
+// Find the style of each family of lines, for the main rendering pass
+// or (with do_hidden) the hidden-line one.  draw_colors gives each family
+// its own color; gray is for a mesh that is drawn gray or lit.
+extern void find_line_styles(const LineOptions &opts, bool draw_colors,
+			     bool gray, bool do_hidden, LineStyle *styles);
+
+#endif
@@ -0,0 +1,286 @@
+/*
+locality.cpp
+Measures what reorder_mesh_locality() does for the per-frame loops: runs
+compute_perview (with apparent ridges, so compute_Dt1q1 too) and the
+contour and suggestive contour extraction over an orbit of views, once on
+the mesh in its own order and once reordered, and reports the time and
+the cache misses of each.
+
+Cache misses are read from the hardware counters with perf_event_open,
+which is Linux-only and may be disallowed (see
+/proc/sys/kernel/perf_event_paranoid); the times are reported regardless.
+The generic counters cover the L1 data cache and the last-level cache;
+L2 only has model-specific events.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "XForm.h"
+#include "timestamp.h"
+#include "lineextractor.h"
+#include "ldmesh.h"
+
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+using namespace std;
+
+#ifndef M_PI
+#	define M_PI 3.14159265358979323846
+#endif
+
+
+// Hardware cache-miss counters for the calling thread and its children
+struct CacheCounters {
+	enum { L1D_MISSES, LL_MISSES, NUM_COUNTERS };
+	int fd[NUM_COUNTERS];
+	long long total[NUM_COUNTERS];
+
+	CacheCounters();
+	~CacheCounters();
+	void start();
+	void stop();
+};
+
+static const char *counter_names[] = { "L1D read misses", "LLC read misses" };
+
+
+#ifdef __linux__
+static int open_counter(unsigned long long cache)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+
+CacheCounters::CacheCounters()
+{
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		fd[i] = -1;
+		total[i] = 0;
+	}
+#ifdef __linux__
+	fd[L1D_MISSES] = open_counter(PERF_COUNT_HW_CACHE_L1D);
+	fd[LL_MISSES] = open_counter(PERF_COUNT_HW_CACHE_LL);
+#endif
+}
+
+
+CacheCounters::~CacheCounters()
+{
+#ifdef __linux__
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		if (fd[i] >= 0)
+			close(fd[i]);
+#endif
+}
+
+
+void CacheCounters::start()
+{
+#ifdef __linux__
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		if (fd[i] < 0)
+			continue;
+		ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+
+void CacheCounters::stop()
+{
+#ifdef __linux__
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		if (fd[i] < 0)
+			continue;
+		ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		long long count = 0;
+		if (read(fd[i], &count, sizeof(count)) == sizeof(count))
+			total[i] += count;
+	}
+#endif
+}
+
+
+// Time and cache misses of one stage, summed over the views
+struct StageStats {
+	double seconds;
+	CacheCounters counters;
+	StageStats() : seconds(0)
+		{}
+};
+
+enum { STAGE_PERVIEW, STAGE_EXTRACT, NUM_STAGES };
+static const char *stage_names[] = { "compute_perview", "extract" };
+
+
+// Run the per-frame work over the views
+static void run_views(TriMesh *mesh, float feature_size,
+		      const vector<xform> &views, StageStats *stats)
+{
+	LineOptions opts;
+	opts.draw_apparent = 1;
+	LineExtractor extractor;
+	extractor.set_mesh(mesh, feature_size);
+	extractor.set_options(opts);
+
+	LineSet lines;
+	for (size_t v = 0; v < views.size(); v++) {
+		extractor.set_view(views[v]);
+
+		StageStats &p = stats[STAGE_PERVIEW];
+		p.counters.start();
+		timestamp t = now();
+		extractor.compute_perview();
+		p.seconds += now() - t;
+		p.counters.stop();
+
+		StageStats &e = stats[STAGE_EXTRACT];
+		e.counters.start();
+		t = now();
+		extractor.extract(lines);
+		e.seconds += now() - t;
+		e.counters.stop();
+	}
+}
+
+
+// Shuffle an array, with the same quick 'n dirty random number generator
+// as mesh_feature_size so that every run gets the same order
+template <class T>
+static void shuffle(vector<T> &v)
+{
+	unsigned randq = 0;
+	for (int i = int(v.size()) - 1; i > 0; i--) {
+		randq = unsigned(1664525) * randq + unsigned(1013904223);
+		swap(v[i], v[randq % (i + 1)]);
+	}
+}
+
+
+// Scramble the order of the vertices and faces, as some exporters do
+static void shuffle_mesh(TriMesh *mesh)
+{
+	int nv = mesh->vertices.size();
+	vector<int> remap(nv);
+	for (int i = 0; i < nv; i++)
+		remap[i] = i;
+	shuffle(remap);
+	remap_verts(mesh, remap);
+	shuffle(mesh->faces);
+}
+
+
+static void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [-options] infile\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-subdiv n	Subdivide the mesh n times first\n");
+	fprintf(stderr, "	-shuffle	Scramble the mesh's own order first\n");
+	fprintf(stderr, "	-views n	Number of orbit views (default 16)\n");
+	exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *myname = argv[0];
+	int nsubdiv = 0, nviews = 16;
+	bool shuffle = false;
+
+	// The counters only follow threads created after they are opened,
+	// so open them before anything starts the OpenMP threads
+	StageStats stats[2][NUM_STAGES], warmup[NUM_STAGES];
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (!strcmp(argv[1], "-subdiv") && argc > 2) {
+			nsubdiv = atoi(argv[2]);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-views") && argc > 2) {
+			nviews = max(atoi(argv[2]), 1);
+			argc--, argv++;
+		} else if (!strcmp(argv[1], "-shuffle")) {
+			shuffle = true;
+		} else {
+			usage(myname);
+		}
+		argc--, argv++;
+	}
+	if (argc != 2)
+		usage(myname);
+
+	TriMesh *original = read_mesh(argv[1]);
+	if (!original)
+		usage(myname);
+	original->need_faces();
+	for (int i = 0; i < nsubdiv; i++)
+		subdiv(original);
+	if (shuffle)
+		shuffle_mesh(original);
+	fprintf(stderr, "%d vertices, %d faces\n",
+		(int) original->vertices.size(), (int) original->faces.size());
+
+	for (int reorder = 0; reorder < 2; reorder++) {
+		TriMesh *mesh = new TriMesh(*original);
+		float feature_size = prepare_mesh(mesh, NULL, reorder != 0);
+
+		vector<xform> views;
+		xform home = xform::trans(0, 0, -5.0f * mesh->bsphere.r);
+		for (int i = 0; i < nviews; i++) {
+			double angle = 2.0 * M_PI * i / nviews;
+			views.push_back(home * xform::rot(angle, 0, 1, 0) *
+					xform::trans(-mesh->bsphere.center));
+		}
+
+		// One untimed pass to warm up, then the measured one
+		run_views(mesh, feature_size, views, warmup);
+		run_views(mesh, feature_size, views, stats[reorder]);
+		delete mesh;
+	}
+	delete original;
+
+	printf("%-16s %-22s %14s %14s %8s\n", "stage", "measure",
+	       "own order", "reordered", "change");
+	for (int s = 0; s < NUM_STAGES; s++) {
+		double t0 = 1000.0 * stats[0][s].seconds / nviews;
+		double t1 = 1000.0 * stats[1][s].seconds / nviews;
+		printf("%-16s %-22s %14.3f %14.3f %+7.1f%%\n", stage_names[s],
+		       "msec/view", t0, t1, 100.0 * (t1 - t0) / t0);
+		for (int c = 0; c < CacheCounters::NUM_COUNTERS; c++) {
+			const CacheCounters &c0 = stats[0][s].counters;
+			const CacheCounters &c1 = stats[1][s].counters;
+			if (c0.fd[c] < 0 || c1.fd[c] < 0) {
+				printf("%-16s %-22s %14s %14s\n", stage_names[s],
+				       counter_names[c], "n/a", "n/a");
+				continue;
+			}
+			double m0 = double(c0.total[c]) / nviews;
+			double m1 = double(c1.total[c]) / nviews;
+			printf("%-16s %-22s %14.0f %14.0f %+7.1f%%\n",
+			       stage_names[s], counter_names[c], m0, m1,
+			       m0 > 0 ? 100.0 * (m1 - m0) / m0 : 0.0);
+		}
+	}
+
+	return 0;
+}
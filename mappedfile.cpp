@@ -0,0 +1,145 @@
+/*
+mappedfile.cpp
+A read-only memory-mapped file.  See mappedfile.h.
+*/
+
+#include <stdio.h>
+#include "mappedfile.h"
+
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile() : data_(NULL), size_(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *filename)
+{
+	close();
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+			   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	data_ = (const unsigned char *)
+		MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data_) {
+		close();
+		return false;
+	}
+	size_ = (size_t) fsize.QuadPart;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (data_)
+		UnmapViewOfFile(data_);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data_ = NULL;
+	size_ = 0;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+}
+
+
+// Rename tempname over filename.  Windows doesn't allow this while
+// another process has filename mapped, which then stays as it was.
+bool replace_file(const char *tempname, const char *filename)
+{
+	if (MoveFileExA(tempname, filename, MOVEFILE_REPLACE_EXISTING))
+		return true;
+	remove(tempname);
+	return false;
+}
+
+#else
+
+bool MappedFile::open(const char *filename)
+{
+	close();
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	data_ = (const unsigned char *) p;
+	size_ = st.st_size;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (data_)
+		munmap((void *) data_, size_);
+	data_ = NULL;
+	size_ = 0;
+}
+
+
+// Rename tempname over filename.  Processes that have it mapped keep the
+// old file.
+bool replace_file(const char *tempname, const char *filename)
+{
+	if (rename(tempname, filename) == 0)
+		return true;
+	remove(tempname);
+	return false;
+}
+
+#endif
+
+
+// A name next to filename, unique to this process
+std::string temp_file_name(const char *filename)
+{
+	char suffix[32];
+#ifdef _WIN32
+	sprintf(suffix, ".tmp.%lu", (unsigned long) GetCurrentProcessId());
+#else
+	sprintf(suffix, ".tmp.%ld", (long) getpid());
+#endif
+	return std::string(filename) + suffix;
+}
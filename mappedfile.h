@@ -0,0 +1,55 @@
+/*
+mappedfile.h
+A read-only memory-mapped file, using mmap on POSIX systems and
+MapViewOfFile on Windows.
+
+A file that may be mapped must not be rewritten in place: truncating it
+makes the pages of a reader's mapping go away under it (SIGBUS on POSIX
+systems).  Instead, the new contents are written to temp_file_name() and
+replace_file() puts them in its place, while readers keep the old file
+until they close it.
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <string>
+
+
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Map the whole of filename.  Returns false (and leaves the
+	// object closed) if the file can't be opened or is empty.
+	bool open(const char *filename);
+	void close();
+	bool is_open() const { return data_ != NULL; }
+
+	const unsigned char *data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	const unsigned char *data_;
+	size_t size_;
+#ifdef _WIN32
+	void *file, *mapping;
+#endif
+
+	// Not copyable
+	MappedFile(const MappedFile &);
+	MappedFile &operator = (const MappedFile &);
+};
+
+
+// A name, next to filename and unique to this process, to write its new
+// contents under
+extern std::string temp_file_name(const char *filename);
+
+// Rename tempname over filename.  Returns false, removing tempname, if
+// that can't be done.
+extern bool replace_file(const char *tempname, const char *filename);
+
+#endif
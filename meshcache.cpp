@@ -0,0 +1,225 @@
+/*
+meshcache.cpp
+Binary sidecar cache of the per-mesh data computed by prepare_mesh().
+See meshcache.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "meshcache.h"
+#include "mappedfile.h"
+
+using namespace std;
+
+
+static const char cache_magic[8] = "LDCACHE";
+static const unsigned cache_byte_order = 0x01020304u;
+
+
+// 64-bit FNV-1a over a block of bytes
+static inline unsigned long long fnv1a(unsigned long long h,
+				       const void *data, size_t n)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	for (size_t i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+
+// 64-bit FNV-1a hash of the vertices and faces of a mesh
+unsigned long long mesh_hash(const TriMesh *mesh)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	unsigned long long h = 14695981039346656037ull;
+	h = fnv1a(h, &nv, sizeof(nv));
+	h = fnv1a(h, &nf, sizeof(nf));
+	if (nv)
+		h = fnv1a(h, &mesh->vertices[0], nv * sizeof(point));
+	if (nf)
+		h = fnv1a(h, &mesh->faces[0], nf * sizeof(TriMesh::Face));
+	return h;
+}
+
+
+// The name of the cache file for a mesh file
+string mesh_cache_name(const char *meshfile)
+{
+	return string(meshfile) + ".ldcache";
+}
+
+
+// One array in the cache
+struct CacheSection {
+	void *data;
+	size_t size;
+};
+
+static inline size_t align16(size_t x)
+{
+	return (x + 15) & ~size_t(15);
+}
+
+
+// The size of the cache file for a mesh with nv vertices, nf faces and
+// ntstrips strip entries
+static size_t cache_size(int nv, int nf, int ntstrips)
+{
+	return align16(sizeof(MeshCacheHeader)) +
+	       3 * align16(nv * sizeof(vec)) +
+	       3 * align16(nv * sizeof(float)) +
+	       align16(nv * sizeof(Vec<4,float>)) +
+	       align16(nf * sizeof(vec)) +
+	       align16(ntstrips * sizeof(int));
+}
+
+
+// The sections of the cache, pointing into mesh's arrays (which must
+// have the right sizes already)
+static void cache_sections(TriMesh *mesh, int nv, int nf, int ntstrips,
+			   CacheSection sections[9])
+{
+	CacheSection s[9] = {
+		{ nv ? &mesh->normals[0] : 0, nv * sizeof(vec) },
+		{ nv ? &mesh->pdir1[0] : 0, nv * sizeof(vec) },
+		{ nv ? &mesh->pdir2[0] : 0, nv * sizeof(vec) },
+		{ nv ? &mesh->curv1[0] : 0, nv * sizeof(float) },
+		{ nv ? &mesh->curv2[0] : 0, nv * sizeof(float) },
+		{ nv ? &mesh->dcurv[0] : 0, nv * sizeof(Vec<4,float>) },
+		{ nv ? &mesh->pointareas[0] : 0, nv * sizeof(float) },
+		{ nf ? &mesh->cornerareas[0] : 0, nf * sizeof(vec) },
+		{ ntstrips ? &mesh->tstrips[0] : 0, ntstrips * sizeof(int) },
+	};
+	for (int i = 0; i < 9; i++)
+		sections[i] = s[i];
+}
+
+
+// Fill in the mesh from the cache, if it matches
+bool read_mesh_cache(const char *cachename, unsigned long long hash,
+		     TriMesh *mesh, float &feature_size)
+{
+	MappedFile file;
+	if (!file.open(cachename))
+		return false;
+	if (file.size() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader h;
+	memcpy(&h, file.data(), sizeof(h));
+	if (memcmp(h.magic, cache_magic, sizeof(h.magic)) ||
+	    h.version != MESH_CACHE_VERSION ||
+	    h.byte_order != cache_byte_order ||
+	    h.hash != hash ||
+	    h.nv != int(mesh->vertices.size()) ||
+	    h.nf != int(mesh->faces.size()) ||
+	    h.ntstrips < 0) {
+		TriMesh::dprintf("Ignoring stale cache %s\n", cachename);
+		return false;
+	}
+
+	// Check the size before touching the mesh
+	int nv = h.nv, nf = h.nf, ntstrips = h.ntstrips;
+	if (file.size() != cache_size(nv, nf, ntstrips)) {
+		TriMesh::dprintf("Ignoring truncated cache %s\n", cachename);
+		return false;
+	}
+
+	TriMesh::dprintf("Reading cache %s... ", cachename);
+	mesh->normals.resize(nv);
+	mesh->pdir1.resize(nv);
+	mesh->pdir2.resize(nv);
+	mesh->curv1.resize(nv);
+	mesh->curv2.resize(nv);
+	mesh->dcurv.resize(nv);
+	mesh->pointareas.resize(nv);
+	mesh->cornerareas.resize(nf);
+	mesh->tstrips.resize(ntstrips);
+	CacheSection sections[9];
+	cache_sections(mesh, nv, nf, ntstrips, sections);
+	size_t offset = align16(sizeof(MeshCacheHeader));
+	for (int i = 0; i < 9; i++) {
+		if (sections[i].size)
+			memcpy(sections[i].data, file.data() + offset,
+			       sections[i].size);
+		offset += align16(sections[i].size);
+	}
+	mesh->bsphere.center = point(h.center[0], h.center[1], h.center[2]);
+	mesh->bsphere.r = h.radius;
+	mesh->bsphere.valid = true;
+	feature_size = h.feature_size;
+	TriMesh::dprintf("Done.\n");
+	return true;
+}
+
+
+// Write the cache for a prepared mesh
+bool write_mesh_cache(const char *cachename, unsigned long long hash,
+		      const TriMesh *mesh, float feature_size)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	int ntstrips = mesh->tstrips.size();
+	if (int(mesh->normals.size()) != nv ||
+	    int(mesh->curv1.size()) != nv ||
+	    int(mesh->dcurv.size()) != nv ||
+	    int(mesh->pointareas.size()) != nv ||
+	    int(mesh->cornerareas.size()) != nf || !mesh->bsphere.valid)
+		return false;
+
+	// Another process may have the old cache mapped, so it is replaced
+	// rather than rewritten (see mappedfile.h)
+	string tempname = temp_file_name(cachename);
+	FILE *f = fopen(tempname.c_str(), "wb");
+	if (!f) {
+		TriMesh::dprintf("Couldn't write cache %s\n", cachename);
+		return false;
+	}
+
+	// The magic number is written last, so that a partly-written
+	// file is never taken for a valid one
+	MeshCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	h.version = MESH_CACHE_VERSION;
+	h.byte_order = cache_byte_order;
+	h.hash = hash;
+	h.nv = nv;
+	h.nf = nf;
+	h.ntstrips = ntstrips;
+	h.feature_size = feature_size;
+	h.center[0] = mesh->bsphere.center[0];
+	h.center[1] = mesh->bsphere.center[1];
+	h.center[2] = mesh->bsphere.center[2];
+	h.radius = mesh->bsphere.r;
+
+	static const char zeros[16] = { 0 };
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+	size_t hpad = align16(sizeof(h)) - sizeof(h);
+	if (hpad)
+		ok = ok && (fwrite(zeros, hpad, 1, f) == 1);
+
+	CacheSection sections[9];
+	cache_sections(const_cast<TriMesh *>(mesh), nv, nf, ntstrips, sections);
+	for (int i = 0; i < 9 && ok; i++) {
+		size_t n = sections[i].size, pad = align16(n) - n;
+		if (n)
+			ok = (fwrite(sections[i].data, n, 1, f) == 1);
+		if (ok && pad)
+			ok = (fwrite(zeros, pad, 1, f) == 1);
+	}
+
+	if (ok) {
+		fflush(f);
+		ok = (fseek(f, 0, SEEK_SET) == 0) &&
+		     (fwrite(cache_magic, sizeof(cache_magic), 1, f) == 1);
+	}
+	ok = (fclose(f) == 0) && ok;
+	if (!ok)
+		remove(tempname.c_str());
+	else
+		ok = replace_file(tempname.c_str(), cachename);
+	if (!ok)
+		TriMesh::dprintf("Couldn't write cache %s\n", cachename);
+	return ok;
+}
@@ -0,0 +1,56 @@
+/*
+meshcache.h
+A binary sidecar file holding everything prepare_mesh() computes for a
+mesh (triangle strips, bounding sphere, normals, curvatures, dcurv,
+point and corner areas, and the feature size), so that loading a mesh
+for the second time doesn't have to recompute them.
+
+The cache is keyed by a hash of the mesh's vertices and faces, and
+carries a version number that is bumped whenever the layout or the
+computation of any of its contents changes.  A cache that doesn't match
+is ignored (and overwritten).  The file is memory-mapped and copied
+straight into the mesh's arrays.
+
+Layout, in native byte order: a MeshCacheHeader, followed by normals,
+pdir1, pdir2, curv1, curv2, dcurv, pointareas (per vertex), cornerareas
+(per face) and tstrips, each starting at a multiple of 16 bytes.
+*/
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <string>
+#include "TriMesh.h"
+
+
+// Bump whenever anything stored in the cache changes
+#define MESH_CACHE_VERSION 1
+
+struct MeshCacheHeader {
+	char magic[8];			// "LDCACHE", written last
+	unsigned version;		// MESH_CACHE_VERSION
+	unsigned byte_order;		// 0x01020304, as written
+	unsigned long long hash;	// mesh_hash() of the mesh
+	int nv, nf, ntstrips;
+	float feature_size;
+	float center[3], radius;	// Bounding sphere
+	int pad[2];
+};
+
+
+// 64-bit FNV-1a hash of the vertices and faces of a mesh
+extern unsigned long long mesh_hash(const TriMesh *mesh);
+
+// The name of the cache file for a mesh file: meshfile.ldcache
+extern std::string mesh_cache_name(const char *meshfile);
+
+// Fill in the mesh from the cache, if the cache exists and was written
+// for a mesh with this hash
+extern bool read_mesh_cache(const char *cachename, unsigned long long hash,
+			    TriMesh *mesh, float &feature_size);
+
+// Write the cache for a prepared mesh
+extern bool write_mesh_cache(const char *cachename, unsigned long long hash,
+			     const TriMesh *mesh, float feature_size);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+multiview.cpp
+Extract the lines of one mesh for many views: see multiview.h.
+*/
+
+#include "multiview.h"
+
+using namespace std;
+
+
+bool extract_views(LineExtractor &extractor, const vector<xform> &views,
+		   bool do_hidden, ViewSink &sink)
+{
+	LineOptions saved_opts = extractor.opts;
+	LineOptions opts = saved_opts;
+	opts.coherent = 0;
+	opts.threshold_sweep = 0;
+	opts.draw_hidden = do_hidden;
+	extractor.set_options(opts);
+	extractor.prepare_views();
+
+	// With more than one view, the loop over faces or vertices inside
+	// each stage runs on one thread, since it is in a parallel region
+	// already.  With only one, it can use them all.
+	int nviews = views.size();
+	bool stop = false;
+#pragma omp parallel if (nviews > 1)
+	{
+		LineExtractor view_extractor(extractor);
+		view_extractor.profiler = NULL;
+		LineSet lines, hidden;
+#pragma omp for schedule(dynamic)
+		for (int v = 0; v < nviews; v++) {
+			bool stopped;
+#pragma omp critical (extract_views)
+			stopped = stop;
+			if (stopped)
+				continue;
+
+			view_extractor.set_view(views[v]);
+			view_extractor.compute_perview();
+			view_extractor.extract(lines);
+			if (do_hidden)
+				view_extractor.extract(hidden, true);
+			if (!sink.view_done(v, views[v], lines,
+					    do_hidden ? &hidden : NULL)) {
+#pragma omp critical (extract_views)
+				stop = true;
+			}
+		}
+	}
+	extractor.set_options(saved_opts);
+	return !stop;
+}
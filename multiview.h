@@ -0,0 +1,45 @@
+/*
+multiview.h
+Extract the lines of one mesh for many views, one view per thread.
+
+What the views share (see LineExtractor::prepare_views) is computed once,
+and then each thread works on a copy of the extractor, taking the next
+view as soon as it is done with one.  Each view's lines are handed to a
+ViewSink as soon as they are extracted, so that they can be written out
+without keeping every view in memory.
+
+Views are extracted independently of each other, so the lines of a view
+don't depend on the number of threads.  Temporal coherence
+(LineOptions::coherent) is turned off, since it relies on going through
+the views in order, and so are threshold sweeps, which only help when
+the view stays the same.
+*/
+
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#include <vector>
+#include "XForm.h"
+#include "lineextractor.h"
+
+
+// Receives the lines of each view
+class ViewSink {
+public:
+	virtual ~ViewSink() {}
+	// Called once per view, from the thread that extracted it, while
+	// other threads may be calling it for other views.  hidden is NULL
+	// unless the hidden-line pass was asked for.  Returns false to stop
+	// extracting views.
+	virtual bool view_done(int view, const xform &xf,
+			       const LineSet &lines, const LineSet *hidden) = 0;
+};
+
+
+// Extract the lines of each view with the mesh and options of extractor,
+// and hand them to sink.  Returns false if the sink asked to stop.
+extern bool extract_views(LineExtractor &extractor,
+			  const std::vector<xform> &views, bool do_hidden,
+			  ViewSink &sink);
+
+#endif
@@ -0,0 +1,660 @@
+/*
+outofcore.cpp
+Line extraction on meshes too large for memory, cluster by cluster: see
+outofcore.h.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include "outofcore.h"
+#include "bsphere.h"
+
+using namespace std;
+
+// Rough peak memory per face of a cluster: the mesh with everything
+// prepare_mesh() computes, the extractor's per-view values, and the lines
+// of a view
+#define BYTES_PER_FACE 512
+
+// At most this many face centroids are sampled to split the mesh
+#define MAX_SAMPLES (1 << 20)
+
+// Faces are streamed through in parallel chunks of this many, up to this
+// many chunks at a time
+#define FACE_CHUNK 4096
+#define BLOCK_CHUNKS 256
+
+
+OutOfCoreMesh::OutOfCoreMesh() : faces_loaded(0), budget(0), margin(0)
+{
+}
+
+
+// Orders points by one coordinate
+struct CompareAxis {
+	int axis;
+	CompareAxis(int axis_) : axis(axis_) {}
+	bool operator () (const point &p1, const point &p2) const
+		{ return p1[axis] < p2[axis]; }
+};
+
+
+// Is a point on the side of a split that child[0] of a Node gets?
+struct BelowSplit {
+	int axis;
+	float split;
+	BelowSplit(int axis_, float split_) : axis(axis_), split(split_) {}
+	bool operator () (const point &p) const
+		{ return p[axis] < split; }
+};
+
+
+// Map a .ldm file, find its bounds and longest edge, and split it into
+// clusters
+bool OutOfCoreMesh::open(const char *filename, size_t budget_)
+{
+	close();
+	if (!mm.open(filename))
+		return false;
+	if (!mm.vertices || !mm.faces || !mm.nv || !mm.nf) {
+		fprintf(stderr, "%s has no faces\n", filename);
+		close();
+		return false;
+	}
+	budget = budget_;
+	int nv = mm.nv, nf = mm.nf;
+
+	// Bounding box and longest edge, which don't depend on the order
+	// the threads get to them in
+	bbox_min = bbox_max = mm.vertices[0];
+	float max_edge2 = 0.0f;
+#pragma omp parallel
+	{
+		point lo = bbox_min, hi = bbox_max;
+		float e2 = 0.0f;
+#pragma omp for
+		for (int i = 0; i < nv; i++) {
+			const point &p = mm.vertices[i];
+			for (int j = 0; j < 3; j++) {
+				lo[j] = min(lo[j], p[j]);
+				hi[j] = max(hi[j], p[j]);
+			}
+		}
+#pragma omp for
+		for (int i = 0; i < nf; i++) {
+			const TriMesh::Face &f = mm.faces[i];
+			const point &p0 = mm.vertices[f[0]];
+			const point &p1 = mm.vertices[f[1]];
+			const point &p2 = mm.vertices[f[2]];
+			e2 = max(e2, dist2(p0, p1));
+			e2 = max(e2, dist2(p1, p2));
+			e2 = max(e2, dist2(p2, p0));
+		}
+#pragma omp critical (outofcore_bounds)
+		{
+			for (int j = 0; j < 3; j++) {
+				bbox_min[j] = min(bbox_min[j], lo[j]);
+				bbox_max[j] = max(bbox_max[j], hi[j]);
+			}
+			max_edge2 = max(max_edge2, e2);
+		}
+	}
+
+	// The vertices of a cluster's faces are within the longest edge of
+	// its box, and the faces in halo_rings rings around one of them
+	// within halo_rings times that.  Leave a little extra for roundoff.
+	margin = 1.01f * (halo_rings + 1) * sqrt(max_edge2);
+
+	if (mm.bsphere) {
+		bsph.center = point(mm.bsphere[0], mm.bsphere[1], mm.bsphere[2]);
+		bsph.r = mm.bsphere[3];
+	} else {
+		// The one need_bsphere() would find on the whole mesh, which
+		// the topo lines, the default views and the feature size
+		// depend on.  Miniball works on a copy of the vertices: files
+		// from convert have the sphere, so this is only for older ones.
+		TriMesh::dprintf("Computing bounding sphere... ");
+		Miniball<3,float> mb;
+		mb.check_in(mm.vertices, mm.vertices + nv);
+		mb.build();
+		bsph.center = mb.center();
+		bsph.r = sqrt(mb.squared_radius());
+		TriMesh::dprintf("Done.\n");
+	}
+	bsph.valid = true;
+
+	// Split a sample of the face centroids until each leaf of the tree
+	// stands for few enough faces to fit half the budget.  The face
+	// lists of a batch take the other half.
+	int target = int(min(0.5 * budget / BYTES_PER_FACE, double(nf)));
+	target = max(target, 1);
+	int stride = max(1, (nf + MAX_SAMPLES - 1) / MAX_SAMPLES);
+	vector<point> pts;
+	pts.reserve((nf + stride - 1) / stride);
+	for (int i = 0; i < nf; i += stride)
+		pts.push_back(centroid(i));
+	build_node(pts, 0, pts.size(), bbox_min, bbox_max, stride, target, 0);
+	return true;
+}
+
+
+// Unmap the file and forget the clusters
+void OutOfCoreMesh::close()
+{
+	mm.close();
+	nodes.clear();
+	leaves.clear();
+	bsph.valid = false;
+	faces_loaded = 0;
+}
+
+
+// Make a node of the tree for the sample points from begin to end, in the
+// box from lo to hi, splitting it until there are at most target faces in
+// a leaf.  Returns its index.
+int OutOfCoreMesh::build_node(vector<point> &pts, int begin, int end,
+			      const point &lo, const point &hi, int stride,
+			      int target, int depth)
+{
+	int n = nodes.size();
+	nodes.push_back(Node());
+	nodes[n].first_leaf = leaves.size();
+
+	// Split along the longest side of the box around the points
+	int axis = -1, mid = begin;
+	float split = 0.0f;
+	if ((end - begin) * double(stride) > target && end - begin > 1 &&
+	    depth < 48) {
+		point plo = pts[begin], phi = pts[begin];
+		for (int i = begin + 1; i < end; i++) {
+			for (int j = 0; j < 3; j++) {
+				plo[j] = min(plo[j], pts[i][j]);
+				phi[j] = max(phi[j], pts[i][j]);
+			}
+		}
+		axis = 0;
+		for (int j = 1; j < 3; j++)
+			if (phi[j] - plo[j] > phi[axis] - plo[axis])
+				axis = j;
+
+		// At the median, unless that leaves nothing on one side
+		nth_element(pts.begin() + begin, pts.begin() + (begin + end) / 2,
+			    pts.begin() + end, CompareAxis(axis));
+		split = pts[(begin + end) / 2][axis];
+		mid = partition(pts.begin() + begin, pts.begin() + end,
+				BelowSplit(axis, split)) - pts.begin();
+		if (mid == begin)
+			axis = -1;
+	}
+
+	if (axis < 0) {
+		Leaf l;
+		l.lo = lo;
+		l.hi = hi;
+		l.nfaces = int(min((end - begin) * double(stride),
+				   double(mm.nf)));
+		nodes[n].axis = -1;
+		nodes[n].split = 0.0f;
+		nodes[n].child[0] = nodes[n].last_leaf = leaves.size();
+		nodes[n].child[1] = -1;
+		leaves.push_back(l);
+		return n;
+	}
+
+	point lhi = hi, rlo = lo;
+	lhi[axis] = rlo[axis] = split;
+	int left = build_node(pts, begin, mid, lo, lhi, stride, target,
+			      depth + 1);
+	int right = build_node(pts, mid, end, rlo, hi, stride, target,
+			       depth + 1);
+	nodes[n].axis = axis;
+	nodes[n].split = split;
+	nodes[n].child[0] = left;
+	nodes[n].child[1] = right;
+	nodes[n].last_leaf = leaves.size() - 1;
+	return n;
+}
+
+
+// The leaf a point falls in
+int OutOfCoreMesh::leaf_of(const point &p) const
+{
+	int i = 0;
+	while (nodes[i].axis >= 0)
+		i = nodes[i].child[p[nodes[i].axis] < nodes[i].split ? 0 : 1];
+	return nodes[i].child[0];
+}
+
+
+// The leaves from first to last whose boxes overlap the box from lo to hi,
+// in order
+void OutOfCoreMesh::leaves_near(const point &lo, const point &hi,
+				int first, int last, vector<int> &out) const
+{
+	out.clear();
+	int stack[64];
+	int sp = 0;
+	stack[sp++] = 0;
+	while (sp) {
+		const Node &n = nodes[stack[--sp]];
+		if (n.last_leaf < first || n.first_leaf > last)
+			continue;
+		if (n.axis < 0) {
+			out.push_back(n.child[0]);
+			continue;
+		}
+		if (hi[n.axis] >= n.split)
+			stack[sp++] = n.child[1];
+		if (lo[n.axis] < n.split)
+			stack[sp++] = n.child[0];
+	}
+}
+
+
+// The point that decides which cluster a face belongs to.  It has to come
+// out the same every time.
+point OutOfCoreMesh::centroid(int face) const
+{
+	const TriMesh::Face &f = mm.faces[face];
+	return (1.0f / 3.0f) * (mm.vertices[f[0]] + mm.vertices[f[1]] +
+				mm.vertices[f[2]]);
+}
+
+
+// List the faces of the clusters in batch, in one streaming pass over the
+// faces of the file: those whose centroid falls in a cluster's box, and
+// those with a vertex within margin of it.  Clusters are dropped from the
+// end of the batch while the lists hold more than max_listed faces.
+void OutOfCoreMesh::find_cluster_faces(vector<int> &batch, size_t max_listed,
+				       vector< vector<int> > &faces) const
+{
+	// Where each leaf goes in faces, if it's in the batch, and the box
+	// around the batch that a face needs a vertex in
+	vector<int> slot(leaves.size(), -1);
+	point lo = leaves[batch[0]].lo, hi = leaves[batch[0]].hi;
+	for (size_t i = 0; i < batch.size(); i++) {
+		const Leaf &l = leaves[batch[i]];
+		slot[batch[i]] = i;
+		for (int j = 0; j < 3; j++) {
+			lo[j] = min(lo[j], l.lo[j]);
+			hi[j] = max(hi[j], l.hi[j]);
+		}
+	}
+	point m(margin, margin, margin);
+	lo = lo - m;
+	hi = hi + m;
+
+	faces.clear();
+	faces.resize(batch.size());
+	for (size_t i = 0; i < batch.size(); i++)
+		faces[i].reserve(leaves[batch[i]].nfaces);
+
+	// Each chunk lists pairs of (slot, face) in face order, and the
+	// chunks of a block are then gathered in order.  Blocks start small,
+	// and then hold as many chunks as there is room for in a quarter of
+	// max_listed, at the rate of pairs per chunk of the last block.
+	int nf = mm.nf;
+	int nchunks = (nf + FACE_CHUNK - 1) / FACE_CHUNK;
+	vector< vector<int> > buckets(BLOCK_CHUNKS);
+	int block = 16;
+	size_t nlisted = 0;
+	for (int c0 = 0, c1; c0 < nchunks; c0 = c1) {
+		int first = batch.front(), last = batch.back();
+		c1 = min(nchunks, c0 + block);
+#pragma omp parallel for schedule(dynamic)
+		for (int c = c0; c < c1; c++) {
+			vector<int> &bucket = buckets[c - c0];
+			bucket.clear();
+			vector<int> near, found;
+			int fend = min(nf, (c + 1) * FACE_CHUNK);
+			for (int i = c * FACE_CHUNK; i < fend; i++) {
+				const TriMesh::Face &f = mm.faces[i];
+				found.clear();
+				for (int k = 0; k < 3; k++) {
+					const point &p = mm.vertices[f[k]];
+					if (p[0] < lo[0] || p[0] > hi[0] ||
+					    p[1] < lo[1] || p[1] > hi[1] ||
+					    p[2] < lo[2] || p[2] > hi[2])
+						continue;
+					leaves_near(p - m, p + m, first, last,
+						    near);
+					for (size_t j = 0; j < near.size(); j++)
+						if (slot[near[j]] >= 0)
+							found.push_back(slot[near[j]]);
+				}
+				if (found.empty())
+					continue;
+				sort(found.begin(), found.end());
+				found.erase(unique(found.begin(), found.end()),
+					    found.end());
+				for (size_t j = 0; j < found.size(); j++) {
+					bucket.push_back(found[j]);
+					bucket.push_back(i);
+				}
+			}
+		}
+		size_t npairs = 0;
+		for (int c = c0; c < c1; c++) {
+			const vector<int> &bucket = buckets[c - c0];
+			for (size_t j = 0; j < bucket.size(); j += 2)
+				faces[bucket[j]].push_back(bucket[j+1]);
+			npairs += bucket.size() / 2;
+		}
+		nlisted += npairs;
+		double per_chunk = max(double(npairs) / (c1 - c0), 1.0);
+		block = int(min(0.25 * max_listed / per_chunk,
+				double(BLOCK_CHUNKS)));
+		block = max(block, 1);
+
+		while (nlisted > max_listed && batch.size() > 1) {
+			nlisted -= faces.back().size();
+			slot[batch.back()] = -1;
+			batch.pop_back();
+			faces.pop_back();
+		}
+	}
+}
+
+
+// Copy the elements ids of an array in the file, if it's there
+template <class T>
+static inline void gather_array(const T *p, const vector<int> &ids,
+				vector<T> &v)
+{
+	if (!p)
+		return;
+	int n = ids.size();
+	v.resize(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+		v[i] = p[ids[i]];
+}
+
+
+// Make the mesh of cluster leaf from the faces listed for it, in the order
+// they are in the file.  Only the faces whose centroids fall in its box
+// (marked in own) and halo_rings rings of faces around them are kept in
+// faces, and verts gets the vertices of the file it uses.  Whatever the
+// file holds besides vertices and faces is copied over, as to_trimesh()
+// would.
+TriMesh *OutOfCoreMesh::cluster_mesh(int leaf, vector<int> &faces,
+				     vector<int> &verts,
+				     vector<char> &own) const
+{
+	// The vertices of all the faces listed, and the corners of the faces
+	// as indices into those
+	int nf = faces.size();
+	verts.clear();
+	verts.reserve(3 * nf);
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mm.faces[faces[i]];
+		verts.push_back(f[0]);
+		verts.push_back(f[1]);
+		verts.push_back(f[2]);
+	}
+	sort(verts.begin(), verts.end());
+	verts.erase(unique(verts.begin(), verts.end()), verts.end());
+	vector<int> corners(3 * nf);
+	own.resize(nf);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mm.faces[faces[i]];
+		for (int j = 0; j < 3; j++)
+			corners[3*i+j] = lower_bound(verts.begin(),
+				verts.end(), f[j]) - verts.begin();
+		own[i] = (leaf_of(centroid(faces[i])) == leaf);
+	}
+
+	// Each ring adds the faces with a vertex on those kept so far.  The
+	// spatial halo the faces were listed with always holds these.
+	int nv = verts.size();
+	vector<char> keep(own.begin(), own.end()), mark(nv);
+	for (int r = 0; r < halo_rings; r++) {
+		for (int i = 0; i < nf; i++)
+			if (keep[i])
+				mark[corners[3*i]] = mark[corners[3*i+1]] =
+					mark[corners[3*i+2]] = 1;
+		for (int i = 0; i < nf; i++)
+			if (!keep[i] && (mark[corners[3*i]] ||
+					 mark[corners[3*i+1]] ||
+					 mark[corners[3*i+2]]))
+				keep[i] = 1;
+	}
+
+	// Number what's kept in order
+	vector<int> newv(nv, -1);
+	for (int i = 0; i < nf; i++)
+		if (keep[i])
+			newv[corners[3*i]] = newv[corners[3*i+1]] =
+				newv[corners[3*i+2]] = 0;
+	int nkept = 0;
+	for (int i = 0; i < nv; i++) {
+		if (newv[i] < 0)
+			continue;
+		verts[nkept] = verts[i];
+		newv[i] = nkept++;
+	}
+	verts.resize(nkept);
+
+	TriMesh *mesh = new TriMesh;
+	gather_array(mm.vertices, verts, mesh->vertices);
+	mesh->faces.reserve(count(keep.begin(), keep.end(), 1));
+	int k = 0;
+	for (int i = 0; i < nf; i++) {
+		if (!keep[i])
+			continue;
+		mesh->faces.push_back(TriMesh::Face(newv[corners[3*i]],
+						    newv[corners[3*i+1]],
+						    newv[corners[3*i+2]]));
+		faces[k] = faces[i];
+		own[k++] = own[i];
+	}
+	faces.resize(k);
+	own.resize(k);
+
+	gather_array(mm.normals, verts, mesh->normals);
+	gather_array(mm.pdir1, verts, mesh->pdir1);
+	gather_array(mm.pdir2, verts, mesh->pdir2);
+	gather_array(mm.curv1, verts, mesh->curv1);
+	gather_array(mm.curv2, verts, mesh->curv2);
+	gather_array(mm.dcurv, verts, mesh->dcurv);
+	gather_array(mm.pointareas, verts, mesh->pointareas);
+	gather_array(mm.cornerareas, faces, mesh->cornerareas);
+	mesh->bsphere = bsph;
+	return mesh;
+}
+
+
+// Build the clusters in which, a batch at a time, and hand them to visitor
+bool OutOfCoreMesh::visit_clusters(const vector<int> &which,
+				   Visitor &visitor)
+{
+	// The face lists of a batch take at most half the budget.  Batches
+	// are made with room for halos as large as the clusters at first,
+	// then as large as in the last batch, and cut short if the lists
+	// turn out longer.
+	size_t max_listed = budget / (2 * sizeof(int));
+	double spread = 2.0;
+	int verbose = TriMesh::verbose;
+	TriMesh::set_verbose(0);
+	faces_loaded = 0;
+
+	bool ok = true;
+	vector<int> batch, verts;
+	vector< vector<int> > faces;
+	vector<char> own;
+	for (size_t i = 0; ok && i < which.size(); i += batch.size()) {
+		batch.clear();
+		double nfaces = 0;
+		do {
+			nfaces += leaves[which[i + batch.size()]].nfaces;
+			batch.push_back(which[i + batch.size()]);
+		} while (i + batch.size() < which.size() &&
+			 spread * (nfaces +
+				   leaves[which[i + batch.size()]].nfaces) <=
+			 max_listed);
+
+		find_cluster_faces(batch, max_listed, faces);
+		double nlisted = 0;
+		nfaces = 0;
+		for (size_t j = 0; j < batch.size(); j++) {
+			nlisted += faces[j].size();
+			nfaces += leaves[batch[j]].nfaces;
+		}
+		spread = max(nlisted / max(nfaces, 1.0), 1.0);
+		for (size_t j = 0; ok && j < batch.size(); j++) {
+			vector<int> cluster_faces;
+			cluster_faces.swap(faces[j]);
+			TriMesh *mesh = cluster_mesh(batch[j], cluster_faces,
+						     verts, own);
+			faces_loaded += cluster_faces.size();
+			vector<int>().swap(cluster_faces);
+			ok = visitor.visit(batch[j], mesh, verts, own);
+			delete mesh;
+		}
+	}
+
+	TriMesh::set_verbose(verbose);
+	return ok;
+}
+
+
+// Computes the curvatures of clusters to find the feature size: each
+// takes the vertices sampled in its box
+class OutOfCoreMesh::FeatureSizeVisitor : public OutOfCoreMesh::Visitor {
+public:
+	// For each leaf, the indices in which of the vertices in its box
+	vector< vector<int> > in_leaf;
+	const vector<int> &which;
+	vector<float> &samples;
+
+	FeatureSizeVisitor(int nleaves, const vector<int> &which_,
+			   vector<float> &samples_) :
+		in_leaf(nleaves), which(which_), samples(samples_)
+	{}
+	bool visit(int leaf, TriMesh *mesh, const vector<int> &verts,
+		   vector<char> & /*own*/)
+	{
+		mesh->need_normals();
+		mesh->need_curvatures();
+		const vector<int> &in = in_leaf[leaf];
+		for (size_t i = 0; i < in.size(); i++) {
+			int k = in[i];
+			// A vertex on no face has no curvature
+			vector<int>::const_iterator v = lower_bound(
+				verts.begin(), verts.end(), which[k]);
+			if (v == verts.end() || *v != which[k])
+				continue;
+			int j = v - verts.begin();
+			samples[2*k] = fabs(mesh->curv1[j]);
+			samples[2*k+1] = fabs(mesh->curv2[j]);
+		}
+		return true;
+	}
+};
+
+
+// The feature size mesh_feature_size() finds on the whole mesh.  The
+// curvatures at a vertex depend on the faces in two rings around it, all
+// of which are in the halo of the cluster whose box it is in.
+float OutOfCoreMesh::feature_size()
+{
+	if (mm.feature_size)
+		return *mm.feature_size;
+
+	vector<int> which;
+	feature_size_samples(mm.nv, which);
+	vector<float> samples(2 * which.size());
+
+	if (mm.curv1 && mm.curv2) {
+		for (size_t i = 0; i < which.size(); i++) {
+			samples[2*i] = fabs(mm.curv1[which[i]]);
+			samples[2*i+1] = fabs(mm.curv2[which[i]]);
+		}
+	} else {
+		FeatureSizeVisitor visitor(leaves.size(), which, samples);
+		vector<int> sampled;
+		for (size_t i = 0; i < which.size(); i++) {
+			int leaf = leaf_of(mm.vertices[which[i]]);
+			if (visitor.in_leaf[leaf].empty())
+				sampled.push_back(leaf);
+			visitor.in_leaf[leaf].push_back(i);
+		}
+		sort(sampled.begin(), sampled.end());
+		visit_clusters(sampled, visitor);
+	}
+
+	return feature_size_of_samples(samples, bsph.r);
+}
+
+
+// Computes what prepare_mesh() would on each cluster, and extracts the
+// lines on its own faces for every view
+class OutOfCoreMesh::ExtractVisitor : public OutOfCoreMesh::Visitor {
+public:
+	LineExtractor &extractor;
+	const vector<xform> &views;
+	bool do_hidden;
+	float feature_size;
+	ViewSink &sink;
+	LineSet lines, hidden;
+
+	ExtractVisitor(LineExtractor &extractor_, const vector<xform> &views_,
+		       bool do_hidden_, float feature_size_,
+		       ViewSink &sink_) :
+		extractor(extractor_), views(views_), do_hidden(do_hidden_),
+		feature_size(feature_size_), sink(sink_)
+	{}
+	bool visit(int /*leaf*/, TriMesh *mesh,
+		   const vector<int> & /*verts*/, vector<char> &own)
+	{
+		mesh->need_normals();
+		mesh->need_curvatures();
+		mesh->need_dcurv();
+		extractor.drawn_faces.swap(own);
+		extractor.set_mesh(mesh, feature_size);
+		extractor.prepare_views();
+		int nviews = views.size();
+		bool ok = true;
+		for (int v = 0; ok && v < nviews; v++) {
+			extractor.set_view(views[v]);
+			extractor.compute_perview();
+			extractor.extract(lines);
+			if (do_hidden)
+				extractor.extract(hidden, true);
+			ok = sink.view_done(v, views[v], lines,
+					    do_hidden ? &hidden : NULL);
+		}
+		extractor.drawn_faces.swap(own);
+		return ok;
+	}
+};
+
+
+// Extract the lines of each view, one cluster after another.  The views
+// of a cluster are also done one after another, each with all the
+// threads, so that there's only one copy of the per-view values.
+bool OutOfCoreMesh::extract_views(LineExtractor &extractor,
+				  const vector<xform> &views, bool do_hidden,
+				  float feature_size, ViewSink &sink)
+{
+	// The same options as extract_views() in multiview.h uses
+	LineOptions saved_opts = extractor.opts;
+	LineOptions opts = saved_opts;
+	opts.coherent = 0;
+	opts.threshold_sweep = 0;
+	opts.draw_hidden = do_hidden;
+	extractor.set_options(opts);
+
+	vector<int> all(leaves.size());
+	for (size_t i = 0; i < leaves.size(); i++)
+		all[i] = i;
+	ExtractVisitor visitor(extractor, views, do_hidden, feature_size,
+			       sink);
+	bool ok = visit_clusters(all, visitor);
+
+	extractor.set_options(saved_opts);
+	extractor.drawn_faces.clear();
+	extractor.themesh = NULL;
+	return ok;
+}
@@ -0,0 +1,150 @@
+/*
+outofcore.h
+Line extraction on meshes too large to hold in memory along with what
+prepare_mesh() computes, working from a memory-mapped .ldm file.
+
+The faces are split into clusters of nearby faces, each small enough that
+it fits in a memory budget with its normals, curvatures, dcurv and the
+extractor's per-view values.  A face belongs to the cluster its centroid
+falls in.  A cluster is loaded along with a halo of the three rings of
+faces around its own vertices that dcurv and the per-view values there
+depend on, so they come out as they would on the whole mesh, and so do
+the lines, which are only extracted on the cluster's own faces (see
+LineExtractor::drawn_faces).  The vertices and faces of a cluster keep
+the order they have in the file, so that this holds bit for bit, as long
+as the whole mesh isn't reordered either (see prepare_mesh).
+
+The halo is found without any connectivity for the whole mesh: the faces
+with a vertex within (halo_rings + 1) times the longest edge of the mesh
+of a cluster's box are listed, and the rings are then grown among them.
+A mesh with a few very long edges gets long lists.
+
+The clusters are the leaves of a kd-tree, split at the median of a sample
+of the face centroids.  They are loaded a batch at a time: one streaming
+pass over the faces lists the faces of every cluster in the batch, and
+then the clusters are built and processed one after another.
+*/
+
+#ifndef OUTOFCORE_H
+#define OUTOFCORE_H
+
+#include <stddef.h>
+#include <vector>
+#include "TriMesh.h"
+#include "XForm.h"
+#include "ldmesh.h"
+#include "lineextractor.h"
+#include "multiview.h"
+
+
+class OutOfCoreMesh {
+public:
+	// Rings of faces around a cluster's own vertices that its halo
+	// has to hold
+	static const int halo_rings = 3;
+
+	OutOfCoreMesh();
+
+	// Map a .ldm file and split it into clusters small enough that one,
+	// with everything computed and the lines of a view, and the face
+	// lists of a batch of them, take about budget bytes.  The clusters
+	// only depend on the file and the budget.
+	bool open(const char *filename, size_t budget);
+	void close();
+
+	int nclusters() const { return leaves.size(); }
+	int nfaces() const { return mm.nf; }
+	// The bounding sphere of the whole mesh: the one stored in the file,
+	// or else the one need_bsphere() finds
+	const TriMesh::BSphere &bsphere() const { return bsph; }
+	// How many faces, halos included, the last pass over the clusters
+	// loaded
+	double faces_loaded;
+
+	// The feature size stored in the file, or else the one
+	// mesh_feature_size() finds on the whole mesh.  Unless the file
+	// holds curvatures, they are computed on the clusters holding the
+	// vertices it samples.
+	float feature_size();
+
+	// Extract the lines of each view with the options of extractor, one
+	// cluster after another.  For each cluster, sink gets the lines on
+	// the cluster's faces for every view in turn, as from extract_views()
+	// in multiview.h but from one thread.  Returns false if the sink
+	// asked to stop.  The extractor is left without a mesh.
+	bool extract_views(LineExtractor &extractor,
+			   const std::vector<xform> &views, bool do_hidden,
+			   float feature_size, ViewSink &sink);
+
+private:
+	MappedMesh mm;
+	size_t budget;
+	TriMesh::BSphere bsph;
+	point bbox_min, bbox_max;
+	float margin;		// Of the halo, around each cluster's box
+
+	// The kd-tree: an inner node sends the points with p[axis] < split
+	// to child[0], and the others to child[1].  A leaf has axis -1 and
+	// its index in leaves as child[0].  The leaves below a node are
+	// first_leaf to last_leaf.
+	struct Node {
+		int axis;
+		float split;
+		int child[2];
+		int first_leaf, last_leaf;
+	};
+	std::vector<Node> nodes;
+	// A cluster: its box, and an estimate of its number of faces
+	struct Leaf {
+		point lo, hi;
+		int nfaces;
+	};
+	std::vector<Leaf> leaves;
+
+	int build_node(std::vector<point> &pts, int begin, int end,
+		       const point &lo, const point &hi, int stride,
+		       int target, int depth);
+	// The leaf a point falls in
+	int leaf_of(const point &p) const;
+	// The leaves from first to last whose boxes overlap the box from lo
+	// to hi
+	void leaves_near(const point &lo, const point &hi, int first, int last,
+			 std::vector<int> &out) const;
+	// The point that decides which cluster a face belongs to
+	point centroid(int face) const;
+
+	// Receives each cluster built by visit_clusters()
+	class Visitor {
+	public:
+		virtual ~Visitor() {}
+		// mesh holds cluster leaf and its halo.  verts maps its
+		// vertices to those of the file, and own marks the faces
+		// that belong to the cluster itself (and can be taken).
+		// Returns false to stop.
+		virtual bool visit(int leaf, TriMesh *mesh,
+				   const std::vector<int> &verts,
+				   std::vector<char> &own) = 0;
+	};
+	// Build the clusters in which (in increasing order), a batch at a
+	// time, and hand them to visitor.  Returns false if it asked to stop.
+	bool visit_clusters(const std::vector<int> &which, Visitor &visitor);
+	// List the faces of the clusters in batch, halos included, in
+	// increasing order, leaving out clusters at the end of the batch if
+	// that's more than max_listed
+	void find_cluster_faces(std::vector<int> &batch, size_t max_listed,
+				std::vector< std::vector<int> > &faces) const;
+	// Make the mesh of cluster leaf from the faces listed for it, and
+	// keep only those it uses
+	TriMesh *cluster_mesh(int leaf, std::vector<int> &faces,
+			      std::vector<int> &verts,
+			      std::vector<char> &own) const;
+
+	class FeatureSizeVisitor;
+	class ExtractVisitor;
+
+	// Not copyable
+	OutOfCoreMesh(const OutOfCoreMesh &);
+	OutOfCoreMesh &operator = (const OutOfCoreMesh &);
+};
+
+#endif
@@ -0,0 +1,833 @@
+/*
+perview.cpp
+Vectorized computation of the per-view quantities used by the line
+extractor.  See perview.h.
+
+All three kernels evaluate the same expressions as the scalar code did
+in compute_perview, operation for operation, with no fused multiply-adds
+and no reciprocal approximations.  Build with -ffp-contract=off (as the
+.pro files do for gcc) so the compiler doesn't fuse the scalar path.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "perview.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+# define PERVIEW_X86 1
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#else
+# define PERVIEW_X86 0
+#endif
+
+// gcc and clang need to be told a function may use AVX or SSE
+// instructions; MSVC lets any function use the intrinsics.
+#if PERVIEW_X86 && defined(__GNUC__)
+# define PERVIEW_TARGET_SSE __attribute__((target("sse")))
+# define PERVIEW_TARGET_AVX __attribute__((target("avx")))
+#else
+# define PERVIEW_TARGET_SSE
+# define PERVIEW_TARGET_AVX
+#endif
+
+using namespace std;
+
+
+// Copy the data out of the mesh
+void PerviewPack::build(const TriMesh *mesh)
+{
+	nv = mesh->vertices.size();
+	vector<float> *fields[] = { &vx, &vy, &vz, &nx, &ny, &nz,
+				    &p1x, &p1y, &p1z, &p2x, &p2y, &p2z,
+				    &c1, &c2, &d0, &d1, &d2, &d3 };
+	const int nfields = sizeof(fields) / sizeof(fields[0]);
+	for (int f = 0; f < nfields; f++)
+		fields[f]->resize(nv);
+
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		const point &p = mesh->vertices[i];
+		const vec &n = mesh->normals[i];
+		const vec &e1 = mesh->pdir1[i], &e2 = mesh->pdir2[i];
+		const Vec<4> &C = mesh->dcurv[i];
+		vx[i] = p[0];   vy[i] = p[1];   vz[i] = p[2];
+		nx[i] = n[0];   ny[i] = n[1];   nz[i] = n[2];
+		p1x[i] = e1[0]; p1y[i] = e1[1]; p1z[i] = e1[2];
+		p2x[i] = e2[0]; p2y[i] = e2[1]; p2z[i] = e2[2];
+		c1[i] = mesh->curv1[i];
+		c2[i] = mesh->curv2[i];
+		d0[i] = C[0];   d1[i] = C[1];   d2[i] = C[2];   d3[i] = C[3];
+	}
+}
+
+
+// Free the memory
+void PerviewPack::clear()
+{
+	*this = PerviewPack();
+}
+
+
+// The scalar kernel, for one vertex.  Also used for the leftover
+// vertices at the end of the vector kernels.
+static inline void perview_one(const PerviewPack &p, const PerviewArgs &a,
+			       int i)
+{
+	// Compute n DOT v
+	float wx = a.viewpos[0] - p.vx[i];
+	float wy = a.viewpos[1] - p.vy[i];
+	float wz = a.viewpos[2] - p.vz[i];
+	float rlv = 1.0f / sqrtf(wx*wx + wy*wy + wz*wz);
+	wx *= rlv; wy *= rlv; wz *= rlv;
+	float ndotv = wx*p.nx[i] + wy*p.ny[i] + wz*p.nz[i];
+
+	float u = wx*p.p1x[i] + wy*p.p1y[i] + wz*p.p1z[i], u2 = u*u;
+	float v = wx*p.p2x[i] + wy*p.p2y[i] + wz*p.p2z[i], v2 = v*v;
+
+	// Note:  this is actually Kr * sin^2 theta
+	a.ndotv[i] = ndotv;
+	a.kr[i] = p.c1[i] * u2 + p.c2[i] * v2;
+	if (!a.sctest_num)
+		return;
+
+	// Use DwKr * sin(theta) / cos(theta) for cutoff test
+	float num = u2 * (     u*p.d0[i] + 3.0f*v*p.d1[i]) +
+		    v2 * (3.0f*u*p.d2[i] +      v*p.d3[i]);
+	float csc2theta = 1.0f / (u2 + v2);
+	num *= csc2theta;
+	float tr = (p.c2[i] - p.c1[i]) * u * v * csc2theta;
+	num -= 2.0f * ndotv * (tr * tr);
+	if (a.extra_sin2theta)
+		num *= u2 + v2;
+
+	a.sctest_den[i] = ndotv;
+	if (a.shtest_num)
+		a.shtest_num[i] = -num - a.shthresh * ndotv;
+	a.sctest_num[i] = num - a.scthresh * ndotv;
+}
+
+
+static void perview_scalar(const PerviewPack &p, const PerviewArgs &a,
+			   int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+		perview_one(p, a, i);
+}
+
+
+#if PERVIEW_X86
+
+// The kernel body, written once for both vector widths.  Expects the
+// intrinsics for the width at hand to be #defined as V_ADD etc.
+// Negation is done by flipping the sign bit, as in the scalar code.
+#define PERVIEW_VECTOR_BODY(W) \
+	const VT vpx = V_SET1(a.viewpos[0]); \
+	const VT vpy = V_SET1(a.viewpos[1]); \
+	const VT vpz = V_SET1(a.viewpos[2]); \
+	const VT one = V_SET1(1.0f), two = V_SET1(2.0f), three = V_SET1(3.0f); \
+	const VT scthresh = V_SET1(a.scthresh), shthresh = V_SET1(a.shthresh); \
+	const VT signbit = V_SET1(-0.0f); \
+	int i = begin; \
+	for ( ; i + W <= end; i += W) { \
+		VT wx = V_SUB(vpx, V_LOAD(&p.vx[i])); \
+		VT wy = V_SUB(vpy, V_LOAD(&p.vy[i])); \
+		VT wz = V_SUB(vpz, V_LOAD(&p.vz[i])); \
+		VT l2 = V_ADD(V_ADD(V_MUL(wx, wx), V_MUL(wy, wy)), V_MUL(wz, wz)); \
+		VT rlv = V_DIV(one, V_SQRT(l2)); \
+		wx = V_MUL(wx, rlv); wy = V_MUL(wy, rlv); wz = V_MUL(wz, rlv); \
+		VT ndotv = V_ADD(V_ADD(V_MUL(wx, V_LOAD(&p.nx[i])), \
+				       V_MUL(wy, V_LOAD(&p.ny[i]))), \
+				 V_MUL(wz, V_LOAD(&p.nz[i]))); \
+		VT u = V_ADD(V_ADD(V_MUL(wx, V_LOAD(&p.p1x[i])), \
+				   V_MUL(wy, V_LOAD(&p.p1y[i]))), \
+			     V_MUL(wz, V_LOAD(&p.p1z[i]))); \
+		VT v = V_ADD(V_ADD(V_MUL(wx, V_LOAD(&p.p2x[i])), \
+				   V_MUL(wy, V_LOAD(&p.p2y[i]))), \
+			     V_MUL(wz, V_LOAD(&p.p2z[i]))); \
+		VT u2 = V_MUL(u, u), v2 = V_MUL(v, v); \
+		VT c1 = V_LOAD(&p.c1[i]), c2 = V_LOAD(&p.c2[i]); \
+		V_STORE(&a.ndotv[i], ndotv); \
+		V_STORE(&a.kr[i], V_ADD(V_MUL(c1, u2), V_MUL(c2, v2))); \
+		if (!a.sctest_num) \
+			continue; \
+		VT num = V_ADD( \
+			V_MUL(u2, V_ADD(V_MUL(u, V_LOAD(&p.d0[i])), \
+					V_MUL(V_MUL(three, v), V_LOAD(&p.d1[i])))), \
+			V_MUL(v2, V_ADD(V_MUL(V_MUL(three, u), V_LOAD(&p.d2[i])), \
+					V_MUL(v, V_LOAD(&p.d3[i]))))); \
+		VT sin2theta = V_ADD(u2, v2); \
+		VT csc2theta = V_DIV(one, sin2theta); \
+		num = V_MUL(num, csc2theta); \
+		VT tr = V_MUL(V_MUL(V_MUL(V_SUB(c2, c1), u), v), csc2theta); \
+		num = V_SUB(num, V_MUL(V_MUL(two, ndotv), V_MUL(tr, tr))); \
+		if (a.extra_sin2theta) \
+			num = V_MUL(num, sin2theta); \
+		V_STORE(&a.sctest_den[i], ndotv); \
+		if (a.shtest_num) \
+			V_STORE(&a.shtest_num[i], V_SUB(V_XOR(num, signbit), \
+						V_MUL(shthresh, ndotv))); \
+		V_STORE(&a.sctest_num[i], V_SUB(num, V_MUL(scthresh, ndotv))); \
+	} \
+	for ( ; i < end; i++) \
+		perview_one(p, a, i);
+
+
+// 4 vertices at a time
+PERVIEW_TARGET_SSE
+static void perview_sse(const PerviewPack &p, const PerviewArgs &a,
+			int begin, int end)
+{
+#define VT __m128
+#define V_SET1 _mm_set1_ps
+#define V_LOAD _mm_loadu_ps
+#define V_STORE _mm_storeu_ps
+#define V_ADD _mm_add_ps
+#define V_SUB _mm_sub_ps
+#define V_MUL _mm_mul_ps
+#define V_DIV _mm_div_ps
+#define V_SQRT _mm_sqrt_ps
+#define V_XOR _mm_xor_ps
+	PERVIEW_VECTOR_BODY(4)
+#undef VT
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_XOR
+}
+
+
+// 8 vertices at a time
+PERVIEW_TARGET_AVX
+static void perview_avx(const PerviewPack &p, const PerviewArgs &a,
+			int begin, int end)
+{
+#define VT __m256
+#define V_SET1 _mm256_set1_ps
+#define V_LOAD _mm256_loadu_ps
+#define V_STORE _mm256_storeu_ps
+#define V_ADD _mm256_add_ps
+#define V_SUB _mm256_sub_ps
+#define V_MUL _mm256_mul_ps
+#define V_DIV _mm256_div_ps
+#define V_SQRT _mm256_sqrt_ps
+#define V_XOR _mm256_xor_ps
+	PERVIEW_VECTOR_BODY(8)
+#undef VT
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_XOR
+}
+
+
+static void cpuid(int info[4], int leaf)
+{
+#ifdef _MSC_VER
+	__cpuid(info, leaf);
+#else
+	unsigned a, b, c, d;
+	__cpuid(leaf, a, b, c, d);
+	info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+}
+
+
+// Does the OS save the SSE and AVX registers on context switches?
+static bool os_saves_ymm()
+{
+#ifdef _MSC_VER
+	return (_xgetbv(0) & 6) == 6;
+#else
+	unsigned a, d;
+	__asm__ __volatile__ ("xgetbv" : "=a" (a), "=d" (d) : "c" (0));
+	return (a & 6) == 6;
+#endif
+}
+
+#endif // PERVIEW_X86
+
+
+// Find what the CPU supports
+static PerviewKernel detect_kernel()
+{
+#if PERVIEW_X86
+	int info[4];
+	cpuid(info, 0);
+	if (info[0] < 1)
+		return PERVIEW_SCALAR;
+	cpuid(info, 1);
+	bool has_sse = (info[3] & (1 << 25)) != 0;
+	bool has_osxsave = (info[2] & (1 << 27)) != 0;
+	bool has_avx = (info[2] & (1 << 28)) != 0;
+	if (has_avx && has_osxsave && os_saves_ymm())
+		return PERVIEW_AVX;
+	if (has_sse)
+		return PERVIEW_SSE;
+#endif
+	return PERVIEW_SCALAR;
+}
+
+
+// The best kernel supported by this CPU, or the one asked for
+// in LINEDRAWING_SIMD if that is slower
+PerviewKernel perview_kernel()
+{
+	static int k = -1;
+	if (k < 0) {
+		PerviewKernel best = detect_kernel();
+		PerviewKernel want = best;
+		const char *env = getenv("LINEDRAWING_SIMD");
+		if (env && !strcmp(env, "scalar"))
+			want = PERVIEW_SCALAR;
+		else if (env && !strcmp(env, "sse"))
+			want = PERVIEW_SSE;
+		k = (want < best) ? want : best;
+	}
+	return PerviewKernel(k);
+}
+
+
+const char *perview_kernel_name(PerviewKernel k)
+{
+	switch (k) {
+		case PERVIEW_AVX: return "avx";
+		case PERVIEW_SSE: return "sse";
+		default: return "scalar";
+	}
+}
+
+
+// Compute the per-view quantities for vertices [begin, end)
+void compute_perview_pack(const PerviewPack &pack, const PerviewArgs &args,
+			  int begin, int end, PerviewKernel k)
+{
+#if PERVIEW_X86
+	if (k == PERVIEW_AVX) {
+		perview_avx(pack, args, begin, end);
+		return;
+	}
+	if (k == PERVIEW_SSE) {
+		perview_sse(pack, args, begin, end);
+		return;
+	}
+#endif
+	perview_scalar(pack, args, begin, end);
+}
+
+
+// How far the view position can move from args.viewpos before any of the
+// quantities computed at vertices [begin, end) could change sign, or the
+// unit view direction w at the vertex could turn by more than slack
+// (squared, in radius2).
+// The bounds are Lipschitz bounds in terms of |dw|, which is at most
+// 2 |dp| / (|viewpos - v| + |viewpos + dp - v|) when the view position
+// moves by dp.
+void compute_perview_radius(const PerviewPack &p, const PerviewArgs &a,
+			    float slack, int begin, int end, float *radius2)
+{
+	for (int i = begin; i < end; i++) {
+		float wx = a.viewpos[0] - p.vx[i];
+		float wy = a.viewpos[1] - p.vy[i];
+		float wz = a.viewpos[2] - p.vz[i];
+		float lv = sqrtf(wx*wx + wy*wy + wz*wz);
+		wx /= lv; wy /= lv; wz /= lv;
+
+		// n.v changes by at most |dw|
+		float r = slack;
+		float ndotv = a.ndotv[i];
+		if (fabsf(ndotv) < r)
+			r = fabsf(ndotv);
+
+		// kr sin^2 theta = k1 u^2 + k2 v^2, where u and v change by
+		// at most |dw|, so it changes by at most 2 (|k1| + |k2|) |dw|
+		float lkr = 2.0f * (fabsf(p.c1[i]) + fabsf(p.c2[i]));
+		if (fabsf(a.kr[i]) < lkr * r)
+			r = fabsf(a.kr[i]) / lkr;
+
+		if (a.sctest_num) {
+			// The tests divide by sin^2 theta = u^2 + v^2: don't
+			// let sin theta drop below half its current value
+			float u = wx*p.p1x[i] + wy*p.p1y[i] + wz*p.p1z[i];
+			float v = wx*p.p2x[i] + wy*p.p2y[i] + wz*p.p2z[i];
+			float s2 = u*u + v*v, s = sqrtf(s2);
+			if (0.5f * s < r)
+				r = 0.5f * s;
+
+			// The cubic term of num is homogeneous of degree 1 in
+			// (u,v), with gradient at most 5 D.  The torsion term
+			// is 2 n.v (k2-k1)^2 cos^2 phi sin^2 phi, with gradient
+			// at most (k2-k1)^2 (1/2 + 2 / sin theta).
+			float D = fabsf(p.d0[i]) + 3.0f * fabsf(p.d1[i]) +
+				  3.0f * fabsf(p.d2[i]) + fabsf(p.d3[i]);
+			float dk2 = (p.c2[i] - p.c1[i]) * (p.c2[i] - p.c1[i]);
+			float lnum = 5.0f * D;
+			if (s > 0.0f)
+				lnum += dk2 * (0.5f + 2.0f / s);
+			if (a.extra_sin2theta && s > 0.0f) {
+				// num * sin^2 theta, with sin theta <= 1.5 s
+				float num = fabsf(a.sctest_num[i] +
+						  a.scthresh * ndotv) / s2;
+				lnum = lnum * 2.25f * s2 +
+				       (num + 0.5f * lnum * s) * 3.0f * s;
+			}
+
+			float lsc = lnum + a.scthresh;
+			if (fabsf(a.sctest_num[i]) < lsc * r)
+				r = fabsf(a.sctest_num[i]) / lsc;
+			if (a.shtest_num) {
+				float lsh = lnum + a.shthresh;
+				if (fabsf(a.shtest_num[i]) < lsh * r)
+					r = fabsf(a.shtest_num[i]) / lsh;
+			}
+			if (!(s > 0.0f))
+				r = 0.0f;
+		}
+
+		float radius = r * lv / (1.0f + 0.5f * r);
+		radius2[i] = radius * radius;
+	}
+}
+
+
+// The scalar gradient of kr * sin^2 theta, for one vertex.  Also used
+// for the leftover vertices at the end of the vector kernels.
+static inline void gradkr_one(const PerviewPack &p, const point &viewpos,
+			      int i, vec &grad)
+{
+	float wx = viewpos[0] - p.vx[i];
+	float wy = viewpos[1] - p.vy[i];
+	float wz = viewpos[2] - p.vz[i];
+	float rlen_viewdir = 1.0f / sqrtf(wx*wx + wy*wy + wz*wz);
+	wx *= rlen_viewdir; wy *= rlen_viewdir; wz *= rlen_viewdir;
+
+	float ndotv = wx*p.nx[i] + wy*p.ny[i] + wz*p.nz[i];
+	float sin2theta = 1.0f - ndotv*ndotv;
+	float sintheta = sqrtf(sin2theta);
+	float csctheta = 1.0f / sintheta;
+	float u = (wx*p.p1x[i] + wy*p.p1y[i] + wz*p.p1z[i]) * csctheta;
+	float v = (wx*p.p2x[i] + wy*p.p2y[i] + wz*p.p2z[i]) * csctheta;
+	float c1 = p.c1[i], c2 = p.c2[i];
+	float kr = c1 * u*u + c2 * v*v;
+	float tr = u*v * (c2 - c1);
+	float kt = c1 * (1.0f - u*u) + c2 * (1.0f - v*v);
+
+	// g = pdir1 * s1 + pdir2 * s2 - s3 * (w / |viewdir| +
+	//     n.v (tr w + kt wperp)), times sin^2 theta, minus s4 (kr w +
+	//     tr wperp), where w and wperp are the projected view direction
+	//     and its perpendicular, in terms of pdir1 and pdir2
+	float s1 = u*u*p.d0[i] + 2.0f*u*v*p.d1[i] + v*v*p.d2[i];
+	float s2 = u*u*p.d1[i] + 2.0f*u*v*p.d2[i] + v*v*p.d3[i];
+	float s3 = 2.0f * csctheta * tr;
+	float s4 = 2.0f * kr * sintheta * ndotv;
+	const float e1[3] = { p.p1x[i], p.p1y[i], p.p1z[i] };
+	const float e2[3] = { p.p2x[i], p.p2y[i], p.p2z[i] };
+	for (int k = 0; k < 3; k++) {
+		float w = u*e1[k] + v*e2[k], wperp = u*e2[k] - v*e1[k];
+		float g = e1[k]*s1 + e2[k]*s2 -
+			  s3 * (rlen_viewdir*wperp + ndotv*(tr*w + kt*wperp));
+		g *= sin2theta;
+		g -= s4 * (kr*w + tr*wperp);
+		grad[k] = g;
+	}
+}
+
+
+static void gradkr_scalar(const PerviewPack &p, const point &viewpos,
+			  const int *verts, int n, vec *grad)
+{
+	for (int i = 0; i < n; i++)
+		gradkr_one(p, viewpos, verts[i], grad[verts[i]]);
+}
+
+
+#if PERVIEW_X86
+
+// The gradkr kernel body, for both vector widths.  The vertices are
+// gathered from the pack with V_GATHER, which loads field[ix[0..W-1]].
+#define GRADKR_VECTOR_BODY(W) \
+	const VT vpx = V_SET1(viewpos[0]); \
+	const VT vpy = V_SET1(viewpos[1]); \
+	const VT vpz = V_SET1(viewpos[2]); \
+	const VT one = V_SET1(1.0f), two = V_SET1(2.0f); \
+	int i = 0; \
+	for ( ; i + W <= n; i += W) { \
+		const int *ix = &verts[i]; \
+		VT wx = V_SUB(vpx, V_GATHER(p.vx)); \
+		VT wy = V_SUB(vpy, V_GATHER(p.vy)); \
+		VT wz = V_SUB(vpz, V_GATHER(p.vz)); \
+		VT l2 = V_ADD(V_ADD(V_MUL(wx, wx), V_MUL(wy, wy)), V_MUL(wz, wz)); \
+		VT rlv = V_DIV(one, V_SQRT(l2)); \
+		wx = V_MUL(wx, rlv); wy = V_MUL(wy, rlv); wz = V_MUL(wz, rlv); \
+		VT ndotv = V_ADD(V_ADD(V_MUL(wx, V_GATHER(p.nx)), \
+				       V_MUL(wy, V_GATHER(p.ny))), \
+				 V_MUL(wz, V_GATHER(p.nz))); \
+		VT sin2theta = V_SUB(one, V_MUL(ndotv, ndotv)); \
+		VT sintheta = V_SQRT(sin2theta); \
+		VT csctheta = V_DIV(one, sintheta); \
+		VT e1[3] = { V_GATHER(p.p1x), V_GATHER(p.p1y), V_GATHER(p.p1z) }; \
+		VT e2[3] = { V_GATHER(p.p2x), V_GATHER(p.p2y), V_GATHER(p.p2z) }; \
+		VT u = V_MUL(V_ADD(V_ADD(V_MUL(wx, e1[0]), V_MUL(wy, e1[1])), \
+				   V_MUL(wz, e1[2])), csctheta); \
+		VT v = V_MUL(V_ADD(V_ADD(V_MUL(wx, e2[0]), V_MUL(wy, e2[1])), \
+				   V_MUL(wz, e2[2])), csctheta); \
+		VT c1 = V_GATHER(p.c1), c2 = V_GATHER(p.c2); \
+		VT uu = V_MUL(u, u), vv = V_MUL(v, v); \
+		VT kr = V_ADD(V_MUL(V_MUL(c1, u), u), V_MUL(V_MUL(c2, v), v)); \
+		VT tr = V_MUL(V_MUL(u, v), V_SUB(c2, c1)); \
+		VT kt = V_ADD(V_MUL(c1, V_SUB(one, uu)), V_MUL(c2, V_SUB(one, vv))); \
+		VT d0 = V_GATHER(p.d0), d1 = V_GATHER(p.d1); \
+		VT d2 = V_GATHER(p.d2), d3 = V_GATHER(p.d3); \
+		VT uv2 = V_MUL(V_MUL(two, u), v); \
+		VT s1 = V_ADD(V_ADD(V_MUL(uu, d0), V_MUL(uv2, d1)), V_MUL(vv, d2)); \
+		VT s2 = V_ADD(V_ADD(V_MUL(uu, d1), V_MUL(uv2, d2)), V_MUL(vv, d3)); \
+		VT s3 = V_MUL(V_MUL(two, csctheta), tr); \
+		VT s4 = V_MUL(V_MUL(V_MUL(two, kr), sintheta), ndotv); \
+		float g[3][W]; \
+		for (int k = 0; k < 3; k++) { \
+			VT w = V_ADD(V_MUL(u, e1[k]), V_MUL(v, e2[k])); \
+			VT wperp = V_SUB(V_MUL(u, e2[k]), V_MUL(v, e1[k])); \
+			VT inner = V_ADD(V_MUL(rlv, wperp), V_MUL(ndotv, \
+				V_ADD(V_MUL(tr, w), V_MUL(kt, wperp)))); \
+			VT gk = V_SUB(V_ADD(V_MUL(e1[k], s1), V_MUL(e2[k], s2)), \
+				      V_MUL(s3, inner)); \
+			gk = V_MUL(gk, sin2theta); \
+			gk = V_SUB(gk, V_MUL(s4, V_ADD(V_MUL(kr, w), \
+						       V_MUL(tr, wperp)))); \
+			V_STORE(g[k], gk); \
+		} \
+		for (int l = 0; l < W; l++) \
+			grad[ix[l]] = vec(g[0][l], g[1][l], g[2][l]); \
+	} \
+	for ( ; i < n; i++) \
+		gradkr_one(p, viewpos, verts[i], grad[verts[i]]);
+
+
+// 4 vertices at a time
+PERVIEW_TARGET_SSE
+static void gradkr_sse(const PerviewPack &p, const point &viewpos,
+		       const int *verts, int n, vec *grad)
+{
+#define VT __m128
+#define V_SET1 _mm_set1_ps
+#define V_STORE _mm_storeu_ps
+#define V_ADD _mm_add_ps
+#define V_SUB _mm_sub_ps
+#define V_MUL _mm_mul_ps
+#define V_DIV _mm_div_ps
+#define V_SQRT _mm_sqrt_ps
+#define V_GATHER(f) _mm_setr_ps(f[ix[0]], f[ix[1]], f[ix[2]], f[ix[3]])
+	GRADKR_VECTOR_BODY(4)
+#undef VT
+#undef V_SET1
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_GATHER
+}
+
+
+// 8 vertices at a time
+PERVIEW_TARGET_AVX
+static void gradkr_avx(const PerviewPack &p, const point &viewpos,
+		       const int *verts, int n, vec *grad)
+{
+#define VT __m256
+#define V_SET1 _mm256_set1_ps
+#define V_STORE _mm256_storeu_ps
+#define V_ADD _mm256_add_ps
+#define V_SUB _mm256_sub_ps
+#define V_MUL _mm256_mul_ps
+#define V_DIV _mm256_div_ps
+#define V_SQRT _mm256_sqrt_ps
+#define V_GATHER(f) _mm256_setr_ps(f[ix[0]], f[ix[1]], f[ix[2]], f[ix[3]], \
+				   f[ix[4]], f[ix[5]], f[ix[6]], f[ix[7]])
+	GRADKR_VECTOR_BODY(8)
+#undef VT
+#undef V_SET1
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_GATHER
+}
+
+#endif // PERVIEW_X86
+
+
+// Compute the gradient of kr at the vertices in verts
+void compute_gradkr_pack(const PerviewPack &pack, const point &viewpos,
+			 const int *verts, int n, vec *grad, PerviewKernel k)
+{
+#if PERVIEW_X86
+	if (k == PERVIEW_AVX) {
+		gradkr_avx(pack, viewpos, verts, n, grad);
+		return;
+	}
+	if (k == PERVIEW_SSE) {
+		gradkr_sse(pack, viewpos, verts, n, grad);
+		return;
+	}
+#endif
+	gradkr_scalar(pack, viewpos, verts, n, grad);
+}
+
+// The scalar Hermite zero finder, for one cubic.  Also used for the
+// leftover cubics at the end of the vector kernels.
+static inline float hermite_one(float a, float b, float c,
+				float val0, float val1)
+{
+	if (val0 == val1)
+		return 0.5f;
+	float d = val0;
+
+	// -- Find a root by bisection
+	// (as Newton can wander out of desired interval)
+
+	// Start with entire [0,1] interval
+	float sl = 0.0f, sr = 1.0f, valsl = val0;
+
+	// Check if we're in a (somewhat uncommon) 3-root situation, and pick
+	// the middle root if it happens (given we aren't drawing curvy lines,
+	// seems the best approach..)
+	//
+	// Find extrema of derivative (a -> 3a; b -> 2b, c -> c),
+	// and check if they're both in [0,1] and have different signs
+	float disc = 4 * b - 12 * a * c;
+	if (disc > 0 && a != 0) {
+		disc = sqrtf(disc);
+		float r1 = (-2 * b + disc) / (6 * a);
+		float r2 = (-2 * b - disc) / (6 * a);
+		if (r1 >= 0 && r1 <= 1 && r2 >= 0 && r2 <= 1) {
+			float vr1 = (((a * r1 + b) * r1 + c) * r1) + d;
+			float vr2 = (((a * r2 + b) * r2 + c) * r2) + d;
+			// When extrema have different signs inside an
+			// interval with endpoints with different signs,
+			// the middle root is in between the two extrema
+			if ((vr1 < 0.0f && vr2 >= 0.0f) ||
+			    (vr1 > 0.0f && vr2 <= 0.0f)) {
+				// 3 roots
+				if (r1 < r2) {
+					sl = r1;
+					valsl = vr1;
+					sr = r2;
+				} else {
+					sl = r2;
+					valsl = vr2;
+					sr = r1;
+				}
+			}
+		}
+	}
+
+	// Bisection method (constant number of interations)
+	for (int iter = 0; iter < 10; iter++) {
+		float sbi = (sl + sr) / 2.0f;
+		float valsbi = (((a * sbi + b) * sbi) + c) * sbi + d;
+
+		// Keep the half which has different signs
+		if ((valsl < 0.0f && valsbi >= 0.0f) ||
+		    (valsl > 0.0f && valsbi <= 0.0f)) {
+			sr = sbi;
+		} else {
+			sl = sbi;
+			valsl = valsbi;
+		}
+	}
+
+	return 0.5f * (sl + sr);
+}
+
+
+static void hermite_scalar(int n, const float *a, const float *b,
+			   const float *c, const float *val0,
+			   const float *val1, float *s)
+{
+	for (int i = 0; i < n; i++)
+		s[i] = hermite_one(a[i], b[i], c[i], val0[i], val1[i]);
+}
+
+
+#if PERVIEW_X86
+
+// The Hermite kernel body, for both vector widths.  Both branches of
+// each "if" in hermite_one are evaluated, and the one wanted is picked
+// lane by lane with V_SEL.  Halving is done by multiplying by 0.5, which
+// gives the same result as dividing by 2.
+#define V_SEL(m, x, y) V_OR(V_AND(m, x), V_ANDNOT(m, y))
+#define HERMITE_VECTOR_BODY(W) \
+	const VT zero = V_SET1(0.0f), one = V_SET1(1.0f); \
+	const VT half = V_SET1(0.5f), mtwo = V_SET1(-2.0f); \
+	const VT four = V_SET1(4.0f), six = V_SET1(6.0f); \
+	const VT twelve = V_SET1(12.0f); \
+	int i = 0; \
+	for ( ; i + W <= n; i += W) { \
+		VT ca = V_LOAD(&a[i]), cb = V_LOAD(&b[i]), cc = V_LOAD(&c[i]); \
+		VT d = V_LOAD(&val0[i]), v1 = V_LOAD(&val1[i]); \
+		VT sl = zero, sr = one, valsl = d; \
+		VT disc = V_SUB(V_MUL(four, cb), V_MUL(V_MUL(twelve, ca), cc)); \
+		VT three = V_AND(V_GT(disc, zero), V_NEQ(ca, zero)); \
+		disc = V_SQRT(disc); \
+		VT r1 = V_DIV(V_ADD(V_MUL(mtwo, cb), disc), V_MUL(six, ca)); \
+		VT r2 = V_DIV(V_SUB(V_MUL(mtwo, cb), disc), V_MUL(six, ca)); \
+		three = V_AND(three, V_AND(V_AND(V_GE(r1, zero), V_LE(r1, one)), \
+					   V_AND(V_GE(r2, zero), V_LE(r2, one)))); \
+		VT vr1 = V_ADD(V_MUL(V_ADD(V_MUL(V_ADD(V_MUL(ca, r1), cb), r1), \
+					   cc), r1), d); \
+		VT vr2 = V_ADD(V_MUL(V_ADD(V_MUL(V_ADD(V_MUL(ca, r2), cb), r2), \
+					   cc), r2), d); \
+		three = V_AND(three, V_OR(V_AND(V_LT(vr1, zero), V_GE(vr2, zero)), \
+					  V_AND(V_GT(vr1, zero), V_LE(vr2, zero)))); \
+		VT r1first = V_LT(r1, r2); \
+		sl = V_SEL(three, V_SEL(r1first, r1, r2), sl); \
+		valsl = V_SEL(three, V_SEL(r1first, vr1, vr2), valsl); \
+		sr = V_SEL(three, V_SEL(r1first, r2, r1), sr); \
+		for (int iter = 0; iter < 10; iter++) { \
+			VT sbi = V_MUL(V_ADD(sl, sr), half); \
+			VT valsbi = V_ADD(V_MUL(V_ADD(V_MUL(V_ADD(V_MUL(ca, sbi), \
+					cb), sbi), cc), sbi), d); \
+			VT left = V_OR(V_AND(V_LT(valsl, zero), V_GE(valsbi, zero)), \
+				       V_AND(V_GT(valsl, zero), V_LE(valsbi, zero))); \
+			sr = V_SEL(left, sbi, sr); \
+			sl = V_SEL(left, sl, sbi); \
+			valsl = V_SEL(left, valsl, valsbi); \
+		} \
+		VT si = V_MUL(half, V_ADD(sl, sr)); \
+		V_STORE(&s[i], V_SEL(V_EQ(d, v1), half, si)); \
+	} \
+	for ( ; i < n; i++) \
+		s[i] = hermite_one(a[i], b[i], c[i], val0[i], val1[i]);
+
+
+// 4 edges at a time
+PERVIEW_TARGET_SSE
+static void hermite_sse(int n, const float *a, const float *b,
+			const float *c, const float *val0,
+			const float *val1, float *s)
+{
+#define VT __m128
+#define V_SET1 _mm_set1_ps
+#define V_LOAD _mm_loadu_ps
+#define V_STORE _mm_storeu_ps
+#define V_ADD _mm_add_ps
+#define V_SUB _mm_sub_ps
+#define V_MUL _mm_mul_ps
+#define V_DIV _mm_div_ps
+#define V_SQRT _mm_sqrt_ps
+#define V_AND _mm_and_ps
+#define V_ANDNOT _mm_andnot_ps
+#define V_OR _mm_or_ps
+#define V_LT _mm_cmplt_ps
+#define V_LE _mm_cmple_ps
+#define V_GT _mm_cmpgt_ps
+#define V_GE _mm_cmpge_ps
+#define V_EQ _mm_cmpeq_ps
+#define V_NEQ _mm_cmpneq_ps
+	HERMITE_VECTOR_BODY(4)
+#undef VT
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_AND
+#undef V_ANDNOT
+#undef V_OR
+#undef V_LT
+#undef V_LE
+#undef V_GT
+#undef V_GE
+#undef V_EQ
+#undef V_NEQ
+}
+
+
+// 8 edges at a time.  The comparisons are ordered, as in C, except for
+// != which is true for NaNs.
+PERVIEW_TARGET_AVX
+static void hermite_avx(int n, const float *a, const float *b,
+			const float *c, const float *val0,
+			const float *val1, float *s)
+{
+#define VT __m256
+#define V_SET1 _mm256_set1_ps
+#define V_LOAD _mm256_loadu_ps
+#define V_STORE _mm256_storeu_ps
+#define V_ADD _mm256_add_ps
+#define V_SUB _mm256_sub_ps
+#define V_MUL _mm256_mul_ps
+#define V_DIV _mm256_div_ps
+#define V_SQRT _mm256_sqrt_ps
+#define V_AND _mm256_and_ps
+#define V_ANDNOT _mm256_andnot_ps
+#define V_OR _mm256_or_ps
+#define V_LT(x, y) _mm256_cmp_ps(x, y, _CMP_LT_OQ)
+#define V_LE(x, y) _mm256_cmp_ps(x, y, _CMP_LE_OQ)
+#define V_GT(x, y) _mm256_cmp_ps(x, y, _CMP_GT_OQ)
+#define V_GE(x, y) _mm256_cmp_ps(x, y, _CMP_GE_OQ)
+#define V_EQ(x, y) _mm256_cmp_ps(x, y, _CMP_EQ_OQ)
+#define V_NEQ(x, y) _mm256_cmp_ps(x, y, _CMP_NEQ_UQ)
+	HERMITE_VECTOR_BODY(8)
+#undef VT
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+#undef V_DIV
+#undef V_SQRT
+#undef V_AND
+#undef V_ANDNOT
+#undef V_OR
+#undef V_LT
+#undef V_LE
+#undef V_GT
+#undef V_GE
+#undef V_EQ
+#undef V_NEQ
+}
+
+#endif // PERVIEW_X86
+
+
+// Find the zero crossings of n cubics
+void find_zeros_hermite(int n, const float *a, const float *b,
+			const float *c, const float *val0,
+			const float *val1, float *s, PerviewKernel k)
+{
+#if PERVIEW_X86
+	if (k == PERVIEW_AVX) {
+		hermite_avx(n, a, b, c, val0, val1, s);
+		return;
+	}
+	if (k == PERVIEW_SSE) {
+		hermite_sse(n, a, b, c, val0, val1, s);
+		return;
+	}
+#endif
+	hermite_scalar(n, a, b, c, val0, val1, s);
+}
@@ -0,0 +1,96 @@
+/*
+perview.h
+Vectorized computation of the per-view quantities used by the line
+extractor: n dot v, radial curvature, and the suggestive contour and
+suggestive highlight tests.
+
+The per-vertex mesh data these need (position, normal, principal
+directions and curvatures, dcurv) are copied once per mesh into a
+structure of arrays, which the kernels then stream through 8 (AVX) or
+4 (SSE) vertices at a time.  The kernel is chosen at run time from what
+the CPU supports; the scalar fallback performs exactly the same float
+operations in the same order, so all three give bitwise-identical
+results.
+
+Hermite interpolation of suggestive contours and highlights is
+vectorized the same way: the gradient of kr, across a list of vertices,
+and the zero finder, across a batch of crossed edges.
+*/
+
+#ifndef PERVIEW_H
+#define PERVIEW_H
+
+#include <vector>
+#include "TriMesh.h"
+
+
+// Per-vertex mesh data, as a structure of arrays
+struct PerviewPack {
+	int nv;
+	std::vector<float> vx, vy, vz;		// Vertices
+	std::vector<float> nx, ny, nz;		// Normals
+	std::vector<float> p1x, p1y, p1z;	// pdir1
+	std::vector<float> p2x, p2y, p2z;	// pdir2
+	std::vector<float> c1, c2;		// curv1, curv2
+	std::vector<float> d0, d1, d2, d3;	// dcurv
+
+	PerviewPack() : nv(0) {}
+	// Copy the data out of the mesh, which must have normals,
+	// curvatures and dcurv
+	void build(const TriMesh *mesh);
+	void clear();
+};
+
+
+// Inputs and outputs of the per-view kernel.  The outputs may be NULL
+// when not wanted: sctest_num and sctest_den are only computed if
+// non-NULL, and shtest_num additionally needs sctest_num.
+struct PerviewArgs {
+	point viewpos;
+	float scthresh, shthresh;
+	bool extra_sin2theta;	// Scale sctest_num by an extra sin^2 theta
+	float *ndotv, *kr;
+	float *sctest_num, *sctest_den, *shtest_num;
+};
+
+
+// Which kernel compute_perview_pack uses
+enum PerviewKernel { PERVIEW_SCALAR, PERVIEW_SSE, PERVIEW_AVX };
+
+// The best kernel supported by this CPU.  The LINEDRAWING_SIMD
+// environment variable (scalar, sse or avx) can force a slower one.
+extern PerviewKernel perview_kernel();
+extern const char *perview_kernel_name(PerviewKernel k);
+
+// Compute the per-view quantities for vertices [begin, end)
+extern void compute_perview_pack(const PerviewPack &pack,
+				 const PerviewArgs &args,
+				 int begin, int end,
+				 PerviewKernel k = perview_kernel());
+
+// For vertices [begin, end), whose per-view quantities in args were just
+// computed, find how far the view position may move before any of them
+// could change sign or the view direction at the vertex could turn by
+// more than slack.  Writes the squares of those distances to radius2.
+// Used to skip vertices on the following frames.
+extern void compute_perview_radius(const PerviewPack &pack,
+				   const PerviewArgs &args, float slack,
+				   int begin, int end, float *radius2);
+
+// Compute the gradient of kr * sin^2 theta, for the view position
+// viewpos, at each of the n vertices in verts.  Writes it to
+// grad[verts[i]].
+extern void compute_gradkr_pack(const PerviewPack &pack, const point &viewpos,
+				const int *verts, int n, vec *grad,
+				PerviewKernel k = perview_kernel());
+
+// Find where each of n cubics a*s^3 + b*s^2 + c*s + val0, which go from
+// val0 at s = 0 to val1 at s = 1, crosses zero in [0,1], by bisection.
+// Where there are three crossings, finds the middle one.  Writes the
+// crossings to s.
+extern void find_zeros_hermite(int n, const float *a, const float *b,
+			       const float *c, const float *val0,
+			       const float *val1, float *s,
+			       PerviewKernel k = perview_kernel());
+
+#endif
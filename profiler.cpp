@@ -0,0 +1,219 @@
+/*
+profiler.cpp
+Per-stage timing of frames: see profiler.h.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "profiler.h"
+
+using namespace std;
+
+
+FrameProfiler::FrameProfiler(int history_size) :
+	frames(max(history_size, 1)), first(0), nframes(0),
+	epoch(now()), frame_start(epoch), frame_offset(0.0),
+	in_frame(false), implicit_frame(false)
+{
+}
+
+
+// Start a new frame, which replaces the oldest one once the history is
+// full.  The frame's events keep their storage, so that after the first
+// few frames nothing is allocated.
+void FrameProfiler::begin_frame()
+{
+	if (in_frame)
+		end_frame();
+
+	// Accumulate the offset from the epoch one frame at a time, since
+	// the difference of two timestamps is only a float
+	timestamp t = now();
+	frame_offset += t - frame_start;
+	frame_start = t;
+
+	if (nframes < (int) frames.size())
+		nframes++;
+	else
+		first = (first + 1) % frames.size();
+	ProfileFrame &f = current();
+	f.start = frame_offset;
+	f.duration = 0.0f;
+	f.events.clear();
+	open.clear();
+	in_frame = true;
+	implicit_frame = false;
+}
+
+
+// End the frame, closing any zones still open
+void FrameProfiler::end_frame()
+{
+	if (!in_frame)
+		return;
+	ProfileFrame &f = current();
+	float t = since_frame_start();
+	while (!open.empty()) {
+		ProfileEvent &e = f.events[open.back()];
+		e.duration = t - e.start;
+		open.pop_back();
+	}
+	f.duration = t;
+	in_frame = false;
+}
+
+
+void FrameProfiler::enter(const char *name)
+{
+	if (!in_frame) {
+		begin_frame();
+		implicit_frame = true;
+	}
+	ProfileEvent e = { name, (int) open.size(), since_frame_start(), 0.0f };
+	ProfileFrame &f = current();
+	open.push_back(f.events.size());
+	f.events.push_back(e);
+}
+
+
+void FrameProfiler::leave()
+{
+	if (!in_frame || open.empty())
+		return;
+	ProfileEvent &e = current().events[open.back()];
+	e.duration = since_frame_start() - e.start;
+	open.pop_back();
+	if (open.empty() && implicit_frame)
+		end_frame();
+}
+
+
+const ProfileFrame &FrameProfiler::frame(int i) const
+{
+	return frames[(first + i) % frames.size()];
+}
+
+
+void FrameProfiler::clear()
+{
+	first = nframes = 0;
+	open.clear();
+	in_frame = implicit_frame = false;
+}
+
+
+// Total time spent in zones called name in frame f
+static float zone_total(const ProfileFrame &f, const char *name)
+{
+	float total = 0.0f;
+	for (size_t i = 0; i < f.events.size(); i++)
+		if (!strcmp(f.events[i].name, name))
+			total += f.events[i].duration;
+	return total;
+}
+
+
+// Average and worst time of the whole frame and of each zone.  A zone
+// entered several times in a frame counts with its total.
+void FrameProfiler::summary(vector<ProfileSummary> &out) const
+{
+	out.clear();
+	if (!nframes)
+		return;
+
+	// The frame itself, which is never partly open in the history
+	int nfull = (in_frame ? nframes - 1 : nframes);
+	ProfileSummary s = { "frame", 0, 0.0f, 0.0f };
+	for (int i = 0; i < nfull; i++) {
+		s.average += frame(i).duration;
+		s.worst = max(s.worst, frame(i).duration);
+	}
+	if (nfull)
+		s.average /= nfull;
+	out.push_back(s);
+
+	// The zones of the latest complete frame
+	if (!nfull)
+		return;
+	const ProfileFrame &latest = frame(nfull - 1);
+	for (size_t i = 0; i < latest.events.size(); i++) {
+		const ProfileEvent &e = latest.events[i];
+		bool seen = false;
+		for (size_t j = 1; j < out.size() && !seen; j++)
+			seen = !strcmp(out[j].name, e.name);
+		if (seen)
+			continue;
+
+		ProfileSummary z = { e.name, e.depth + 1, 0.0f, 0.0f };
+		for (int k = 0; k < nfull; k++) {
+			float t = zone_total(frame(k), e.name);
+			z.average += t;
+			z.worst = max(z.worst, t);
+		}
+		z.average /= nfull;
+		out.push_back(z);
+	}
+}
+
+
+// Write a string as a JSON string literal
+static void write_json_string(FILE *f, const char *s)
+{
+	putc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char) *s < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char) *s);
+		else
+			putc(*s, f);
+	}
+	putc('"', f);
+}
+
+
+// One complete ("X") event.  Times are in microseconds.
+static void write_trace_event(FILE *f, bool &first_event, const char *name,
+			      double start, double duration)
+{
+	fprintf(f, "%s\n{\"name\":", first_event ? "" : ",");
+	write_json_string(f, name);
+	fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+		   "\"ts\":%.3f,\"dur\":%.3f}", start * 1.0e6, duration * 1.0e6);
+	first_event = false;
+}
+
+
+// Write the history as Chrome trace-event JSON: one event for each
+// frame, and one for each zone inside it
+bool FrameProfiler::write_chrome_trace(const char *filename) const
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first_event = true;
+	int nfull = (in_frame ? nframes - 1 : nframes);
+	for (int i = 0; i < nfull; i++) {
+		const ProfileFrame &fr = frame(i);
+		write_trace_event(f, first_event, "frame",
+				  fr.start, fr.duration);
+		for (size_t j = 0; j < fr.events.size(); j++) {
+			const ProfileEvent &e = fr.events[j];
+			write_trace_event(f, first_event, e.name,
+					  fr.start + e.start, e.duration);
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	bool ok = !ferror(f);
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Couldn't write %s\n", filename);
+	return ok;
+}
@@ -0,0 +1,111 @@
+/*
+profiler.h
+Per-stage timing of frames, built on timestamp.h.
+
+A FrameProfiler records the time spent in named zones, nested as they
+are entered and left, for each frame between begin_frame() and
+end_frame().  The last history_size frames are kept in a ring buffer,
+from which summary() gives the average and worst time of every zone
+(for an on-screen overlay) and write_chrome_trace() writes the frames
+as Chrome trace-event JSON, for chrome://tracing or Perfetto.
+
+Zones are usually timed with a ProfileScope, or the PROFILE_ZONE macro,
+which does nothing if the profiler is NULL.  Only the thread that calls
+begin_frame() should enter zones; they can of course contain parallel
+loops.  Zone names must be string literals (or otherwise outlive the
+profiler), since only the pointers are stored.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include "timestamp.h"
+
+
+// One timed zone within a frame.  Times are in seconds from the start
+// of the frame.
+struct ProfileEvent {
+	const char *name;
+	int depth;
+	float start, duration;
+};
+
+// One frame: its start (in seconds since the profiler was created), its
+// length, and its zones in the order they were entered
+struct ProfileFrame {
+	double start;
+	float duration;
+	std::vector<ProfileEvent> events;
+};
+
+// Average and worst time of one zone over the frames in the history
+struct ProfileSummary {
+	const char *name;
+	int depth;
+	float average, worst;	// Per frame, in seconds
+};
+
+
+class FrameProfiler {
+public:
+	FrameProfiler(int history_size = 120);
+
+	// Start and end a frame.  Zones entered outside a frame go into
+	// a frame of their own, ended when the last of them is left.
+	void begin_frame();
+	void end_frame();
+	// Enter and leave a zone
+	void enter(const char *name);
+	void leave();
+
+	// The frames in the history, oldest first
+	int num_frames() const { return nframes; }
+	const ProfileFrame &frame(int i) const;
+	void clear();
+
+	// Average and worst time of each zone over the history, in the
+	// order the zones were first entered in the latest frame
+	void summary(std::vector<ProfileSummary> &out) const;
+	// Write the history as Chrome trace-event JSON
+	bool write_chrome_trace(const char *filename) const;
+
+private:
+	std::vector<ProfileFrame> frames;	// Ring buffer
+	int first, nframes;
+	timestamp epoch, frame_start;
+	double frame_offset;			// frame_start - epoch
+	bool in_frame, implicit_frame;
+	std::vector<int> open;			// Indices of open events
+
+	ProfileFrame &current() { return frames[(first + nframes - 1) %
+						frames.size()]; }
+	float since_frame_start() const { return now() - frame_start; }
+};
+
+
+// Times a zone for as long as it is in scope
+class ProfileScope {
+public:
+	ProfileScope(FrameProfiler *profiler_, const char *name) :
+		profiler(profiler_)
+	{
+		if (profiler)
+			profiler->enter(name);
+	}
+	~ProfileScope()
+	{
+		if (profiler)
+			profiler->leave();
+	}
+
+private:
+	FrameProfiler *profiler;
+};
+
+#define PROFILE_ZONE_NAME2(line) profile_zone_ ## line
+#define PROFILE_ZONE_NAME(line) PROFILE_ZONE_NAME2(line)
+#define PROFILE_ZONE(profiler, name) \
+	ProfileScope PROFILE_ZONE_NAME(__LINE__)(profiler, name)
+
+#endif
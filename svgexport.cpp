@@ -0,0 +1,213 @@
+/*
+svgexport.cpp
+Write line drawings as SVG: see svgexport.h.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include "svgexport.h"
+#include "depthbuffer.h"
+
+using namespace std;
+
+// Levels of opacity a path can have
+#define ALPHA_LEVELS 32
+
+
+// Streams the visible runs of the lines of one family as paths.  Each
+// path has one opacity; the first point is held back until there is a
+// second, so that no path is a single point.
+class SvgPathWriter {
+	FILE *f;
+	int level;	// The opacity of the open path, or 0 if none is open
+	int npts;
+	float x0, y0;
+public:
+	SvgPathWriter(FILE *f_) : f(f_), level(0), npts(0), x0(0), y0(0) {}
+	~SvgPathWriter() { end(); }
+	int open_level() const { return level; }
+	void move(float x, float y, int level_)
+	{
+		end();
+		level = level_;
+		npts = 1;
+		x0 = x; y0 = y;
+	}
+	void line(float x, float y)
+	{
+		if (npts == 1) {
+			fprintf(f, "<path");
+			if (level < ALPHA_LEVELS)
+				fprintf(f, " stroke-opacity=\"%.3g\"",
+					float(level) / ALPHA_LEVELS);
+			fprintf(f, " d=\"M%.2f %.2f", x0, y0);
+		}
+		fprintf(f, " %.2f %.2f", x, y);
+		npts++;
+	}
+	void end()
+	{
+		if (npts > 1)
+			fprintf(f, "\"/>\n");
+		level = npts = 0;
+	}
+};
+
+
+// A point of a line, in pixels
+struct ScreenPoint {
+	float x, y, q;
+};
+
+
+// Write the visible runs of one edge of a polyline, from a to b.  The edge
+// is tested against the depth buffer about once per depth sample.
+static void write_edge(SvgPathWriter &w, const ScreenPoint &a,
+		       const ScreenPoint &b, float alpha,
+		       const DepthBuffer *depth)
+{
+	int level = min(int(alpha * ALPHA_LEVELS + 0.5f), ALPHA_LEVELS);
+	if (level <= 0 || a.q == 0.0f || b.q == 0.0f) {
+		w.end();
+		return;
+	}
+
+	int ns = 1;
+	if (depth) {
+		float len = sqrt(sqr(b.x - a.x) + sqr(b.y - a.y));
+		ns = max(1, int(ceil(len * depth->oversample)));
+		ns = min(ns, 1 << 16);
+	}
+
+	// The last visible sample, if it hasn't been written yet
+	bool pending = false;
+	float px = 0.0f, py = 0.0f;
+	for (int k = 0; k <= ns; k++) {
+		float t = float(k) / ns;
+		float x = a.x + t * (b.x - a.x);
+		float y = a.y + t * (b.y - a.y);
+		float q = a.q + t * (b.q - a.q);
+		bool vis = !depth || depth->visible(x, y, q);
+		if (vis) {
+			if (w.open_level() != level) {
+				w.move(x, y, level);
+				pending = false;
+			} else if (k == ns) {
+				w.line(x, y);
+				pending = false;
+			} else if (k > 0) {
+				pending = true;
+				px = x; py = y;
+			}
+		} else {
+			if (pending)
+				w.line(px, py);
+			pending = false;
+			w.end();
+		}
+	}
+}
+
+
+// A color component from 0 to 255
+static int color_byte(float c)
+{
+	return int(255.0f * min(max(c, 0.0f), 1.0f) + 0.5f);
+}
+
+
+// Write one family of lines as a group of paths
+static void write_family(FILE *f, const char *id, const SegmentBuffer &segs,
+			 const StrokeBuffer &strokes, const LineStyle &style,
+			 const ScreenProjection &proj,
+			 const DepthBuffer *depth)
+{
+	if (segs.empty())
+		return;
+	const vec &c = style.color;
+	fprintf(f, "<g id=\"%s\" stroke=\"rgb(%d,%d,%d)\" stroke-width=\"%g\" "
+		   "fill=\"none\" stroke-linecap=\"round\" "
+		   "stroke-linejoin=\"round\">\n", id,
+		color_byte(c[0]),
+		color_byte(c[1]),
+		color_byte(c[2]),
+		style.width);
+
+	SvgPathWriter w(f);
+	ScreenPoint a, b;
+	if (!strokes.empty()) {
+		for (int i = 0; i < strokes.size(); i++) {
+			int end = strokes.stroke_end(i);
+			int j = strokes.stroke_begin(i);
+			a.q = proj.project(strokes.pts[j], a.x, a.y);
+			for (j++; j < end; j++) {
+				b.q = proj.project(strokes.pts[j], b.x, b.y);
+				float alpha = 0.5f * (strokes.alpha[j-1] +
+						      strokes.alpha[j]);
+				write_edge(w, a, b, alpha, depth);
+				a = b;
+			}
+			w.end();
+		}
+	} else {
+		for (int i = 0; i < (int) segs.pts.size(); i += 2) {
+			a.q = proj.project(segs.pts[i], a.x, a.y);
+			b.q = proj.project(segs.pts[i+1], b.x, b.y);
+			float alpha = 0.5f * (segs.alpha[i] + segs.alpha[i+1]);
+			write_edge(w, a, b, alpha, depth);
+			w.end();
+		}
+	}
+	w.end();
+	fprintf(f, "</g>\n");
+}
+
+
+bool write_svg(const char *filename, const TriMesh *mesh, const xform &xf,
+	       const LineSet &lines, const LineStyle *styles,
+	       const LineSet *hidden, const LineStyle *hidden_styles,
+	       const SvgOptions &opts)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	ScreenProjection proj;
+	proj.set(mesh, xf, opts.width, opts.height, opts.fov);
+	DepthBuffer depth;
+	if (opts.hide)
+		depth.render(mesh, proj, opts.oversample);
+	const DepthBuffer *test = opts.hide ? &depth : NULL;
+
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" "
+		   "width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+		opts.width, opts.height, opts.width, opts.height);
+
+	write_family(f, line_family_names[LINES_SILHOUETTE],
+		     lines[LINES_SILHOUETTE], lines.strokes[LINES_SILHOUETTE],
+		     styles[LINES_SILHOUETTE], proj, test);
+	if (hidden) {
+		for (int i = LINES_SILHOUETTE + 1; i < NUM_LINE_FAMILIES; i++) {
+			string id = string("hidden-") + line_family_names[i];
+			write_family(f, id.c_str(), (*hidden)[i],
+				     hidden->strokes[i], hidden_styles[i],
+				     proj, NULL);
+		}
+	}
+	for (int i = LINES_SILHOUETTE + 1; i < NUM_LINE_FAMILIES; i++)
+		write_family(f, line_family_names[i], lines[i],
+			     lines.strokes[i], styles[i], proj, test);
+
+	fprintf(f, "</svg>\n");
+
+	bool ok = !ferror(f);
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Couldn't write %s\n", filename);
+	return ok;
+}
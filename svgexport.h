@@ -0,0 +1,40 @@
+/*
+svgexport.h
+Write line drawings as SVG, with the parts of lines hidden by the mesh
+removed on the CPU (see depthbuffer.h) rather than left to a renderer.
+
+The families are drawn in the order the viewer draws them: the exterior
+silhouette, then the hidden-line pass (if any) without a depth test, then
+the rest in the order of the LineFamily enum.  Each family is a group
+carrying its color and width, and each visible run of a stroke is a path,
+so that chained lines (LineOptions::chain_lines) come out as long paths.
+*/
+
+#ifndef SVGEXPORT_H
+#define SVGEXPORT_H
+
+#include "TriMesh.h"
+#include "XForm.h"
+#include "lineextractor.h"
+#include "linestyle.h"
+
+
+struct SvgOptions {
+	int width, height;	// In pixels
+	float fov;		// Along the diagonal, as in GLCamera
+	int hide;		// Remove the parts of lines hidden by the mesh
+	int oversample;		// Depth samples per pixel along each axis
+
+	SvgOptions() : width(1024), height(1024), fov(0.7f), hide(1),
+		oversample(2) {}
+};
+
+
+// Write lines (and, unless it is NULL, the hidden-line pass) of the mesh
+// seen through xf.  Returns false if the file couldn't be written.
+extern bool write_svg(const char *filename, const TriMesh *mesh,
+		      const xform &xf, const LineSet &lines,
+		      const LineStyle *styles, const LineSet *hidden,
+		      const LineStyle *hidden_styles, const SvgOptions &opts);
+
+#endif